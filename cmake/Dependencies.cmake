@@ -147,7 +147,7 @@ if(NOT APPLE)
 	endif()
 endif()
 
-set(Qt5_MODULES Widgets Network)
+set(Qt5_MODULES Core Widgets Network)
 FIND_PACKAGE(Qt5 5.9.5 COMPONENTS ${Qt5_MODULES})
 IF(NOT Qt5_FOUND)
   message(FATAL_ERROR "Is env variable Qt5_DIR set correctly? Currently: $Qt5_DIR")
@@ -0,0 +1,105 @@
+ /***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: http://www.luxrender.net                             *
+ ***************************************************************************/
+
+#ifndef LUX_ALIGNEDBUFFER_H
+#define LUX_ALIGNEDBUFFER_H
+
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+#if defined(WIN32)
+#include <malloc.h>
+#endif
+
+namespace lux {
+
+// Size of the alignment used for SIMD friendly buffers (a cache line)
+#define LUX_BUFFER_ALIGNMENT 64
+
+inline void *AllocAligned(const size_t size) {
+#if defined(WIN32)
+	void *ptr = _aligned_malloc(size, LUX_BUFFER_ALIGNMENT);
+#else
+	void *ptr = NULL;
+	if (posix_memalign(&ptr, LUX_BUFFER_ALIGNMENT, size) != 0)
+		ptr = NULL;
+#endif
+	if (!ptr)
+		throw std::bad_alloc();
+
+	return ptr;
+}
+
+inline void FreeAligned(void *ptr) {
+#if defined(WIN32)
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
+
+// A buffer of POD elements aligned to LUX_BUFFER_ALIGNMENT. The memory is
+// only reallocated when Resize() asks for more elements than the current
+// capacity, so a buffer sized once can be reused without any allocation.
+template <class T> class AlignedBuffer {
+public:
+	AlignedBuffer() : data(NULL), size(0), capacity(0) { }
+	~AlignedBuffer() { FreeAligned(data); }
+
+	void Resize(const size_t s) {
+		if (s > capacity) {
+			FreeAligned(data);
+			data = NULL;
+			capacity = 0;
+
+			data = static_cast<T *>(AllocAligned(s * sizeof(T)));
+			capacity = s;
+		}
+		size = s;
+	}
+
+	void Free() {
+		FreeAligned(data);
+		data = NULL;
+		size = 0;
+		capacity = 0;
+	}
+
+	T *Get() { return data; }
+	const T *Get() const { return data; }
+	size_t GetSize() const { return size; }
+
+	T &operator[](const size_t i) { return data[i]; }
+	const T &operator[](const size_t i) const { return data[i]; }
+
+private:
+	// Not copyable
+	AlignedBuffer(const AlignedBuffer &);
+	AlignedBuffer &operator=(const AlignedBuffer &);
+
+	T *data;
+	size_t size, capacity;
+};
+
+}
+
+#endif
@@ -0,0 +1,282 @@
+ /***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: http://www.luxrender.net                             *
+ ***************************************************************************/
+
+#include <cmath>
+#include <cstring>
+#include <cfloat>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "convtest/colorspace.h"
+
+using namespace lux;
+
+//------------------------------------------------------------------------------
+// Fast transcendental functions
+//------------------------------------------------------------------------------
+
+// log(m) = 2 * atanh(s) with s = (m - 1) / (m + 1), m in [sqrt(0.5), sqrt(2)]
+// so |s| < 0.1716 and the series truncated after s^7 is exact to 3e-8
+#define LOG2_C0 (2.f / 0.69314718f)
+#define LOG2_C1 (LOG2_C0 / 3.f)
+#define LOG2_C2 (LOG2_C0 / 5.f)
+#define LOG2_C3 (LOG2_C0 / 7.f)
+
+// Taylor series of exp(t) for |t| <= 0.5 * log(2), truncated after t^7
+#define EXP2_LN2 0.69314718f
+#define EXP2_C2 (1.f / 2.f)
+#define EXP2_C3 (1.f / 6.f)
+#define EXP2_C4 (1.f / 24.f)
+#define EXP2_C5 (1.f / 120.f)
+#define EXP2_C6 (1.f / 720.f)
+#define EXP2_C7 (1.f / 5040.f)
+
+static inline unsigned int FloatAsBits(const float f) {
+	unsigned int i;
+	memcpy(&i, &f, sizeof(float));
+	return i;
+}
+
+static inline float BitsAsFloat(const unsigned int i) {
+	float f;
+	memcpy(&f, &i, sizeof(float));
+	return f;
+}
+
+float lux::FastLog2(const float x) {
+	const unsigned int bits = FloatAsBits(x);
+	int e = (int)((bits >> 23) & 0xff) - 127;
+	float m = BitsAsFloat((bits & 0x007fffffu) | 0x3f800000u);
+	if (m > 1.41421356f) {
+		m *= .5f;
+		e += 1;
+	}
+
+	const float s = (m - 1.f) / (m + 1.f);
+	const float s2 = s * s;
+	const float p = LOG2_C0 + s2 * (LOG2_C1 + s2 * (LOG2_C2 + s2 * LOG2_C3));
+
+	return e + s * p;
+}
+
+float lux::FastExp2(const float x) {
+	const float y = (x < -126.f) ? -126.f : ((x > 127.f) ? 127.f : x);
+	const int n = (int)floorf(y + .5f);
+	const float t = (y - n) * EXP2_LN2;
+	const float p = 1.f + t * (1.f + t * (EXP2_C2 + t * (EXP2_C3 + t * (EXP2_C4 +
+			t * (EXP2_C5 + t * (EXP2_C6 + t * EXP2_C7))))));
+
+	return p * BitsAsFloat((unsigned int)(n + 127) << 23);
+}
+
+float lux::FastPow(const float x, const float y) {
+	if (!(x >= FLT_MIN))
+		return 0.f;
+
+	return FastExp2(y * FastLog2(x));
+}
+
+float lux::FastCbrt(const float x) {
+	return FastPow(x, 1.f / 3.f);
+}
+
+#if defined(__SSE2__)
+static inline __m128 FastLog2SSE(const __m128 x) {
+	const __m128i bits = _mm_castps_si128(x);
+	__m128i e = _mm_sub_epi32(_mm_and_si128(_mm_srli_epi32(bits, 23), _mm_set1_epi32(0xff)),
+			_mm_set1_epi32(127));
+	__m128 m = _mm_castsi128_ps(_mm_or_si128(_mm_and_si128(bits, _mm_set1_epi32(0x007fffff)),
+			_mm_set1_epi32(0x3f800000)));
+
+	const __m128 big = _mm_cmpgt_ps(m, _mm_set1_ps(1.41421356f));
+	m = _mm_or_ps(_mm_and_ps(big, _mm_mul_ps(m, _mm_set1_ps(.5f))), _mm_andnot_ps(big, m));
+	// The mask is -1 where the mantissa has been halved
+	e = _mm_sub_epi32(e, _mm_castps_si128(big));
+
+	const __m128 one = _mm_set1_ps(1.f);
+	const __m128 s = _mm_div_ps(_mm_sub_ps(m, one), _mm_add_ps(m, one));
+	const __m128 s2 = _mm_mul_ps(s, s);
+	__m128 p = _mm_add_ps(_mm_set1_ps(LOG2_C2), _mm_mul_ps(s2, _mm_set1_ps(LOG2_C3)));
+	p = _mm_add_ps(_mm_set1_ps(LOG2_C1), _mm_mul_ps(s2, p));
+	p = _mm_add_ps(_mm_set1_ps(LOG2_C0), _mm_mul_ps(s2, p));
+
+	return _mm_add_ps(_mm_cvtepi32_ps(e), _mm_mul_ps(s, p));
+}
+
+static inline __m128 FastExp2SSE(const __m128 x) {
+	const __m128 y = _mm_min_ps(_mm_max_ps(x, _mm_set1_ps(-126.f)), _mm_set1_ps(127.f));
+	// Round to nearest, as floorf(y + .5f) in the scalar version apart
+	// from the exact .5 ties, which both give |y - n| = .5
+	const __m128i n = _mm_cvtps_epi32(y);
+	const __m128 t = _mm_mul_ps(_mm_sub_ps(y, _mm_cvtepi32_ps(n)), _mm_set1_ps(EXP2_LN2));
+
+	__m128 p = _mm_add_ps(_mm_set1_ps(EXP2_C6), _mm_mul_ps(t, _mm_set1_ps(EXP2_C7)));
+	p = _mm_add_ps(_mm_set1_ps(EXP2_C5), _mm_mul_ps(t, p));
+	p = _mm_add_ps(_mm_set1_ps(EXP2_C4), _mm_mul_ps(t, p));
+	p = _mm_add_ps(_mm_set1_ps(EXP2_C3), _mm_mul_ps(t, p));
+	p = _mm_add_ps(_mm_set1_ps(EXP2_C2), _mm_mul_ps(t, p));
+	p = _mm_add_ps(_mm_set1_ps(1.f), _mm_mul_ps(t, p));
+	p = _mm_add_ps(_mm_set1_ps(1.f), _mm_mul_ps(t, p));
+
+	const __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23));
+
+	return _mm_mul_ps(p, scale);
+}
+
+static inline __m128 FastPowSSE(const __m128 x, const __m128 y) {
+	const __m128 valid = _mm_cmpge_ps(x, _mm_set1_ps(FLT_MIN));
+
+	return _mm_and_ps(valid, FastExp2SSE(_mm_mul_ps(y, FastLog2SSE(x))));
+}
+#endif
+
+void lux::FastPow(const float *in, const float y, const unsigned int count, float *out) {
+	unsigned int i = 0;
+#if defined(__SSE2__)
+	const __m128 vy = _mm_set1_ps(y);
+	for (; i + 4 <= count; i += 4)
+		_mm_storeu_ps(&out[i], FastPowSSE(_mm_loadu_ps(&in[i]), vy));
+#endif
+	for (; i < count; ++i)
+		out[i] = FastPow(in[i], y);
+}
+
+void lux::FastCbrt(const float *in, const unsigned int count, float *out) {
+	FastPow(in, 1.f / 3.f, count, out);
+}
+
+//------------------------------------------------------------------------------
+// ColorSpaceConverter
+//------------------------------------------------------------------------------
+
+// Number of pixels converted at a time with the stack buffers
+#define CONVERT_CHUNK_SIZE 256
+
+// convert Adobe RGB (1998) with reference white D65 to XYZ
+static inline void AdobeRGBToXYZ(float r, float g, float b, float &x, float &y, float &z)
+{
+	// matrix is from http://www.brucelindbloom.com/
+	x = r * 0.576700f + g * 0.185556f + b * 0.188212f;
+	y = r * 0.297361f + g * 0.627355f + b * 0.0752847f;
+	z = r * 0.0270328f + g * 0.0706879f + b * 0.991248f;
+}
+
+ColorSpaceConverter::ColorSpaceConverter(const float g, const float l) :
+		gamma(g), luminance(l) {
+	AdobeRGBToXYZ(1.f, 1.f, 1.f, xw, yw, zw);
+
+	for (unsigned int i = 0; i < 256; ++i)
+		gammaLUT[i] = powf(i / 255.f, gamma);
+}
+
+void ColorSpaceConverter::LinearizeChunk(const float *rgb, const unsigned int count,
+		float *linear) const {
+	const unsigned int valueCount = 3 * count;
+
+	// Check if all the values come from 8 bit data
+	unsigned int i = 0;
+	for (; i < valueCount; ++i) {
+		const float v = rgb[i];
+		if (!((v >= 0.f) && (v <= 1.f)))
+			break;
+
+		const unsigned int index = (unsigned int)(v * 255.f + .5f);
+		if (v != index / 255.f)
+			break;
+
+		linear[i] = gammaLUT[index];
+	}
+
+	if (i < valueCount)
+		FastPow(rgb, gamma, valueCount, linear);
+}
+
+void ColorSpaceConverter::ConvertChunk(const float *rgb, const unsigned int count,
+		float *lum, float *A, float *B) const {
+	float linear[3 * CONVERT_CHUNK_SIZE];
+	LinearizeChunk(rgb, count, linear);
+
+	float r[3][CONVERT_CHUNK_SIZE];
+	for (unsigned int i = 0; i < count; ++i) {
+		float x, y, z;
+		AdobeRGBToXYZ(linear[3 * i], linear[3 * i + 1], linear[3 * i + 2], x, y, z);
+
+		lum[i] = y * luminance;
+		r[0][i] = x / xw;
+		r[1][i] = y / yw;
+		r[2][i] = z / zw;
+	}
+
+	const float epsilon  = 216.0f / 24389.0f;
+	const float kappa = 24389.0f / 27.0f;
+	float f[3][CONVERT_CHUNK_SIZE];
+	for (unsigned int c = 0; c < 3; ++c) {
+		FastCbrt(r[c], count, f[c]);
+		for (unsigned int i = 0; i < count; ++i) {
+			if (!(r[c][i] > epsilon))
+				f[c][i] = (kappa * r[c][i] + 16.0f) / 116.0f;
+		}
+	}
+
+	for (unsigned int i = 0; i < count; ++i) {
+		A[i] = 500.0f * (f[0][i] - f[1][i]);
+		B[i] = 200.0f * (f[1][i] - f[2][i]);
+	}
+}
+
+void ColorSpaceConverter::RGBToLumAB(const float *rgb, const unsigned int count,
+		float *lum, float *A, float *B) const {
+	for (unsigned int first = 0; first < count; first += CONVERT_CHUNK_SIZE) {
+		const unsigned int size = (count - first > CONVERT_CHUNK_SIZE) ? CONVERT_CHUNK_SIZE : (count - first);
+		ConvertChunk(&rgb[3 * first], size, &lum[first], &A[first], &B[first]);
+	}
+}
+
+void ColorSpaceConverter::RGBToLumABReference(const float *rgb, const unsigned int count,
+		float *lum, float *A, float *B) const {
+	const float epsilon  = 216.0f / 24389.0f;
+	const float kappa = 24389.0f / 27.0f;
+
+	for (unsigned int i = 0; i < count; ++i) {
+		float x, y, z;
+		AdobeRGBToXYZ(powf(rgb[3 * i], gamma), powf(rgb[3 * i + 1], gamma), powf(rgb[3 * i + 2], gamma),
+				x, y, z);
+
+		float f[3];
+		float r[3];
+		r[0] = x / xw;
+		r[1] = y / yw;
+		r[2] = z / zw;
+		for (int c = 0; c < 3; c++) {
+			if (r[c] > epsilon) {
+				f[c] = powf(r[c], 1.0f / 3.0f);
+			} else {
+				f[c] = (kappa * r[c] + 16.0f) / 116.0f;
+			}
+		}
+
+		lum[i] = y * luminance;
+		A[i] = 500.0f * (f[0] - f[1]);
+		B[i] = 200.0f * (f[1] - f[2]);
+	}
+}
@@ -0,0 +1,92 @@
+ /***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: http://www.luxrender.net                             *
+ ***************************************************************************/
+
+#ifndef LUX_COLORSPACE_H
+#define LUX_COLORSPACE_H
+
+namespace lux {
+
+//------------------------------------------------------------------------------
+// Fast transcendental functions
+//
+// For x in [1e-10, 1e10], FastLog2() has an absolute error below 2e-6 (i.e.
+// about one ulp of the result), FastExp2() has a relative error below 1e-7
+// over its whole range and FastCbrt() has a relative error below 1e-6.
+// FastPow(x, 2.2) has a relative error below 2e-6 for x in [1e-4, 3] and
+// below 1e-5 for x in [1e-10, 1e10].
+// FastPow() and FastCbrt() return 0 for non positive (or denormal) inputs.
+//------------------------------------------------------------------------------
+
+extern float FastLog2(const float x);
+extern float FastExp2(const float x);
+extern float FastPow(const float x, const float y);
+extern float FastCbrt(const float x);
+
+// Array versions, SIMD accelerated when SSE2 is available. out can be the
+// same array as in.
+extern void FastPow(const float *in, const float y, const unsigned int count, float *out);
+extern void FastCbrt(const float *in, const unsigned int count, float *out);
+
+//------------------------------------------------------------------------------
+// ColorSpaceConverter
+//
+// Converts gamma encoded Adobe RGB (1998) pixels, with D65 reference white,
+// to the channels used by the pdiff metric: the luminance in cd/m^2 and the
+// a* and b* channels of CIE L*a*b*.
+//
+// Values coming from 8 bit data (i.e. exactly i / 255.f) are linearized with
+// a table holding powf(i / 255.f, gamma), so they give the same result as
+// powf(). Any other value goes through FastPow(), as it is: images with
+// values above 1 (e.g. a film output) must be clamped by the caller if they
+// are meant as displayed, see FilmToImage(). The L*a*b* cube root always
+// uses FastCbrt().
+//------------------------------------------------------------------------------
+
+class ColorSpaceConverter {
+public:
+	ColorSpaceConverter(const float gamma, const float luminance);
+
+	void RGBToLumAB(const float *rgb, const unsigned int count,
+			float *lum, float *A, float *B) const;
+
+	// The same conversion done with powf(), as in the original pdiff code
+	void RGBToLumABReference(const float *rgb, const unsigned int count,
+			float *lum, float *A, float *B) const;
+
+	float GetGamma() const { return gamma; }
+	float GetLuminance() const { return luminance; }
+
+private:
+	void LinearizeChunk(const float *rgb, const unsigned int count, float *linear) const;
+	void ConvertChunk(const float *rgb, const unsigned int count,
+			float *lum, float *A, float *B) const;
+
+	float gamma, luminance;
+	// Reference white
+	float xw, yw, zw;
+
+	// powf(i / 255.f, gamma)
+	float gammaLUT[256];
+};
+
+}
+
+#endif
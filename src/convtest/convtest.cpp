@@ -28,11 +28,17 @@
 
 using namespace lux;
 
+// Conversion parameters of all the images tested
+#define CONVTEST_GAMMA 2.2f
+#define CONVTEST_LUMINANCE 100.f
+
 //------------------------------------------------------------------------------
 // ConvergenceTest class
 //------------------------------------------------------------------------------
 
-ConvergenceTest::ConvergenceTest(const u_int w, const u_int h) : width(w), height(h) {
+ConvergenceTest::ConvergenceTest(const unsigned int w, const unsigned int h) : width(w), height(h),
+		hasReference(false), workspace(w, h), referenceImage(&workspace.a),
+		testImage(&workspace.b) {
 }
 
 ConvergenceTest::~ConvergenceTest() {
@@ -42,26 +48,219 @@ void ConvergenceTest::NeedTVI() {
 	tvi.resize(width * height, 0.f);
 }
 
+void ConvergenceTest::SetStorage(const YeeStorage storage) {
+	// The reference is packed again by the next Test()
+	workspace.a.SetStorage(storage);
+	workspace.b.SetStorage(storage);
+	Reset();
+}
+
+void ConvergenceTest::ReleaseReferenceFile() {
+	if (referenceFile.IsMapped()) {
+		referenceFile.Unmap();
+		// Back to its own storage
+		referenceImage->Resize(width, height);
+	}
+}
+
 void ConvergenceTest::Reset() {
+	ReleaseReferenceFile();
 	reference.resize(0);
+	hasReference = false;
 }
 
-void ConvergenceTest::Reset(const u_int w, const u_int h) {
+void ConvergenceTest::Reset(const unsigned int w, const unsigned int h) {
+	ReleaseReferenceFile();
 	width = w;
 	height = h;
-	reference.resize(0);	
+	reference.resize(0);
+	hasReference = false;
+	workspace.Resize(width, height);
+	if (!tvi.empty())
+		tvi.resize(width * height, 0.f);
+}
+
+bool ConvergenceTest::LoadReference(const std::string &fileName, const unsigned long long key) {
+	Reset();
+
+	if (!referenceFile.Map(fileName, key, width, height, CONVTEST_GAMMA, CONVTEST_LUMINANCE,
+			*referenceImage))
+		return false;
+
+	hasReference = true;
+	return true;
+}
+
+bool ConvergenceTest::SaveReference(const std::string &fileName, const unsigned long long key) const {
+	if (!hasReference)
+		return false;
+
+	return YeeImageCacheFile::Save(fileName, key, *referenceImage);
+}
+
+bool ConvergenceTest::SetFirstReference(const float *image) {
+	if (hasReference)
+		return false;
+
+	const unsigned int pixelCount = width * height;
+	referenceImage->Build(image, CONVTEST_GAMMA, CONVTEST_LUMINANCE);
+	reference.resize(pixelCount * 3);
+	std::copy(image, image + pixelCount * 3, reference.begin());
+	hasReference = true;
+
+	return true;
+}
+
+bool ConvergenceTest::IsReference(const float *image) const {
+	return !reference.empty() && std::equal(image, image + width * height * 3, reference.begin());
+}
+
+void ConvergenceTest::NextReference(const float *image, const bool tested) {
+	if (tested) {
+		// The tested image is the next reference
+		std::swap(referenceImage, testImage);
+		if (referenceFile.IsMapped()) {
+			// The old reference was the mapped cache file
+			referenceFile.Unmap();
+			testImage->Resize(width, height);
+		}
+	}
+
+	const unsigned int pixelCount = width * height;
+	reference.resize(pixelCount * 3);
+	std::copy(image, image + pixelCount * 3, reference.begin());
 }
 
-u_int ConvergenceTest::Test(const float *image) {
-	const u_int pixelCount = width * height;
+unsigned int ConvergenceTest::Test(const float *image) {
+	if (SetFirstReference(image))
+		return width * height;
+
+	unsigned int count;
+	const bool tested = !IsReference(image);
+	if (tested) {
+		testImage->Build(image, CONVTEST_GAMMA, CONVTEST_LUMINANCE);
+		count = Yee_Compare(*referenceImage, *testImage, NULL,
+				tvi.empty() ? NULL : &tvi[0], &workspace);
+	} else {
+		// Yee_Compare() reports binary identical images as 1 pixel, the
+		// prepared reference is still valid
+		count = 1;
+	}
+
+	NextReference(image, tested);
+	return count;
+}
+
+YeeBoundedResult ConvergenceTest::TestBounded(const float *image, const unsigned int failedThreshold) {
+	YeeBoundedResult result;
+	result.pixelsTested = width * height;
+
+	if (SetFirstReference(image)) {
+		result.pixelsFailed = width * height;
+		result.failed = (result.pixelsFailed >= failedThreshold);
+		return result;
+	}
 
-	if (reference.size() == 0) {
-		reference.resize(pixelCount * 3);
-		std::copy(image, image + pixelCount * 3, reference.begin());
-		return pixelCount;
+	const bool tested = !IsReference(image);
+	if (tested) {
+		testImage->Build(image, CONVTEST_GAMMA, CONVTEST_LUMINANCE);
+		result = Yee_CompareBounded(*referenceImage, *testImage, failedThreshold,
+				false, 45.f, 1.f, &workspace.csfTables);
 	} else {
-		const u_int count = Yee_Compare(&reference[0], image, NULL, &tvi[0], width, height);
-		std::copy(image, image + pixelCount * 3, reference.begin());
-		return count;
+		result.pixelsFailed = 1;
+		result.failed = (result.pixelsFailed >= failedThreshold);
 	}
+
+	NextReference(image, tested);
+	return result;
+}
+
+YeeEstimate ConvergenceTest::Estimate(const float *image, const unsigned int sampleCount) {
+	YeeEstimate estimate;
+	estimate.samples = sampleCount;
+	estimate.samplesFailed = 0;
+	estimate.failedFraction = 0.f;
+	estimate.low = 0.f;
+	estimate.high = 0.f;
+
+	if (SetFirstReference(image)) {
+		estimate.samplesFailed = sampleCount;
+		estimate.failedFraction = 1.f;
+		estimate.low = 1.f;
+		estimate.high = 1.f;
+		return estimate;
+	}
+
+	const bool tested = !IsReference(image);
+	if (tested) {
+		testImage->Build(image, CONVTEST_GAMMA, CONVTEST_LUMINANCE);
+		estimate = Yee_CompareEstimate(*referenceImage, *testImage, sampleCount,
+				false, 45.f, 1.f, &workspace.csfTables);
+	}
+
+	NextReference(image, tested);
+	return estimate;
+}
+
+//------------------------------------------------------------------------------
+// MultiReferenceTest class
+//------------------------------------------------------------------------------
+
+MultiReferenceTest::MultiReferenceTest(const unsigned int w, const unsigned int h) : width(w), height(h),
+		storage(YEE_STORAGE_FLOAT), testImage(w, h) {
+}
+
+MultiReferenceTest::~MultiReferenceTest() {
+	ClearReferences();
+}
+
+void MultiReferenceTest::SetStorage(const YeeStorage s) {
+	storage = s;
+	testImage.SetStorage(storage);
+}
+
+unsigned int MultiReferenceTest::AddReference(const float *image) {
+	YeeImage *referenceImage = new YeeImage(width, height);
+	referenceImage->SetStorage(storage);
+	referenceImage->Build(image, CONVTEST_GAMMA, CONVTEST_LUMINANCE);
+
+	referenceImages.push_back(referenceImage);
+	referenceFiles.push_back(NULL);
+
+	return referenceImages.size() - 1;
+}
+
+bool MultiReferenceTest::AddReference(const std::string &fileName, const unsigned long long key) {
+	YeeImage *referenceImage = new YeeImage();
+	referenceImage->SetStorage(storage);
+	YeeImageCacheFile *referenceFile = new YeeImageCacheFile();
+	if (!referenceFile->Map(fileName, key, width, height, CONVTEST_GAMMA, CONVTEST_LUMINANCE,
+			*referenceImage)) {
+		delete referenceFile;
+		delete referenceImage;
+		return false;
+	}
+
+	referenceImages.push_back(referenceImage);
+	referenceFiles.push_back(referenceFile);
+
+	return true;
+}
+
+void MultiReferenceTest::ClearReferences() {
+	// The images are released before the files they map
+	for (unsigned int i = 0; i < referenceImages.size(); ++i)
+		delete referenceImages[i];
+	for (unsigned int i = 0; i < referenceFiles.size(); ++i)
+		delete referenceFiles[i];
+
+	referenceImages.clear();
+	referenceFiles.clear();
+}
+
+YeeMultiResult MultiReferenceTest::Test(const float *image) {
+	testImage.Build(image, CONVTEST_GAMMA, CONVTEST_LUMINANCE);
+
+	return Yee_CompareMulti(std::vector<const YeeImage *>(referenceImages.begin(), referenceImages.end()),
+			testImage, false, 45.f, 1.f, &csfTables);
 }
@@ -23,29 +23,111 @@
 #define LUX_CONVTEST_H
 
 #include <vector>
+#include <string>
 
-#include "luxrays/luxrays.h"
 #include "convtest/pdiff/metric.h"
+#include "convtest/referencecache.h"
 
 namespace lux {
 
 class ConvergenceTest {
 public:
-	ConvergenceTest(const u_int w, const u_int h);
+	ConvergenceTest(const unsigned int w, const unsigned int h);
 	virtual ~ConvergenceTest();
 
 	void NeedTVI();
+	// The storage used by the comparisons, see YeeImage::SetStorage()
+	void SetStorage(const YeeStorage storage);
 	const float *GetTVI() const { return &tvi[0]; }
 	
 	void Reset();
-	void Reset(const u_int w, const u_int h);
-	u_int Test(const float *image);
+	void Reset(const unsigned int w, const unsigned int h);
+	unsigned int Test(const float *image);
+	// Like Test() but it stops as soon as the result against failedThreshold
+	// is known, see Yee_CompareBounded()
+	YeeBoundedResult TestBounded(const float *image, const unsigned int failedThreshold);
+	// Like Test() but it only estimates the fraction of different pixels
+	// from about sampleCount samples, see Yee_CompareEstimate()
+	YeeEstimate Estimate(const float *image, const unsigned int sampleCount);
+
+	// The reference of the next Test() can be loaded from a cache file
+	// instead of being built from an image. The key identifies the source
+	// of the reference (e.g. HashImageData() of the reference file), a
+	// missing or stale cache file returns false.
+	bool LoadReference(const std::string &fileName, const unsigned long long key);
+	// Writes the current reference to a cache file
+	bool SaveReference(const std::string &fileName, const unsigned long long key) const;
 
 private:
-	u_int width, height;
+	void ReleaseReferenceFile();
+	// Returns true if there was no reference yet and the image has been
+	// used to build it
+	bool SetFirstReference(const float *image);
+	// True if the image is binary identical to the reference
+	bool IsReference(const float *image) const;
+	// Makes the image the reference of the next test, tested tells if it has
+	// been built in testImage
+	void NextReference(const float *image, const bool tested);
+
+	unsigned int width, height;
 	
+	// The RGB of the reference, only used to detect identical images. It is
+	// empty if the reference has been loaded from a cache file.
 	std::vector<float> reference;
+	bool hasReference;
 	std::vector<float> tvi;
+
+	// Reused by all the comparisons, it is sized only by Reset(w, h). The
+	// reference and test images point to workspace.a and workspace.b, they
+	// are swapped after each test so the tested image becomes the next
+	// reference without being built again.
+	YeeWorkspace workspace;
+	YeeImage *referenceImage, *testImage;
+	YeeImageCacheFile referenceFile;
+};
+
+//------------------------------------------------------------------------------
+// MultiReferenceTest
+//
+// Scores images against a set of references kept for the same scene (e.g. one
+// per render engine, film size or LuxCore version). The references are built,
+// or loaded from their cache files, only once and each Test() builds the
+// tested image once for all of them, see Yee_CompareMulti().
+//------------------------------------------------------------------------------
+
+class MultiReferenceTest {
+public:
+	MultiReferenceTest(const unsigned int w, const unsigned int h);
+	~MultiReferenceTest();
+
+	// The storage of the references added after the call and of the tested
+	// images, see YeeImage::SetStorage()
+	void SetStorage(const YeeStorage storage);
+
+	// Adds a reference built from an image, returns its index
+	unsigned int AddReference(const float *image);
+	// Adds a reference loaded from a cache file, see
+	// ConvergenceTest::LoadReference(). Returns false (and adds nothing) if
+	// the cache file is missing or stale.
+	bool AddReference(const std::string &fileName, const unsigned long long key);
+	unsigned int GetReferenceCount() const { return referenceImages.size(); }
+	void ClearReferences();
+
+	YeeMultiResult Test(const float *image);
+
+private:
+	// Not copyable
+	MultiReferenceTest(const MultiReferenceTest &);
+	MultiReferenceTest &operator=(const MultiReferenceTest &);
+
+	unsigned int width, height;
+	YeeStorage storage;
+
+	std::vector<YeeImage *> referenceImages;
+	// The cache file of each reference, NULL if it has been built
+	std::vector<YeeImageCacheFile *> referenceFiles;
+	YeeImage testImage;
+	YeeCsfTables csfTables;
 };
 
 }
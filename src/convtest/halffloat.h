@@ -0,0 +1,119 @@
+ /***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: http://www.luxrender.net                             *
+ ***************************************************************************/
+
+#ifndef LUX_HALFFLOAT_H
+#define LUX_HALFFLOAT_H
+
+#include <cstring>
+
+#if defined(__F16C__)
+#include <immintrin.h>
+#endif
+
+namespace lux {
+
+//------------------------------------------------------------------------------
+// 16bit floating point formats
+//
+// Half is the IEEE 754 binary16 format (11 bits of precision, values up to
+// 65504), BFloat16 keeps the float exponent range with 8 bits of precision.
+// Both conversions from float round to nearest even, the half ones use the
+// F16C instructions when they are available.
+//------------------------------------------------------------------------------
+
+inline unsigned int FloatBits(const float f) {
+	unsigned int i;
+	memcpy(&i, &f, sizeof(float));
+	return i;
+}
+
+inline float BitsFloat(const unsigned int i) {
+	float f;
+	memcpy(&f, &i, sizeof(float));
+	return f;
+}
+
+inline unsigned short FloatToHalf(const float f) {
+#if defined(__F16C__)
+	return (unsigned short)_cvtss_sh(f, 0);
+#else
+	unsigned int bits = FloatBits(f);
+	const unsigned int sign = (bits >> 16) & 0x8000u;
+	bits &= 0x7fffffffu;
+
+	unsigned short h;
+	if (bits >= 0x47800000u) {
+		// Too large for a half (Inf or NaN stay so)
+		h = (bits > 0x7f800000u) ? 0x7e00u : 0x7c00u;
+	} else if (bits < 0x38800000u) {
+		// Denormal half (or zero): let the float adder do the rounding
+		h = (unsigned short)(FloatBits(BitsFloat(bits) + .5f) - 0x3f000000u);
+	} else {
+		const unsigned int mantissaOdd = (bits >> 13) & 1u;
+		// Rebias the exponent and round to nearest even
+		bits += ((unsigned int)(15 - 127) << 23) + 0xfffu + mantissaOdd;
+		h = (unsigned short)(bits >> 13);
+	}
+
+	return (unsigned short)(h | sign);
+#endif
+}
+
+inline float HalfToFloat(const unsigned short h) {
+#if defined(__F16C__)
+	return _cvtsh_ss(h);
+#else
+	const unsigned int exponentMask = 0x7c00u << 13;
+	unsigned int bits = (h & 0x7fffu) << 13;
+	const unsigned int exponent = bits & exponentMask;
+
+	// Rebias the exponent
+	bits += (unsigned int)(127 - 15) << 23;
+	if (exponent == exponentMask) {
+		// Inf or NaN
+		bits += (unsigned int)(128 - 16) << 23;
+	} else if (exponent == 0) {
+		// Zero or denormal: renormalize with the float subtraction
+		bits += 1u << 23;
+		bits = FloatBits(BitsFloat(bits) - BitsFloat(113u << 23));
+	}
+
+	return BitsFloat(bits | ((h & 0x8000u) << 16));
+#endif
+}
+
+inline unsigned short FloatToBFloat16(const float f) {
+	const unsigned int bits = FloatBits(f);
+	if ((bits & 0x7fffffffu) > 0x7f800000u) {
+		// Keep NaN a NaN
+		return (unsigned short)((bits >> 16) | 0x40u);
+	}
+
+	return (unsigned short)((bits + 0x7fffu + ((bits >> 16) & 1u)) >> 16);
+}
+
+inline float BFloat16ToFloat(const unsigned short b) {
+	return BitsFloat((unsigned int)b << 16);
+}
+
+}
+
+#endif
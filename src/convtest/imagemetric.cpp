@@ -0,0 +1,457 @@
+ /***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: http://www.luxrender.net                             *
+ ***************************************************************************/
+
+#include <cmath>
+#include <algorithm>
+#include <cfloat>
+#include <limits>
+#include <sstream>
+#include <iomanip>
+#include <stdexcept>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include <boost/bind.hpp>
+
+#include "convtest/imagemetric.h"
+#include "convtest/parallel.h"
+
+using namespace lux;
+
+// Pixels are processed in tiles of consecutive pixels (rows for SSIM)
+#define METRIC_TILE_SIZE 16384
+#define SSIM_TILE_ROWS 16
+// Partial sums are kept in float only for short runs of values
+#define METRIC_BLOCK_SIZE 256
+
+//------------------------------------------------------------------------------
+// ImageMetric
+//------------------------------------------------------------------------------
+
+ImageMetricType ImageMetric::String2Type(const std::string &name) {
+	if (name == "pdiff")
+		return IMAGE_METRIC_PDIFF;
+	else if (name == "mse")
+		return IMAGE_METRIC_MSE;
+	else if (name == "psnr")
+		return IMAGE_METRIC_PSNR;
+	else if (name == "relmse")
+		return IMAGE_METRIC_RELMSE;
+	else if (name == "ssim")
+		return IMAGE_METRIC_SSIM;
+	else
+		throw std::runtime_error("Unknown image metric: " + name);
+}
+
+const char *ImageMetric::Type2String(const ImageMetricType type) {
+	switch (type) {
+		case IMAGE_METRIC_PDIFF:
+			return "pdiff";
+		case IMAGE_METRIC_MSE:
+			return "mse";
+		case IMAGE_METRIC_PSNR:
+			return "psnr";
+		case IMAGE_METRIC_RELMSE:
+			return "relmse";
+		case IMAGE_METRIC_SSIM:
+			return "ssim";
+		default:
+			throw std::runtime_error("Unknown image metric type in ImageMetric::Type2String()");
+	}
+}
+
+ImageMetric *ImageMetric::Create(const ImageMetricType type, const float threshold) {
+	switch (type) {
+		case IMAGE_METRIC_PDIFF:
+			return new PdiffImageMetric(threshold);
+		case IMAGE_METRIC_MSE:
+		case IMAGE_METRIC_PSNR:
+		case IMAGE_METRIC_RELMSE:
+			return new ErrorImageMetric(type, threshold);
+		case IMAGE_METRIC_SSIM:
+			return new SSIMImageMetric(threshold);
+		default:
+			throw std::runtime_error("Unknown image metric type in ImageMetric::Create()");
+	}
+}
+
+void lux::FilmToImage(const unsigned int w, const unsigned int h, const float *film, float *rgb) {
+	const size_t rowSize = 3 * (size_t)w;
+	for (unsigned int y = 0; y < h; ++y) {
+		const float *src = &film[(h - y - 1) * rowSize];
+		float *dst = &rgb[y * rowSize];
+		for (size_t i = 0; i < rowSize; ++i)
+			dst[i] = std::min(std::max(src[i], 0.f), 1.f);
+	}
+}
+
+//------------------------------------------------------------------------------
+// ErrorImageMetric
+//------------------------------------------------------------------------------
+
+// The constant added to the squared reference by the relative MSE
+#define RELMSE_EPSILON 0.01f
+
+ErrorImageMetric::ErrorImageMetric(const ImageMetricType t, const float threshold) :
+	ImageMetric(threshold), type(t) {
+}
+
+ErrorImageMetric::~ErrorImageMetric() {
+}
+
+void ErrorImageMetric::SetReference(const unsigned int w, const unsigned int h, const float *rgb) {
+	width = w;
+	height = h;
+
+	reference.Resize(3 * width * height);
+	std::copy(rgb, rgb + 3 * width * height, reference.Get());
+	tileErrors.resize((width * height + METRIC_TILE_SIZE - 1) / METRIC_TILE_SIZE);
+}
+
+void ErrorImageMetric::ErrorTile(const float *rgb, const unsigned int /* threadIndex */,
+		const unsigned int first, const unsigned int last) {
+	const float *ref = reference.Get();
+	const bool relative = (type == IMAGE_METRIC_RELMSE);
+
+	double error = 0.0;
+	for (unsigned int block = 3 * first; block < 3 * last; block += METRIC_BLOCK_SIZE) {
+		const unsigned int blockEnd = std::min(block + METRIC_BLOCK_SIZE, 3 * last);
+
+		unsigned int i = block;
+		float blockError = 0.f;
+#if defined(__SSE2__)
+		__m128 sum = _mm_setzero_ps();
+		const __m128 epsilon = _mm_set1_ps(RELMSE_EPSILON);
+		for (; i + 4 <= blockEnd; i += 4) {
+			const __m128 r = _mm_loadu_ps(&ref[i]);
+			const __m128 d = _mm_sub_ps(_mm_loadu_ps(&rgb[i]), r);
+			__m128 e = _mm_mul_ps(d, d);
+			if (relative)
+				e = _mm_div_ps(e, _mm_add_ps(_mm_mul_ps(r, r), epsilon));
+			sum = _mm_add_ps(sum, e);
+		}
+		float lanes[4];
+		_mm_storeu_ps(lanes, sum);
+		blockError = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+		for (; i < blockEnd; ++i) {
+			const float d = rgb[i] - ref[i];
+			blockError += relative ? (d * d / (ref[i] * ref[i] + RELMSE_EPSILON)) : (d * d);
+		}
+
+		error += blockError;
+	}
+
+	tileErrors[first / METRIC_TILE_SIZE] = error;
+}
+
+ImageMetricResult ErrorImageMetric::Test(const float *rgb) {
+	const unsigned int pixelCount = width * height;
+	ParallelFor(pixelCount, METRIC_TILE_SIZE, boost::bind(&ErrorImageMetric::ErrorTile,
+			this, rgb, _1, _2, _3));
+
+	double error = 0.0;
+	for (unsigned int i = 0; i < tileErrors.size(); ++i)
+		error += tileErrors[i];
+	const double mse = (pixelCount > 0) ? (error / (3.0 * pixelCount)) : 0.0;
+
+	ImageMetricResult result;
+	std::stringstream ss;
+	switch (type) {
+		case IMAGE_METRIC_PSNR:
+			result.value = (mse > 0.0) ? (float)(10.0 * log10(1.0 / mse)) :
+				std::numeric_limits<float>::infinity();
+			result.passed = (result.value >= threshold);
+			ss << "PSNR " << std::fixed << std::setprecision(2) << result.value << " dB";
+			break;
+		case IMAGE_METRIC_RELMSE:
+			result.value = (float)mse;
+			result.passed = (result.value <= threshold);
+			ss << "relative MSE " << std::scientific << std::setprecision(3) << result.value;
+			break;
+		default:
+			result.value = (float)mse;
+			result.passed = (result.value <= threshold);
+			ss << "MSE " << std::scientific << std::setprecision(3) << result.value;
+			break;
+	}
+	result.description = ss.str();
+
+	return result;
+}
+
+//------------------------------------------------------------------------------
+// SSIMImageMetric
+//------------------------------------------------------------------------------
+
+#define SSIM_SIGMA 1.5f
+#define SSIM_C1 (0.01f * 0.01f)
+#define SSIM_C2 (0.03f * 0.03f)
+
+SSIMImageMetric::SSIMImageMetric(const float threshold) : ImageMetric(threshold) {
+	float sum = 0.f;
+	for (int i = 0; i < SSIM_WINDOW_SIZE; ++i) {
+		const float d = (float)(i - SSIM_WINDOW_RADIUS);
+		window[i] = expf(-d * d / (2.f * SSIM_SIGMA * SSIM_SIGMA));
+		sum += window[i];
+	}
+	for (int i = 0; i < SSIM_WINDOW_SIZE; ++i)
+		window[i] /= sum;
+}
+
+SSIMImageMetric::~SSIMImageMetric() {
+}
+
+void SSIMImageMetric::LumaTile(const float *rgb, float *luma, const unsigned int /* threadIndex */,
+		const unsigned int first, const unsigned int last) {
+	for (unsigned int i = first; i < last; ++i)
+		luma[i] = 0.2126f * rgb[3 * i] + 0.7152f * rgb[3 * i + 1] + 0.0722f * rgb[3 * i + 2];
+}
+
+void SSIMImageMetric::SetReference(const unsigned int w, const unsigned int h, const float *rgb) {
+	width = w;
+	height = h;
+
+	referenceLuma.Resize(width * height);
+	testLuma.Resize(width * height);
+	ParallelFor(width * height, METRIC_TILE_SIZE, boost::bind(&SSIMImageMetric::LumaTile,
+			this, rgb, referenceLuma.Get(), _1, _2, _3));
+
+	rowBuffers.Resize(GetParallelThreadCount() * 5 * width);
+	const unsigned int validRows = (height >= SSIM_WINDOW_SIZE) ? (height - 2 * SSIM_WINDOW_RADIUS) : 0;
+	tileSSIM.resize((validRows + SSIM_TILE_ROWS - 1) / SSIM_TILE_ROWS);
+}
+
+void SSIMImageMetric::SSIMTile(const unsigned int threadIndex, const unsigned int first, const unsigned int last) {
+	const float *a = referenceLuma.Get();
+	const float *b = testLuma.Get();
+	float *mA = &rowBuffers[threadIndex * 5 * width];
+	float *mB = mA + width;
+	float *mAA = mB + width;
+	float *mBB = mAA + width;
+	float *mAB = mBB + width;
+
+	double ssim = 0.0;
+	for (unsigned int row = first; row < last; ++row) {
+		// The window rows of output row (row + SSIM_WINDOW_RADIUS)
+		const float *rowA = &a[row * width];
+		const float *rowB = &b[row * width];
+
+		// Vertical pass of the 5 moments
+		unsigned int x = 0;
+#if defined(__SSE2__)
+		for (; x + 4 <= width; x += 4) {
+			__m128 sA = _mm_setzero_ps(), sB = _mm_setzero_ps(), sAA = _mm_setzero_ps(),
+					sBB = _mm_setzero_ps(), sAB = _mm_setzero_ps();
+			for (int j = 0; j < SSIM_WINDOW_SIZE; ++j) {
+				const __m128 k = _mm_set1_ps(window[j]);
+				const __m128 va = _mm_loadu_ps(&rowA[j * width + x]);
+				const __m128 vb = _mm_loadu_ps(&rowB[j * width + x]);
+				const __m128 ka = _mm_mul_ps(k, va);
+				const __m128 kb = _mm_mul_ps(k, vb);
+				sA = _mm_add_ps(sA, ka);
+				sB = _mm_add_ps(sB, kb);
+				sAA = _mm_add_ps(sAA, _mm_mul_ps(ka, va));
+				sBB = _mm_add_ps(sBB, _mm_mul_ps(kb, vb));
+				sAB = _mm_add_ps(sAB, _mm_mul_ps(ka, vb));
+			}
+			_mm_storeu_ps(&mA[x], sA);
+			_mm_storeu_ps(&mB[x], sB);
+			_mm_storeu_ps(&mAA[x], sAA);
+			_mm_storeu_ps(&mBB[x], sBB);
+			_mm_storeu_ps(&mAB[x], sAB);
+		}
+#endif
+		for (; x < width; ++x) {
+			float sA = 0.f, sB = 0.f, sAA = 0.f, sBB = 0.f, sAB = 0.f;
+			for (int j = 0; j < SSIM_WINDOW_SIZE; ++j) {
+				const float va = rowA[j * width + x];
+				const float vb = rowB[j * width + x];
+				const float ka = window[j] * va;
+				const float kb = window[j] * vb;
+				sA += ka;
+				sB += kb;
+				sAA += ka * va;
+				sBB += kb * vb;
+				sAB += ka * vb;
+			}
+			mA[x] = sA;
+			mB[x] = sB;
+			mAA[x] = sAA;
+			mBB[x] = sBB;
+			mAB[x] = sAB;
+		}
+
+		// Horizontal pass and SSIM of the pixels where the window fits
+		const unsigned int count = width - 2 * SSIM_WINDOW_RADIUS;
+		float rowSSIM = 0.f;
+		x = 0;
+#if defined(__SSE2__)
+		__m128 sum = _mm_setzero_ps();
+		const __m128 two = _mm_set1_ps(2.f);
+		const __m128 c1 = _mm_set1_ps(SSIM_C1);
+		const __m128 c2 = _mm_set1_ps(SSIM_C2);
+		for (; x + 4 <= count; x += 4) {
+			__m128 uA = _mm_setzero_ps(), uB = _mm_setzero_ps(), eAA = _mm_setzero_ps(),
+					eBB = _mm_setzero_ps(), eAB = _mm_setzero_ps();
+			for (int j = 0; j < SSIM_WINDOW_SIZE; ++j) {
+				const __m128 k = _mm_set1_ps(window[j]);
+				uA = _mm_add_ps(uA, _mm_mul_ps(k, _mm_loadu_ps(&mA[x + j])));
+				uB = _mm_add_ps(uB, _mm_mul_ps(k, _mm_loadu_ps(&mB[x + j])));
+				eAA = _mm_add_ps(eAA, _mm_mul_ps(k, _mm_loadu_ps(&mAA[x + j])));
+				eBB = _mm_add_ps(eBB, _mm_mul_ps(k, _mm_loadu_ps(&mBB[x + j])));
+				eAB = _mm_add_ps(eAB, _mm_mul_ps(k, _mm_loadu_ps(&mAB[x + j])));
+			}
+			const __m128 uAB = _mm_mul_ps(uA, uB);
+			const __m128 uAA = _mm_mul_ps(uA, uA);
+			const __m128 uBB = _mm_mul_ps(uB, uB);
+			const __m128 num = _mm_mul_ps(_mm_add_ps(_mm_mul_ps(two, uAB), c1),
+					_mm_add_ps(_mm_mul_ps(two, _mm_sub_ps(eAB, uAB)), c2));
+			const __m128 den = _mm_mul_ps(_mm_add_ps(_mm_add_ps(uAA, uBB), c1),
+					_mm_add_ps(_mm_add_ps(_mm_sub_ps(eAA, uAA), _mm_sub_ps(eBB, uBB)), c2));
+			sum = _mm_add_ps(sum, _mm_div_ps(num, den));
+		}
+		float lanes[4];
+		_mm_storeu_ps(lanes, sum);
+		rowSSIM = (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]);
+#endif
+		for (; x < count; ++x) {
+			float uA = 0.f, uB = 0.f, eAA = 0.f, eBB = 0.f, eAB = 0.f;
+			for (int j = 0; j < SSIM_WINDOW_SIZE; ++j) {
+				uA += window[j] * mA[x + j];
+				uB += window[j] * mB[x + j];
+				eAA += window[j] * mAA[x + j];
+				eBB += window[j] * mBB[x + j];
+				eAB += window[j] * mAB[x + j];
+			}
+			const float uAB = uA * uB;
+			const float uAA = uA * uA;
+			const float uBB = uB * uB;
+			rowSSIM += ((2.f * uAB + SSIM_C1) * (2.f * (eAB - uAB) + SSIM_C2)) /
+					((uAA + uBB + SSIM_C1) * ((eAA - uAA) + (eBB - uBB) + SSIM_C2));
+		}
+
+		ssim += rowSSIM;
+	}
+
+	tileSSIM[first / SSIM_TILE_ROWS] = ssim;
+}
+
+ImageMetricResult SSIMImageMetric::Test(const float *rgb) {
+	ParallelFor(width * height, METRIC_TILE_SIZE, boost::bind(&SSIMImageMetric::LumaTile,
+			this, rgb, testLuma.Get(), _1, _2, _3));
+
+	ImageMetricResult result;
+	if ((width < SSIM_WINDOW_SIZE) || (height < SSIM_WINDOW_SIZE)) {
+		// Smaller than the window: the images are only similar if identical
+		result.value = std::equal(testLuma.Get(), testLuma.Get() + width * height,
+				referenceLuma.Get()) ? 1.f : 0.f;
+	} else {
+		const unsigned int validRows = height - 2 * SSIM_WINDOW_RADIUS;
+		// The thread count may have changed since SetReference()
+		rowBuffers.Resize(GetParallelThreadCount() * 5 * width);
+		ParallelFor(validRows, SSIM_TILE_ROWS, boost::bind(&SSIMImageMetric::SSIMTile,
+				this, _1, _2, _3));
+
+		double ssim = 0.0;
+		for (unsigned int i = 0; i < tileSSIM.size(); ++i)
+			ssim += tileSSIM[i];
+		result.value = (float)(ssim / ((double)validRows * (width - 2 * SSIM_WINDOW_RADIUS)));
+	}
+	result.passed = (result.value >= threshold);
+
+	std::stringstream ss;
+	ss << "SSIM " << std::fixed << std::setprecision(4) << result.value;
+	result.description = ss.str();
+
+	return result;
+}
+
+//------------------------------------------------------------------------------
+// PdiffImageMetric
+//------------------------------------------------------------------------------
+
+PdiffImageMetric::PdiffImageMetric(const float threshold, const bool exact) :
+	ImageMetric(threshold), exactCount(exact) {
+}
+
+PdiffImageMetric::~PdiffImageMetric() {
+}
+
+void PdiffImageMetric::SetReference(const unsigned int w, const unsigned int h, const float *rgb) {
+	width = w;
+	height = h;
+
+	referenceFile.Unmap();
+	referenceImage.Resize(width, height);
+	testImage.Resize(width, height);
+	referenceImage.Build(rgb, PDIFF_GAMMA, PDIFF_LUMINANCE);
+}
+
+bool PdiffImageMetric::LoadReference(const unsigned int w, const unsigned int h,
+		const std::string &fileName, const unsigned long long key) {
+	width = w;
+	height = h;
+
+	testImage.Resize(width, height);
+	return referenceFile.Map(fileName, key, width, height, PDIFF_GAMMA, PDIFF_LUMINANCE,
+			referenceImage);
+}
+
+bool PdiffImageMetric::SaveReference(const std::string &fileName, const unsigned long long key) const {
+	return YeeImageCacheFile::Save(fileName, key, referenceImage);
+}
+
+ImageMetricResult PdiffImageMetric::Test(const float *rgb) {
+	const unsigned int pixelCount = width * height;
+	testImage.Build(rgb, PDIFF_GAMMA, PDIFF_LUMINANCE);
+
+	const unsigned int failedThreshold = (unsigned int)ceil(threshold * (double)pixelCount / 100.0);
+	YeeBoundedResult bounded;
+	if (exactCount) {
+		// All the pixels are tested, the count doesn't depend on the
+		// bounds of the coarse to fine comparison
+		bounded.pixelsFailed = Yee_Compare(referenceImage, testImage, NULL, NULL, &workspace);
+		bounded.pixelsTested = pixelCount;
+		bounded.failed = (bounded.pixelsFailed >= failedThreshold);
+	} else {
+		// Only the verdict against the threshold is needed
+		bounded = Yee_CompareBounded(referenceImage, testImage, failedThreshold,
+				false, 45.f, 1.f, &workspace.csfTables);
+	}
+
+	ImageMetricResult result;
+	result.value = (pixelCount > 0) ? (100.f * bounded.pixelsFailed / (float)pixelCount) : 0.f;
+	result.passed = !bounded.failed;
+
+	std::stringstream ss;
+	if (bounded.pixelsTested == pixelCount)
+		ss << bounded.pixelsFailed << " different pixels, " << std::fixed << std::setprecision(2) << result.value << "%";
+	else if (result.passed)
+		ss << "less than " << std::fixed << std::setprecision(2) << threshold << "% different pixels";
+	else
+		ss << "at least " << bounded.pixelsFailed << " different pixels, " << std::fixed << std::setprecision(2) << result.value << "%";
+	result.description = ss.str();
+
+	return result;
+}
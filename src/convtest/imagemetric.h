@@ -0,0 +1,198 @@
+ /***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: http://www.luxrender.net                             *
+ ***************************************************************************/
+
+#ifndef LUX_IMAGEMETRIC_H
+#define LUX_IMAGEMETRIC_H
+
+#include <string>
+#include <vector>
+
+#include "convtest/alignedbuffer.h"
+#include "convtest/pdiff/metric.h"
+#include "convtest/referencecache.h"
+
+namespace lux {
+
+enum ImageMetricType {
+	IMAGE_METRIC_PDIFF,
+	IMAGE_METRIC_MSE,
+	IMAGE_METRIC_PSNR,
+	IMAGE_METRIC_RELMSE,
+	IMAGE_METRIC_SSIM
+};
+
+class ImageMetricResult {
+public:
+	ImageMetricResult() : value(0.f), passed(false) { }
+
+	// The value of the metric, see the description of each metric
+	float value;
+	// True if the value is within the threshold of the metric
+	bool passed;
+	// A short human readable description of the value
+	std::string description;
+};
+
+//------------------------------------------------------------------------------
+// ImageMetric
+//
+// Compares RGB float images against a reference. The reference is prepared
+// once by SetReference() and can then be tested any number of times. All
+// the metrics work on gamma encoded values in [0, 1].
+//------------------------------------------------------------------------------
+
+class ImageMetric {
+public:
+	ImageMetric(const float t) : threshold(t), width(0), height(0) { }
+	virtual ~ImageMetric() { }
+
+	virtual ImageMetricType GetType() const = 0;
+	virtual const char *GetName() const = 0;
+	float GetThreshold() const { return threshold; }
+
+	virtual void SetReference(const unsigned int w, const unsigned int h, const float *rgb) = 0;
+	// Metrics with a costly reference preparation can cache it in a file,
+	// see ConvergenceTest::LoadReference()
+	virtual bool LoadReference(const unsigned int /* w */, const unsigned int /* h */,
+			const std::string & /* fileName */, const unsigned long long /* key */) { return false; }
+	virtual bool SaveReference(const std::string & /* fileName */, const unsigned long long /* key */) const { return false; }
+
+	virtual ImageMetricResult Test(const float *rgb) = 0;
+
+	static ImageMetricType String2Type(const std::string &name);
+	static const char *Type2String(const ImageMetricType type);
+	// The threshold units depend on the metric, see their description
+	static ImageMetric *Create(const ImageMetricType type, const float threshold);
+
+protected:
+	float threshold;
+	unsigned int width, height;
+};
+
+// Copies a film image, with the bottom-up rows returned by
+// luxcore::RenderSession, to the top-down rows of the image files (and so of
+// the references), clamping the values to the display range [0, 1]
+extern void FilmToImage(const unsigned int w, const unsigned int h, const float *film, float *rgb);
+
+//------------------------------------------------------------------------------
+// Error metrics, all averaged over the 3 channels of all pixels:
+//  - MSE: mean of (a - r)^2, passes if not above the threshold
+//  - PSNR: 10 * log10(1 / MSE) dB, passes if not below the threshold
+//  - relative MSE: mean of (a - r)^2 / (r^2 + 0.01), passes if not above
+//    the threshold
+//------------------------------------------------------------------------------
+
+class ErrorImageMetric : public ImageMetric {
+public:
+	ErrorImageMetric(const ImageMetricType type, const float threshold);
+	virtual ~ErrorImageMetric();
+
+	virtual ImageMetricType GetType() const { return type; }
+	virtual const char *GetName() const { return Type2String(type); }
+
+	virtual void SetReference(const unsigned int w, const unsigned int h, const float *rgb);
+	virtual ImageMetricResult Test(const float *rgb);
+
+private:
+	void ErrorTile(const float *rgb, const unsigned int threadIndex,
+			const unsigned int first, const unsigned int last);
+
+	ImageMetricType type;
+	AlignedBuffer<float> reference;
+	// Per tile sums, added in tile order so the result never depends on the
+	// number of threads
+	std::vector<double> tileErrors;
+};
+
+//------------------------------------------------------------------------------
+// SSIM
+//
+// The mean structural similarity index (Wang et al. 2004) of the Rec. 709
+// luma, with the usual 11x11 Gaussian window (sigma 1.5) evaluated as two
+// separable passes, K1 = 0.01 and K2 = 0.03. Only the pixels where the whole
+// window fits in the image are used. It is 1 for identical images and passes
+// if not below the threshold.
+//------------------------------------------------------------------------------
+
+#define SSIM_WINDOW_RADIUS 5
+#define SSIM_WINDOW_SIZE (2 * SSIM_WINDOW_RADIUS + 1)
+
+class SSIMImageMetric : public ImageMetric {
+public:
+	SSIMImageMetric(const float threshold);
+	virtual ~SSIMImageMetric();
+
+	virtual ImageMetricType GetType() const { return IMAGE_METRIC_SSIM; }
+	virtual const char *GetName() const { return Type2String(IMAGE_METRIC_SSIM); }
+
+	virtual void SetReference(const unsigned int w, const unsigned int h, const float *rgb);
+	virtual ImageMetricResult Test(const float *rgb);
+
+private:
+	void LumaTile(const float *rgb, float *luma, const unsigned int threadIndex,
+			const unsigned int first, const unsigned int last);
+	void SSIMTile(const unsigned int threadIndex, const unsigned int first, const unsigned int last);
+
+	float window[SSIM_WINDOW_SIZE];
+	AlignedBuffer<float> referenceLuma, testLuma;
+	// Per thread buffers of the 5 vertically filtered moments of a row
+	AlignedBuffer<float> rowBuffers;
+	std::vector<double> tileSSIM;
+};
+
+//------------------------------------------------------------------------------
+// Perceptual metric
+//
+// The Yee perceptual metric of ConvergenceTest. The value is the percentage
+// of different pixels and the test passes if it is below the threshold. The
+// comparison stops as soon as the verdict is known, so the value can be a
+// lower bound when the test fails, unless the exact count is requested.
+//------------------------------------------------------------------------------
+
+// Conversion parameters of the images, as in ConvergenceTest
+#define PDIFF_GAMMA 2.2f
+#define PDIFF_LUMINANCE 100.f
+
+class PdiffImageMetric : public ImageMetric {
+public:
+	PdiffImageMetric(const float threshold, const bool exactCount = false);
+	virtual ~PdiffImageMetric();
+
+	virtual ImageMetricType GetType() const { return IMAGE_METRIC_PDIFF; }
+	virtual const char *GetName() const { return Type2String(IMAGE_METRIC_PDIFF); }
+
+	virtual void SetReference(const unsigned int w, const unsigned int h, const float *rgb);
+	virtual bool LoadReference(const unsigned int w, const unsigned int h,
+			const std::string &fileName, const unsigned long long key);
+	virtual bool SaveReference(const std::string &fileName, const unsigned long long key) const;
+	virtual ImageMetricResult Test(const float *rgb);
+
+private:
+	bool exactCount;
+	YeeImage referenceImage, testImage;
+	YeeImageCacheFile referenceFile;
+	// Only its csf() tables are used, they are kept across the Test() calls
+	YeeWorkspace workspace;
+};
+
+}
+
+#endif
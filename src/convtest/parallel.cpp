@@ -0,0 +1,191 @@
+ /***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: http://www.luxrender.net                             *
+ ***************************************************************************/
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+
+#include <boost/thread.hpp>
+#include <boost/bind.hpp>
+
+#include "convtest/parallel.h"
+
+using namespace lux;
+
+//------------------------------------------------------------------------------
+// ParallelFor
+//------------------------------------------------------------------------------
+
+namespace {
+
+class TileScheduler {
+public:
+	TileScheduler(const unsigned int c, const unsigned int size, const ParallelForFunc &f,
+			const unsigned int helpers) :
+		count(c), tileSize(size), nextTile(0), func(f), helpersWanted(helpers),
+		helpersJoined(0), helpersDone(0) { }
+
+	void Run(const unsigned int threadIndex) {
+		for (;;) {
+			unsigned int first, last;
+			{
+				boost::unique_lock<boost::mutex> lock(tileMutex);
+				if (nextTile >= count)
+					return;
+				first = nextTile;
+				last = (count - first > tileSize) ? (first + tileSize) : count;
+				nextTile = last;
+			}
+
+			func(threadIndex, first, last);
+		}
+	}
+
+private:
+	const unsigned int count, tileSize;
+	unsigned int nextTile;
+	boost::mutex tileMutex;
+
+	const ParallelForFunc &func;
+
+public:
+	// Protected by the mutex of the pool
+	const unsigned int helpersWanted;
+	unsigned int helpersJoined, helpersDone;
+};
+
+//------------------------------------------------------------------------------
+// ThreadPool
+//
+// The threads helping the callers of ParallelFor(). They are started the
+// first time they are needed and live until the end of the program, so a
+// ParallelFor() only costs a wake up of the threads it uses. Several
+// threads can run a ParallelFor() at the same time (e.g. the jobs of
+// luxmark_convtest_batch): each queued scheduler is joined by up to the
+// helpers it asks for, the caller runs the tiles left by the busy ones.
+//------------------------------------------------------------------------------
+
+class ThreadPool {
+public:
+	ThreadPool() : stopRequested(false) { }
+
+	~ThreadPool() {
+		{
+			boost::unique_lock<boost::mutex> lock(poolMutex);
+			stopRequested = true;
+		}
+		workCondition.notify_all();
+
+		threads.join_all();
+	}
+
+	void Run(TileScheduler &scheduler) {
+		{
+			boost::unique_lock<boost::mutex> lock(poolMutex);
+			// At least one thread for each hardware thread, the count set
+			// with SetParallelThreadCount() can be larger
+			const unsigned int minSize = std::max(scheduler.helpersWanted,
+					std::max(1u, boost::thread::hardware_concurrency()) - 1);
+			while (threads.size() < minSize)
+				threads.create_thread(boost::bind(&ThreadPool::WorkerImpl, this));
+
+			queue.push_back(&scheduler);
+		}
+		workCondition.notify_all();
+
+		scheduler.Run(0);
+
+		// No other thread can join once the tiles are all taken, wait for
+		// the ones still running a tile
+		boost::unique_lock<boost::mutex> lock(poolMutex);
+		std::deque<TileScheduler *>::iterator it = std::find(queue.begin(), queue.end(), &scheduler);
+		if (it != queue.end())
+			queue.erase(it);
+		while (scheduler.helpersDone < scheduler.helpersJoined)
+			doneCondition.wait(lock);
+	}
+
+private:
+	void WorkerImpl() {
+		boost::unique_lock<boost::mutex> lock(poolMutex);
+		for (;;) {
+			while (!stopRequested && queue.empty())
+				workCondition.wait(lock);
+			if (stopRequested)
+				return;
+
+			TileScheduler *scheduler = queue.front();
+			const unsigned int threadIndex = ++(scheduler->helpersJoined);
+			if (scheduler->helpersJoined >= scheduler->helpersWanted)
+				queue.pop_front();
+
+			lock.unlock();
+			scheduler->Run(threadIndex);
+			lock.lock();
+
+			++(scheduler->helpersDone);
+			doneCondition.notify_all();
+		}
+	}
+
+	boost::thread_group threads;
+	// Protects all the fields and the helper counts of the schedulers
+	boost::mutex poolMutex;
+	boost::condition_variable workCondition, doneCondition;
+	std::deque<TileScheduler *> queue;
+	bool stopRequested;
+};
+
+ThreadPool threadPool;
+
+// 0 if there is no limit
+std::atomic<unsigned int> parallelThreadCount(0);
+
+}
+
+unsigned int lux::GetParallelThreadCount() {
+	const unsigned int count = parallelThreadCount;
+	if (count > 0)
+		return count;
+
+	return std::max(1u, boost::thread::hardware_concurrency());
+}
+
+void lux::SetParallelThreadCount(const unsigned int count) {
+	parallelThreadCount = count;
+}
+
+void lux::ParallelFor(const unsigned int count, const unsigned int tileSize,
+		const ParallelForFunc &func) {
+	const unsigned int size = std::max(1u, tileSize);
+	const unsigned int tileCount = (count + size - 1) / size;
+	const unsigned int threadCount = std::min(GetParallelThreadCount(), tileCount);
+
+	if (threadCount <= 1) {
+		// Nothing to gain from additional threads
+		for (unsigned int first = 0; first < count; first += size)
+			func(0, first, std::min(first + size, count));
+		return;
+	}
+
+	TileScheduler scheduler(count, size, func, threadCount - 1);
+	threadPool.Run(scheduler);
+}
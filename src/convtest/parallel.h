@@ -0,0 +1,53 @@
+ /***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: http://www.luxrender.net                             *
+ ***************************************************************************/
+
+#ifndef LUX_PARALLEL_H
+#define LUX_PARALLEL_H
+
+#include <boost/function.hpp>
+
+namespace lux {
+
+// Work function of ParallelFor(): it is called with the index of the thread
+// running it (in [0, GetParallelThreadCount())) and the [first, last) range
+// of one tile
+typedef boost::function<void (const unsigned int threadIndex,
+		const unsigned int first, const unsigned int last)> ParallelForFunc;
+
+extern unsigned int GetParallelThreadCount();
+// Limits the threads used by ParallelFor(), 0 restores the default of one
+// thread for each hardware thread. It can be called from any thread, but
+// the code sizing per thread buffers with GetParallelThreadCount() expects
+// it to be set before the comparisons start.
+extern void SetParallelThreadCount(const unsigned int count);
+
+// Splits [0, count) in tiles of tileSize elements and runs them on up to
+// GetParallelThreadCount() threads, the calling thread included. The other
+// threads come from a pool started at the first call and reused by all the
+// following ones. Tiles are handed out dynamically, so the work function
+// must not depend on which thread runs a tile, only on the tile range.
+// ParallelFor() can be called by several threads at the same time.
+extern void ParallelFor(const unsigned int count, const unsigned int tileSize,
+		const ParallelForFunc &func);
+
+}
+
+#endif
@@ -16,77 +16,255 @@ if not, write to the Free Software Foundation, Inc., 59 Temple Place, Suite 330,
 
 // Adapted for LuxRender/LuxRays by Dade
 
+#include <algorithm>
+
+#include <boost/bind.hpp>
+
+#include "convtest/parallel.h"
 #include "convtest/pdiff/lpyramid.h"
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 using namespace lux;
 
+// The 5x5 filter kernel is separable: the original 2D kernel is the outer
+// product of this 1D kernel with itself
+static const float Kernel[] = {0.05f, 0.25f, 0.4f, 0.25f, 0.05f};
+
+// Mirror an out of range coordinate back inside [0, n), with the same rule
+// used by the original 2D convolution. The final clamp only matters for
+// images smaller than the kernel support.
+static inline int Mirror(int i, const int n) {
+	if (i < 0) i = -i;
+	if (i >= n) i = 2 * n - i - 1;
+	if (i < 0) i = 0;
+	if (i >= n) i = n - 1;
+	return i;
+}
+
 //////////////////////////////////////////////////////////////////////
 // Construction/Destruction
 //////////////////////////////////////////////////////////////////////
 
-LPyramid::LPyramid(float *image, int width, int height) :
-	Width(width),
-	Height(height)
+LPyramid::LPyramid(int width, int height) :
+	Width(0),
+	Height(0)
 {
-	// Make the Laplacian pyramid by successively
-	// copying the earlier levels and blurring them
-	for (int i=0; i<MAX_PYR_LEVELS; i++) {
-		if (i == 0) {
-			Levels[i] = Copy(image);
-		} else {
-			Levels[i] = new float[Width * Height];
-			Convolve(Levels[i], Levels[i - 1]);
-		}
-	}
+	Resize(width, height);
 }
 
 LPyramid::~LPyramid()
 {
+}
+
+size_t LPyramid::Layout(int width, int height, int levelWidth[MAX_PYR_LEVELS],
+	int levelHeight[MAX_PYR_LEVELS], size_t offsets[MAX_PYR_LEVELS])
+{
+	// All levels share a single buffer, each one starting on an aligned
+	// boundary
+	const int alignment = LUX_BUFFER_ALIGNMENT / sizeof(float);
+	size_t size = 0;
 	for (int i=0; i<MAX_PYR_LEVELS; i++) {
-		if (Levels[i]) delete Levels[i];
+		levelWidth[i] = (i == 0) ? width : ((levelWidth[i - 1] + 1) / 2);
+		levelHeight[i] = (i == 0) ? height : ((levelHeight[i - 1] + 1) / 2);
+		offsets[i] = size;
+		size += ((levelWidth[i] * levelHeight[i] + alignment - 1) / alignment) * alignment;
 	}
+
+	return size;
 }
 
-float *LPyramid::Copy(float *img)
+size_t LPyramid::GetLevelsSize(int width, int height)
 {
-	int max = Width * Height;
-	float *out = new float[max];
-	for (int i = 0; i < max; i++) out[i] = img[i];
-	
-	return out;
+	int levelWidth[MAX_PYR_LEVELS], levelHeight[MAX_PYR_LEVELS];
+	size_t offsets[MAX_PYR_LEVELS];
+	return Layout(width, height, levelWidth, levelHeight, offsets);
 }
 
-void LPyramid::Convolve(float *a, float *b)
-// convolves image b with the filter kernel and stores it in a
+void LPyramid::Resize(int width, int height)
 {
-	int y,x,i,j,nx,ny;
-	const float Kernel[] = {0.05f, 0.25f, 0.4f, 0.25f, 0.05f};
-
-	for (y=0; y<Height; y++) {
-		for (x=0; x<Width; x++) {
-			int index = y * Width + x;
-			a[index] = 0.0f;
-			for (i=-2; i<=2; i++) {
-				for (j=-2; j<=2; j++) {
-					nx=x+i;
-					ny=y+j;
-					if (nx<0) nx=-nx;
-					if (ny<0) ny=-ny;
-					if (nx>=Width) nx=2*Width-nx-1;
-					if (ny>=Height) ny=2*Height-ny-1;
-					a[index] += Kernel[i+2] * Kernel[j+2] * b[ny * Width + nx];
-				} 
-			}
-		}
+	Width = width;
+	Height = height;
+
+	size_t offsets[MAX_PYR_LEVELS];
+	LevelsSize = Layout(Width, Height, LevelWidth, LevelHeight, offsets);
+
+	LevelsBuffer.Resize(LevelsSize);
+	for (int i=0; i<MAX_PYR_LEVELS; i++)
+		Levels[i] = LevelsBuffer.Get() + offsets[i];
+
+	RowBuffers.Resize(GetParallelThreadCount() * 2 * Width);
+}
+
+void LPyramid::Map(int width, int height, float *levels)
+{
+	Width = width;
+	Height = height;
+
+	size_t offsets[MAX_PYR_LEVELS];
+	LevelsSize = Layout(Width, Height, LevelWidth, LevelHeight, offsets);
+
+	LevelsBuffer.Free();
+	for (int i=0; i<MAX_PYR_LEVELS; i++)
+		Levels[i] = levels + offsets[i];
+
+	RowBuffers.Resize(GetParallelThreadCount() * 2 * Width);
+}
+
+void LPyramid::Build()
+{
+	// The thread count may have changed since Resize()
+	RowBuffers.Resize(GetParallelThreadCount() * 2 * Width);
+
+	// Make the Laplacian pyramid by successively
+	// blurring and decimating the earlier levels
+	for (int i=1; i<MAX_PYR_LEVELS; i++)
+		Convolve(Levels[i], Levels[i - 1], LevelWidth[i - 1], LevelHeight[i - 1]);
+}
+
+void LPyramid::Build(const float *image)
+{
+	std::copy(image, image + Width * Height, Levels[0]);
+	Build();
+}
+
+//////////////////////////////////////////////////////////////////////
+// Separable convolution
+//
+// The filter is applied as a vertical pass into a single row buffer
+// followed by a horizontal pass. Compared to the original non-separable
+// 5x5 loop only the order of the floating point additions changes, the
+// result differs from it by less than 1e-6 relative to the filtered value
+// (i.e. a few ulps). The SIMD and scalar paths evaluate the very same
+// expression, so their results are bit identical.
+//
+// Only the even rows and columns of the filtered image are kept, so each
+// level is half the size of the previous one.
+//////////////////////////////////////////////////////////////////////
+
+void LPyramid::ConvolveRow(float *a, const float *row, int width) const
+// convolves the vertically filtered row with the filter kernel and stores it in a
+{
+	const float k0 = Kernel[0], k1 = Kernel[1], k2 = Kernel[2], k3 = Kernel[3], k4 = Kernel[4];
+
+	// Left border
+	const int left = (width < 2) ? width : 2;
+	for (int x = 0; x < left; x++) {
+		a[x] = k0 * row[Mirror(x - 2, width)] +
+				k1 * row[Mirror(x - 1, width)] +
+				k2 * row[x] +
+				k3 * row[Mirror(x + 1, width)] +
+				k4 * row[Mirror(x + 2, width)];
+	}
+
+	// Interior, all the taps are inside the row
+	const int right = (width - 2 > left) ? (width - 2) : left;
+	int x = left;
+#if defined(__AVX2__)
+	const __m256 vk0 = _mm256_set1_ps(k0), vk1 = _mm256_set1_ps(k1), vk2 = _mm256_set1_ps(k2),
+			vk3 = _mm256_set1_ps(k3), vk4 = _mm256_set1_ps(k4);
+	for (; x + 8 <= right; x += 8) {
+		__m256 v = _mm256_mul_ps(vk0, _mm256_loadu_ps(&row[x - 2]));
+		v = _mm256_add_ps(v, _mm256_mul_ps(vk1, _mm256_loadu_ps(&row[x - 1])));
+		v = _mm256_add_ps(v, _mm256_mul_ps(vk2, _mm256_loadu_ps(&row[x])));
+		v = _mm256_add_ps(v, _mm256_mul_ps(vk3, _mm256_loadu_ps(&row[x + 1])));
+		v = _mm256_add_ps(v, _mm256_mul_ps(vk4, _mm256_loadu_ps(&row[x + 2])));
+		_mm256_storeu_ps(&a[x], v);
+	}
+#elif defined(__SSE2__)
+	const __m128 vk0 = _mm_set1_ps(k0), vk1 = _mm_set1_ps(k1), vk2 = _mm_set1_ps(k2),
+			vk3 = _mm_set1_ps(k3), vk4 = _mm_set1_ps(k4);
+	for (; x + 4 <= right; x += 4) {
+		__m128 v = _mm_mul_ps(vk0, _mm_loadu_ps(&row[x - 2]));
+		v = _mm_add_ps(v, _mm_mul_ps(vk1, _mm_loadu_ps(&row[x - 1])));
+		v = _mm_add_ps(v, _mm_mul_ps(vk2, _mm_loadu_ps(&row[x])));
+		v = _mm_add_ps(v, _mm_mul_ps(vk3, _mm_loadu_ps(&row[x + 1])));
+		v = _mm_add_ps(v, _mm_mul_ps(vk4, _mm_loadu_ps(&row[x + 2])));
+		_mm_storeu_ps(&a[x], v);
+	}
+#endif
+	for (; x < right; x++) {
+		a[x] = k0 * row[x - 2] +
+				k1 * row[x - 1] +
+				k2 * row[x] +
+				k3 * row[x + 1] +
+				k4 * row[x + 2];
+	}
+
+	// Right border
+	for (x = right; x < width; x++) {
+		a[x] = k0 * row[Mirror(x - 2, width)] +
+				k1 * row[Mirror(x - 1, width)] +
+				k2 * row[x] +
+				k3 * row[Mirror(x + 1, width)] +
+				k4 * row[Mirror(x + 2, width)];
 	}
 }
 
-float LPyramid::Get_Value(int x, int y, int level)
+void LPyramid::Convolve(float *a, const float *b, int srcWidth, int srcHeight)
+// convolves image b with the filter kernel and stores the even pixels in a
 {
-	int index = x + y * Width;
-	int l = level;
-	if (l > MAX_PYR_LEVELS) l = MAX_PYR_LEVELS;
-	return Levels[level][index];
+	const int dstHeight = (srcHeight + 1) / 2;
+
+	// Each destination row is independent, the rows are split in tiles
+	ParallelFor(dstHeight, 16, boost::bind(&LPyramid::ConvolveRows, this,
+			a, b, srcWidth, srcHeight, _1, _2, _3));
 }
 
+void LPyramid::ConvolveRows(float *a, const float *b, int srcWidth, int srcHeight,
+		unsigned int threadIndex, unsigned int firstRow, unsigned int lastRow)
+{
+	const int dstWidth = (srcWidth + 1) / 2;
+	const float k0 = Kernel[0], k1 = Kernel[1], k2 = Kernel[2], k3 = Kernel[3], k4 = Kernel[4];
+	float *Row = &RowBuffers[threadIndex * 2 * Width];
+	float *RowOut = Row + Width;
+
+	for (int dy = firstRow; dy < (int)lastRow; dy++) {
+		const int y = 2 * dy;
+
+		// The vertical pass has no border inside the row, only the choice
+		// of the 5 source rows depends on the mirroring
+		const float *r0 = &b[Mirror(y - 2, srcHeight) * srcWidth];
+		const float *r1 = &b[Mirror(y - 1, srcHeight) * srcWidth];
+		const float *r2 = &b[y * srcWidth];
+		const float *r3 = &b[Mirror(y + 1, srcHeight) * srcWidth];
+		const float *r4 = &b[Mirror(y + 2, srcHeight) * srcWidth];
 
+		int x = 0;
+#if defined(__AVX2__)
+		const __m256 vk0 = _mm256_set1_ps(k0), vk1 = _mm256_set1_ps(k1), vk2 = _mm256_set1_ps(k2),
+				vk3 = _mm256_set1_ps(k3), vk4 = _mm256_set1_ps(k4);
+		for (; x + 8 <= srcWidth; x += 8) {
+			__m256 v = _mm256_mul_ps(vk0, _mm256_loadu_ps(&r0[x]));
+			v = _mm256_add_ps(v, _mm256_mul_ps(vk1, _mm256_loadu_ps(&r1[x])));
+			v = _mm256_add_ps(v, _mm256_mul_ps(vk2, _mm256_loadu_ps(&r2[x])));
+			v = _mm256_add_ps(v, _mm256_mul_ps(vk3, _mm256_loadu_ps(&r3[x])));
+			v = _mm256_add_ps(v, _mm256_mul_ps(vk4, _mm256_loadu_ps(&r4[x])));
+			_mm256_storeu_ps(&Row[x], v);
+		}
+#elif defined(__SSE2__)
+		const __m128 vk0 = _mm_set1_ps(k0), vk1 = _mm_set1_ps(k1), vk2 = _mm_set1_ps(k2),
+				vk3 = _mm_set1_ps(k3), vk4 = _mm_set1_ps(k4);
+		for (; x + 4 <= srcWidth; x += 4) {
+			__m128 v = _mm_mul_ps(vk0, _mm_loadu_ps(&r0[x]));
+			v = _mm_add_ps(v, _mm_mul_ps(vk1, _mm_loadu_ps(&r1[x])));
+			v = _mm_add_ps(v, _mm_mul_ps(vk2, _mm_loadu_ps(&r2[x])));
+			v = _mm_add_ps(v, _mm_mul_ps(vk3, _mm_loadu_ps(&r3[x])));
+			v = _mm_add_ps(v, _mm_mul_ps(vk4, _mm_loadu_ps(&r4[x])));
+			_mm_storeu_ps(&Row[x], v);
+		}
+#endif
+		for (; x < srcWidth; x++)
+			Row[x] = k0 * r0[x] + k1 * r1[x] + k2 * r2[x] + k3 * r3[x] + k4 * r4[x];
+
+		ConvolveRow(RowOut, Row, srcWidth);
+
+		float *dst = &a[dy * dstWidth];
+		for (int dx = 0; dx < dstWidth; dx++)
+			dst[dx] = RowOut[2 * dx];
+	}
+}
@@ -19,22 +19,106 @@ if not, write to the Free Software Foundation, Inc., 59 Temple Place, Suite 330,
 #ifndef _PDIFF_LPYRAMID_H
 #define _PDIFF_LPYRAMID_H
 
+#include "convtest/alignedbuffer.h"
+
 namespace lux {
 
 #define MAX_PYR_LEVELS 8
 
+// Returns the value of a w x h level at full resolution pixel (x, y), the
+// coarse levels are bilinearly interpolated. The Decoder converts the stored
+// values (e.g. 16bit floats) to float.
+template <class T, class Decoder> inline float LevelLookup(const T *data,
+	const int w, const int h, const int x, const int y, const int level)
+{
+	if (level == 0)
+		return Decoder::Decode(data[x + y * w]);
+
+	// Level pixel i sits on full resolution pixel i << level
+	const int scale = 1 << level;
+	const float invScale = 1.f / scale;
+
+	const int x0 = x >> level;
+	const int y0 = y >> level;
+	const int x1 = (x0 + 1 < w) ? (x0 + 1) : x0;
+	const int y1 = (y0 + 1 < h) ? (y0 + 1) : y0;
+	const float fx = (x & (scale - 1)) * invScale;
+	const float fy = (y & (scale - 1)) * invScale;
+
+	const T *level0 = &data[y0 * w];
+	const T *level1 = &data[y1 * w];
+	const float v00 = Decoder::Decode(level0[x0]);
+	const float v01 = Decoder::Decode(level0[x1]);
+	const float v10 = Decoder::Decode(level1[x0]);
+	const float v11 = Decoder::Decode(level1[x1]);
+	const float v0 = v00 + fx * (v01 - v00);
+	const float v1 = v10 + fx * (v11 - v10);
+
+	return v0 + fy * (v1 - v0);
+}
+
+class FloatDecoder {
+public:
+	static float Decode(const float v) { return v; }
+};
+
 class LPyramid
 {
 public:	
-	LPyramid(float *image, int width, int height);
+	// The storage of all levels is allocated once here (and by Resize()),
+	// the pyramid can then be rebuilt any number of times without allocations
+	LPyramid(int width, int height);
 	virtual ~LPyramid();
-	float Get_Value(int x, int y, int level);
+
+	void Resize(int width, int height);
+	// Uses external storage for the levels, laid out as GetLevels() (e.g. a
+	// memory mapped cache file) instead of allocating them
+	void Map(int width, int height, float *levels);
+
+	// All levels are stored one after the other in a single buffer
+	const float *GetLevels() const { return Levels[0]; }
+	size_t GetLevelsSize() const { return LevelsSize; }
+	// The size of the levels of a width x height pyramid
+	static size_t GetLevelsSize(int width, int height);
+
+	// The full resolution level, it can be filled in place before Build()
+	float *GetBaseLevel() { return Levels[0]; }
+	// Builds the coarse levels from the base level
+	void Build();
+	// Copies the image in the base level and builds the coarse levels
+	void Build(const float *image);
+
+	// Returns the value of the level at full resolution pixel (x, y), the
+	// coarse levels are bilinearly interpolated
+	float Get_Value(int x, int y, int level) const {
+		return LevelLookup<float, FloatDecoder>(Levels[level],
+			LevelWidth[level], LevelHeight[level], x, y, level);
+	}
+
+	const float *GetLevel(int level) const { return Levels[level]; }
+	int GetLevelWidth(int level) const { return LevelWidth[level]; }
+	int GetLevelHeight(int level) const { return LevelHeight[level]; }
+
+	// The size and the offset in GetLevels() of each level of a width x
+	// height pyramid, returns the size of all the levels
+	static size_t Layout(int width, int height, int levelWidth[MAX_PYR_LEVELS],
+		int levelHeight[MAX_PYR_LEVELS], size_t offsets[MAX_PYR_LEVELS]);
 protected:
-	float *Copy(float *img);
-	void Convolve(float *a, float *b);
+	void Convolve(float *a, const float *b, int srcWidth, int srcHeight);
+	void ConvolveRows(float *a, const float *b, int srcWidth, int srcHeight,
+		unsigned int threadIndex, unsigned int firstRow, unsigned int lastRow);
+	void ConvolveRow(float *a, const float *row, int width) const;
 	
-	// Succesively blurred versions of the original image
+	// Succesively blurred and decimated versions of the original image,
+	// each level is half the size of the previous one
 	float *Levels[MAX_PYR_LEVELS];
+	int LevelWidth[MAX_PYR_LEVELS];
+	int LevelHeight[MAX_PYR_LEVELS];
+	size_t LevelsSize;
+	AlignedBuffer<float> LevelsBuffer;
+	// Per thread scratch buffers holding one vertically and one fully
+	// filtered row
+	AlignedBuffer<float> RowBuffers;
 
 	int Width;
 	int Height;
@@ -18,7 +18,17 @@ if not, write to the Free Software Foundation, Inc., 59 Temple Place, Suite 330,
 
 #include <cstdio>
 #include <cmath>
+#include <algorithm>
+#include <atomic>
 
+#include <boost/bind.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/locks.hpp>
+#include <boost/thread/once.hpp>
+
+#include "convtest/parallel.h"
+#include "convtest/colorspace.h"
+#include "convtest/halffloat.h"
 #include "convtest/pdiff/metric.h"
 #include "convtest/pdiff/lpyramid.h"
 
@@ -89,43 +99,872 @@ static float mask(float contrast)
       return result;
 } 
 
-// convert Adobe RGB (1998) with reference white D65 to XYZ
-static void AdobeRGBToXYZ(float r, float g, float b, float &x, float &y, float &z)
-{
-	// matrix is from http://www.brucelindbloom.com/
-	x = r * 0.576700f + g * 0.185556f + b * 0.188212f;
-	y = r * 0.297361f + g * 0.627355f + b * 0.0752847f;
-	z = r * 0.0270328f + g * 0.0706879f + b * 0.991248f;
+//------------------------------------------------------------------------------
+// Lookup tables of tvi(), csf() and mask()
+//
+// The functions are sampled on a log2 scale and linearly interpolated. Every
+// cell is checked against the function when the table is built, the cells
+// where the interpolation error is above TABLE_TOLERANCE (e.g. across the
+// breakpoints of tvi()) and the values outside the table range use the
+// function itself. The relative error is then at most about TABLE_TOLERANCE
+// (1.02e-4 measured for csf(), 4e-5 for mask() and 2e-5 for tvi()), so only
+// the pixels at the threshold can give a different result than the analytic
+// functions (see Yee_SetFunctionTables() and the yee_compare_analytic check
+// of the convtest benchmark).
+//------------------------------------------------------------------------------
+
+#define TABLE_TOLERANCE 1e-4f
+
+namespace {
+
+template<class Func> class LogTable {
+public:
+	LogTable() : minLog2(0.f), scale(0.f), minX(0.f), maxX(0.f) { }
+
+	void Init(const Func &f, const int minExp, const int maxExp, const unsigned int stepsPerOctave) {
+		func = f;
+		minLog2 = (float)minExp;
+		scale = (float)stepsPerOctave;
+		minX = ldexpf(1.f, minExp);
+		maxX = ldexpf(1.f, maxExp);
+
+		const unsigned int cellCount = (maxExp - minExp) * stepsPerOctave;
+		values.resize(cellCount + 1);
+		for (unsigned int i = 0; i <= cellCount; ++i)
+			values[i] = func(exp2f(minLog2 + i / scale));
+
+		exact.resize(cellCount);
+		for (unsigned int i = 0; i < cellCount; ++i) {
+			exact[i] = 0;
+			for (unsigned int j = 1; j < 4; ++j) {
+				const float t = j / 4.f;
+				const float expected = func(exp2f(minLog2 + (i + t) / scale));
+				const float value = values[i] + t * (values[i + 1] - values[i]);
+				if (fabsf(value - expected) > TABLE_TOLERANCE * fabsf(expected))
+					exact[i] = 1;
+			}
+		}
+	}
+
+	float Lookup(const float x, const float log2x) const {
+		if (!((x >= minX) && (x < maxX)))
+			return func(x);
+
+		const float t = (log2x - minLog2) * scale;
+		const int cellCount = (int)exact.size();
+		const int i = std::min(std::max((int)t, 0), cellCount - 1);
+		if (exact[i])
+			return func(x);
+
+		const float f = std::min(std::max(t - i, 0.f), 1.f);
+		return values[i] + f * (values[i + 1] - values[i]);
+	}
+
+	float Lookup(const float x) const {
+		if (!((x >= minX) && (x < maxX)))
+			return func(x);
+
+		return Lookup(x, FastLog2(x));
+	}
+
+private:
+	Func func;
+	float minLog2, scale, minX, maxX;
+	std::vector<float> values;
+	std::vector<unsigned char> exact;
+};
+
+class TviFunc {
+public:
+	float operator()(const float adaptation_luminance) const { return tvi(adaptation_luminance); }
+};
+
+class CsfFunc {
+public:
+	CsfFunc(const float c = 0.f) : cpd(c) { }
+	float operator()(const float lum) const { return csf(cpd, lum); }
+
+	float cpd;
+};
+
+class MaskFunc {
+public:
+	float operator()(const float contrast) const { return mask(contrast); }
+};
+
+// The tables of the functions not depending on the comparison are built
+// only once
+LogTable<TviFunc> tviTable;
+LogTable<MaskFunc> maskTable;
+boost::once_flag tablesInitFlag = BOOST_ONCE_INIT;
+std::atomic<bool> functionTables(true);
+
+void InitTables() {
+	// The adaptation luminance is at least 1e-5
+	tviTable.Init(TviFunc(), -17, 17, 64);
+	maskTable.Init(MaskFunc(), -24, 24, 32);
 }
 
-static void XYZToLAB(float x, float y, float z, float &L, float &A, float &B)
-{
-	static float xw = -1;
-	static float yw;
-	static float zw;
-	// reference white
-	if (xw < 0) {
-		AdobeRGBToXYZ(1, 1, 1, xw, yw, zw);
-	}
-	const float epsilon  = 216.0f / 24389.0f;
-	const float kappa = 24389.0f / 27.0f;
-	float f[3];
-	float r[3];
-	r[0] = x / xw;
-	r[1] = y / yw;
-	r[2] = z / zw;
-	for (int i = 0; i < 3; i++) {
-		if (r[i] > epsilon) {
-			f[i] = powf(r[i], 1.0f / 3.0f);
-		} else {
-			f[i] = (kappa * r[i] + 16.0f) / 116.0f;
+}
+
+class YeeCsfTables::Tables {
+public:
+	// csf(cpd[i], adapt) of the levels used by the test
+	LogTable<CsfFunc> csf[MAX_PYR_LEVELS - 2];
+};
+
+YeeCsfTables::YeeCsfTables() : width(0), fieldOfView(0.f), tables(NULL) {
+}
+
+YeeCsfTables::~YeeCsfTables() {
+	delete tables;
+}
+
+void YeeCsfTables::Update(const unsigned int w, const float fov) {
+	if (tables && (w == width) && (fov == fieldOfView))
+		return;
+
+	if (!tables)
+		tables = new Tables();
+	width = w;
+	fieldOfView = fov;
+
+	YeeParameters params;
+	Yee_InitParameters(width, fieldOfView, params);
+	for (unsigned int i = 0; i < MAX_PYR_LEVELS - 2; i++)
+		tables->csf[i].Init(CsfFunc(params.cpd[i]), -17, 17, 32);
+}
+
+// Pixels are processed in tiles of consecutive pixels. The size is a
+// multiple of the std::vector<bool> word size, so tiles never share a word
+// of the diff output.
+#define YEE_TILE_SIZE 16384
+// Samples are tested in smaller tiles, there are far fewer of them
+#define YEE_SAMPLE_TILE_SIZE 256
+
+// Yee_CompareBanded() bands start on multiples of the coarsest pyramid level
+// scale, so the decimated levels of a band sample the same rows of the full
+// image. The halo covers the rows a band edge can affect: the blur of level
+// i reaches 2^i rows further than level i - 1, 2 + 4 + ... + 128 = 254
+// rows. The coarsest level row following a band, used by the bilinear
+// lookup, is then still 256 rows away from the edge of the halo.
+#define YEE_BAND_ALIGNMENT (1u << (MAX_PYR_LEVELS - 1))
+#define YEE_BAND_HALO (2u * YEE_BAND_ALIGNMENT)
+
+namespace {
+
+class HalfDecoder {
+public:
+	static float Decode(const unsigned short v) { return HalfToFloat(v); }
+};
+
+class BFloat16Decoder {
+public:
+	static float Decode(const unsigned short v) { return BFloat16ToFloat(v); }
+};
+
+// The data of a YeeImage read by the test, either the float data or the
+// 16bit copy
+template <class T, class Decoder> class YeeImageReader {
+public:
+	YeeImageReader(const YeeImage &image, const T *a, const T *b, const T *levels) : A(a), B(b) {
+		const LPyramid &pyramid = image.pyramid;
+		for (int i = 0; i < MAX_PYR_LEVELS; i++) {
+			Levels[i] = levels + (pyramid.GetLevel(i) - pyramid.GetLevel(0));
+			LevelWidth[i] = pyramid.GetLevelWidth(i);
+			LevelHeight[i] = pyramid.GetLevelHeight(i);
+		}
+	}
+
+	float Get_Value(const int x, const int y, const int level) const {
+		return LevelLookup<T, Decoder>(Levels[level], LevelWidth[level], LevelHeight[level], x, y, level);
+	}
+	float GetA(const unsigned int index) const { return Decoder::Decode(A[index]); }
+	float GetB(const unsigned int index) const { return Decoder::Decode(B[index]); }
+
+private:
+	const T *A, *B;
+	const T *Levels[MAX_PYR_LEVELS];
+	int LevelWidth[MAX_PYR_LEVELS];
+	int LevelHeight[MAX_PYR_LEVELS];
+};
+
+typedef YeeImageReader<float, FloatDecoder> FloatImageReader;
+typedef YeeImageReader<unsigned short, HalfDecoder> HalfImageReader;
+typedef YeeImageReader<unsigned short, BFloat16Decoder> BFloat16ImageReader;
+
+FloatImageReader MakeFloatReader(const YeeImage &image) {
+	return FloatImageReader(image, image.A, image.B, image.pyramid.GetLevel(0));
+}
+
+template <class Reader> Reader MakePackedReader(const YeeImage &image) {
+	const unsigned short *data = image.GetPackedData();
+	const size_t chromaSize = image.GetChromaSize();
+	return Reader(image, data, data + chromaSize, data + 2 * chromaSize);
+}
+
+// The values of one of the two images used by the test of a pixel
+typedef struct {
+	// Contrast numerator and denominator of each level
+	float n[MAX_PYR_LEVELS - 2], d[MAX_PYR_LEVELS - 2];
+	float adapt, lum, A, B;
+} YeePixelValues;
+
+class YeeCompareContext {
+public:
+	std::vector<bool> *diff;
+	float *tviBuffer;
+	unsigned int width, height;
+	bool LuminanceOnly;
+	float ColorFactor;
+
+	const YeeImage *imageA, *imageB;
+	// The storage read by the test
+	YeeStorage storage;
+	// TestTile() ranges start at firstPixel. The images can be a band of a
+	// larger one, outputOffset is the index of their first pixel in the
+	// diff and TVI outputs.
+	unsigned int firstPixel, outputOffset;
+	unsigned int adaptation_level;
+	float cpd[MAX_PYR_LEVELS];
+	const YeeCsfTables::Tables *csfTables;
+	// False to use the analytic functions instead of the tables
+	bool functionTables;
+	float F_freq[MAX_PYR_LEVELS - 2];
+
+	// Failed pixel count of each tile, summed in tile order at the end so
+	// the result never depends on the number of threads
+	unsigned int *tileFailed;
+
+	template <class Reader> void GetPixelValues(const Reader &r,
+			const unsigned int index, YeePixelValues &values) const;
+	// Returns true if the pixel passes the test
+	bool TestPixel(const YeePixelValues &va, const YeePixelValues &vb,
+			const unsigned int index) const;
+	template <class Reader> bool TestPixel(const Reader &ra, const Reader &rb,
+			const unsigned int index) const;
+	bool TestPixel(const unsigned int index) const;
+	// Returns the number of failed pixels in [first, last)
+	template <class Reader> unsigned int TestRange(const Reader &ra, const Reader &rb,
+			const unsigned int first, const unsigned int last) const;
+	unsigned int TestRange(const unsigned int first, const unsigned int last) const;
+	void TestTile(const unsigned int threadIndex,
+			const unsigned int first, const unsigned int last);
+};
+
+// The early exit state of Yee_CompareBounded()
+class YeeBoundedContext {
+public:
+	YeeBoundedContext(const YeeCompareContext &c, const unsigned int threshold) :
+		ctx(c), failedThreshold(threshold), pixelsFailed(0), pixelsTested(0),
+		pixelsCount(c.width * c.height), done(false) { }
+
+	void TestTile(const unsigned int threadIndex,
+			const unsigned int first, const unsigned int last);
+
+	const YeeCompareContext &ctx;
+	const unsigned int failedThreshold;
+	unsigned int pixelsFailed, pixelsTested, pixelsCount;
+	bool done;
+	boost::mutex doneMutex;
+};
+
+// The stratified sampling of Yee_CompareEstimate()
+class YeeSampleContext {
+public:
+	YeeSampleContext(const YeeCompareContext &c, const unsigned int sx, const unsigned int sy) :
+		ctx(c), strataX(sx), strataY(sy) { }
+
+	void TestTile(const unsigned int threadIndex,
+			const unsigned int first, const unsigned int last);
+
+	const YeeCompareContext &ctx;
+	const unsigned int strataX, strataY;
+	// Failed sample count of each tile
+	std::vector<unsigned int> tileFailed;
+};
+
+// The coarse pass of Yee_CompareCoarseToFine() and the refinement of the
+// blocks it can not decide
+class YeeCoarseContext {
+public:
+	YeeCoarseContext(const YeeCompareContext &c, const unsigned int level) :
+		ctx(c), blockLevel(level),
+		blocksX((c.width + (1u << level) - 1) >> level),
+		blocksY((c.height + (1u << level) - 1) >> level),
+		blockPasses(blocksX * blocksY, 0) { }
+
+	template <class Reader> bool BlockPasses(const Reader &ra, const Reader &rb,
+			const unsigned int bx, const unsigned int by) const;
+	void BlockTile(const unsigned int threadIndex,
+			const unsigned int first, const unsigned int last);
+
+	template <class Reader> unsigned int TestRange(const Reader &ra, const Reader &rb,
+			const unsigned int first, const unsigned int last) const;
+	void TestTile(const unsigned int threadIndex,
+			const unsigned int first, const unsigned int last);
+
+	const YeeCompareContext &ctx;
+	const unsigned int blockLevel, blocksX, blocksY;
+	// 1 if all the pixels of the block are known to pass
+	std::vector<unsigned char> blockPasses;
+	// Failed pixel count of each tile
+	std::vector<unsigned int> tileFailed;
+};
+
+// The comparison of Yee_CompareMulti(), the values of the test image are read
+// once for all the references and the blocks of each reference passing the
+// coarse test of Yee_CompareCoarseToFine() are not tested pixel by pixel
+class YeeMultiContext {
+public:
+	YeeMultiContext(const YeeCompareContext &c, const std::vector<YeeCoarseContext *> &coarse) :
+		ctx(c), coarseCtxs(coarse) { }
+
+	template <class Reader> void TestRange(const std::vector<Reader> &readers,
+			const Reader &rt, const unsigned int first, const unsigned int last,
+			unsigned int *pixelsFailed) const;
+	void TestTile(const unsigned int threadIndex,
+			const unsigned int first, const unsigned int last);
+
+	// The context of the test image and the coarse pass of each reference
+	const YeeCompareContext &ctx;
+	const std::vector<YeeCoarseContext *> &coarseCtxs;
+	// Failed pixel count of each tile and reference, the counts of a tile
+	// are contiguous
+	std::vector<unsigned int> tileFailed;
+};
+
+}
+
+template <class Reader> void YeeCompareContext::GetPixelValues(const Reader &r,
+		const unsigned int index, YeePixelValues &values) const {
+	const int x = index % width;
+	const int y = index / width;
+	for (unsigned int i = 0; i < MAX_PYR_LEVELS - 2; i++) {
+		values.n[i] = fabsf(r.Get_Value(x,y,i) - r.Get_Value(x,y,i + 1));
+		values.d[i] = fabsf(r.Get_Value(x,y,i+2));
+	}
+	values.adapt = r.Get_Value(x,y,adaptation_level);
+	values.lum = r.Get_Value(x,y,0);
+	if (!LuminanceOnly) {
+		values.A = r.GetA(index);
+		values.B = r.GetB(index);
+	}
+}
+
+bool YeeCompareContext::TestPixel(const YeePixelValues &va, const YeePixelValues &vb,
+		const unsigned int index) const {
+	unsigned int i;
+	float contrast[MAX_PYR_LEVELS - 2];
+	float sum_contrast = 0;
+	for (i = 0; i < MAX_PYR_LEVELS - 2; i++) {
+		float n1 = va.n[i];
+		float n2 = vb.n[i];
+		float numerator = (n1 > n2) ? n1 : n2;
+		float d1 = va.d[i];
+		float d2 = vb.d[i];
+		float denominator = (d1 > d2) ? d1 : d2;
+		if (denominator < 1e-5f) denominator = 1e-5f;
+		contrast[i] = numerator / denominator;
+		sum_contrast += contrast[i];
+	}
+	if (sum_contrast < 1e-5) sum_contrast = 1e-5f;
+	float F_mask[MAX_PYR_LEVELS - 2];
+	float adapt = va.adapt + vb.adapt;
+	adapt *= 0.5f;
+	if (adapt < 1e-5) adapt = 1e-5f;
+	const float log2_adapt = FastLog2(adapt);
+	if (functionTables) {
+		for (i = 0; i < MAX_PYR_LEVELS - 2; i++)
+			F_mask[i] = maskTable.Lookup(contrast[i] * csfTables->csf[i].Lookup(adapt, log2_adapt));
+	} else {
+		for (i = 0; i < MAX_PYR_LEVELS - 2; i++)
+			F_mask[i] = mask(contrast[i] * csf(cpd[i], adapt));
+	}
+	float factor = 0;
+	for (i = 0; i < MAX_PYR_LEVELS - 2; i++) {
+		factor += contrast[i] * F_freq[i] * F_mask[i] / sum_contrast;
+	}
+	if (factor < 1) factor = 1;
+	if (factor > 10) factor = 10;
+	float delta = fabsf(va.lum - vb.lum);
+	bool pass = true;
+	// pure luminance test
+	const float tviValue = functionTables ? tviTable.Lookup(adapt, log2_adapt) : tvi(adapt);
+	if (tviBuffer)
+		tviBuffer[outputOffset + index] = tviValue;
+	if (delta > factor * tviValue) {
+		pass = false;
+	} else if (!LuminanceOnly) {
+		// CIE delta E test with modifications
+		float color_scale = ColorFactor;
+		// ramp down the color test in scotopic regions
+		if (adapt < 10.0f) {
+			// Don't do color test at all.
+			color_scale = 0.0;
 		}
+		float da = va.A - vb.A;
+		float db = va.B - vb.B;
+		da = da * da;
+		db = db * db;
+		float delta_e = (da + db) * color_scale;
+		if (delta_e > factor) {
+			pass = false;
+		}
+	}
+	if (diff)
+		(*diff)[outputOffset + index] = pass;
+
+	return pass;
+}
+
+template <class Reader> bool YeeCompareContext::TestPixel(const Reader &ra, const Reader &rb,
+		const unsigned int index) const {
+	YeePixelValues va, vb;
+	GetPixelValues(ra, index, va);
+	GetPixelValues(rb, index, vb);
+
+	return TestPixel(va, vb, index);
+}
+
+bool YeeCompareContext::TestPixel(const unsigned int index) const {
+	switch (storage) {
+		case YEE_STORAGE_HALF:
+			return TestPixel(MakePackedReader<HalfImageReader>(*imageA),
+					MakePackedReader<HalfImageReader>(*imageB), index);
+		case YEE_STORAGE_BFLOAT16:
+			return TestPixel(MakePackedReader<BFloat16ImageReader>(*imageA),
+					MakePackedReader<BFloat16ImageReader>(*imageB), index);
+		default:
+			return TestPixel(MakeFloatReader(*imageA), MakeFloatReader(*imageB), index);
+	}
+}
+
+template <class Reader> unsigned int YeeCompareContext::TestRange(const Reader &ra, const Reader &rb,
+		const unsigned int first, const unsigned int last) const {
+	unsigned int pixels_failed = 0;
+	for (unsigned int index = first; index < last; index++) {
+		if (!TestPixel(ra, rb, index))
+			pixels_failed++;
+	}
+
+	return pixels_failed;
+}
+
+unsigned int YeeCompareContext::TestRange(const unsigned int first, const unsigned int last) const {
+	switch (storage) {
+		case YEE_STORAGE_HALF:
+			return TestRange(MakePackedReader<HalfImageReader>(*imageA),
+					MakePackedReader<HalfImageReader>(*imageB), first, last);
+		case YEE_STORAGE_BFLOAT16:
+			return TestRange(MakePackedReader<BFloat16ImageReader>(*imageA),
+					MakePackedReader<BFloat16ImageReader>(*imageB), first, last);
+		default:
+			return TestRange(MakeFloatReader(*imageA), MakeFloatReader(*imageB), first, last);
+	}
+}
+
+void YeeCompareContext::TestTile(const unsigned int /* threadIndex */,
+		const unsigned int first, const unsigned int last) {
+	tileFailed[first / YEE_TILE_SIZE] = TestRange(firstPixel + first, firstPixel + last);
+}
+
+void YeeBoundedContext::TestTile(const unsigned int /* threadIndex */,
+		const unsigned int first, const unsigned int last) {
+	{
+		boost::unique_lock<boost::mutex> lock(doneMutex);
+		if (done)
+			return;
+	}
+
+	const unsigned int pixels_failed = ctx.TestRange(first, last);
+
+	boost::unique_lock<boost::mutex> lock(doneMutex);
+	pixelsFailed += pixels_failed;
+	pixelsTested += last - first;
+
+	// Stop once the threshold has been reached or can not be reached anymore
+	if ((pixelsFailed >= failedThreshold) ||
+			(pixelsFailed + (pixelsCount - pixelsTested) < failedThreshold))
+		done = true;
+}
+
+// A well mixed 32bit hash, used to place the samples in their strata
+static unsigned int HashUInt(unsigned int v) {
+	v ^= v >> 16;
+	v *= 0x7feb352du;
+	v ^= v >> 15;
+	v *= 0x846ca68bu;
+	v ^= v >> 16;
+
+	return v;
+}
+
+void YeeSampleContext::TestTile(const unsigned int /* threadIndex */,
+		const unsigned int first, const unsigned int last) {
+	unsigned int samples_failed = 0;
+	for (unsigned int stratum = first; stratum < last; stratum++) {
+		// Bounds of the stratum
+		const unsigned int sx = stratum % strataX;
+		const unsigned int sy = stratum / strataX;
+		const unsigned int x0 = (unsigned int)((unsigned long long)sx * ctx.width / strataX);
+		const unsigned int x1 = (unsigned int)((unsigned long long)(sx + 1) * ctx.width / strataX);
+		const unsigned int y0 = (unsigned int)((unsigned long long)sy * ctx.height / strataY);
+		const unsigned int y1 = (unsigned int)((unsigned long long)(sy + 1) * ctx.height / strataY);
+
+		// One pixel of the stratum, always the same one
+		const unsigned int h = HashUInt(stratum);
+		const unsigned int x = x0 + (h & 0xffffu) % (x1 - x0);
+		const unsigned int y = y0 + (h >> 16) % (y1 - y0);
+
+		if (!ctx.TestPixel(y * ctx.width + x))
+			samples_failed++;
+	}
+
+	tileFailed[first / YEE_SAMPLE_TILE_SIZE] = samples_failed;
+}
+
+// The margin covers the error of the tvi() table and the rounding of the
+// bilinear lookups, the drops of tvi() are in TviLowerBound()
+#define YEE_COARSE_TVI_MARGIN 0.99f
+// Larger blocks would almost always be refined
+#define YEE_COARSE_MAX_LEVEL 8
+// Block size of the coarse pass of Yee_CompareMulti()
+#define YEE_MULTI_BLOCK_LEVEL 3
+
+// The lowest tvi() of the adaptation luminances in [minAdapt, maxAdapt].
+// tvi() grows within each of its pieces but drops where two of them meet:
+// by 2.8% at log10(adapt) = -1.44 (r goes from -1.823 to -1.835) and by 0.7%
+// at 1.9. The lowest value is then the one of minAdapt or the one at the
+// start of a piece in the range, computed as tvi() does.
+static float TviLowerBound(const float minAdapt, const float maxAdapt) {
+	const float logMin = log10f(minAdapt);
+	const float logMax = log10f(maxAdapt);
+
+	float result = tvi(minAdapt);
+	if ((logMin < -1.44f) && (logMax >= -1.44f))
+		result = std::min(result, powf(10.0f, -1.44f - 0.395f));
+	if ((logMin < 1.9f) && (logMax >= 1.9f))
+		result = std::min(result, powf(10.0f, 1.9f - 1.255f));
+
+	return result;
+}
+
+// A pixel always passes if its luminance difference is not above the tvi()
+// of its adaptation luminance and its color difference is not above 1,
+// because the masking factor is at least 1. A block passes if the largest
+// differences of its pixels are below the lowest tvi() of the adaptation
+// luminances they can have: the bilinear lookup of the adaptation level is
+// never outside the range of the samples it interpolates.
+template <class Reader> bool YeeCoarseContext::BlockPasses(const Reader &ra, const Reader &rb,
+		const unsigned int bx, const unsigned int by) const {
+	const unsigned int width = ctx.width;
+	const unsigned int height = ctx.height;
+	const unsigned int x0 = bx << blockLevel;
+	const unsigned int y0 = by << blockLevel;
+	const unsigned int x1 = std::min(x0 + (1u << blockLevel), width);
+	const unsigned int y1 = std::min(y0 + (1u << blockLevel), height);
+
+	float maxDeltaL = 0.f, maxDeltaE = 0.f;
+	for (unsigned int y = y0; y < y1; ++y) {
+		for (unsigned int x = x0; x < x1; ++x) {
+			const float deltaL = fabsf(ra.Get_Value(x, y, 0) - rb.Get_Value(x, y, 0));
+			// Written to also catch NaNs
+			if (!(deltaL <= maxDeltaL))
+				maxDeltaL = deltaL;
+
+			if (!ctx.LuminanceOnly) {
+				const unsigned int index = y * width + x;
+				float da = ra.GetA(index) - rb.GetA(index);
+				float db = ra.GetB(index) - rb.GetB(index);
+				da = da * da;
+				db = db * db;
+				const float deltaE = da + db;
+				if (!(deltaE <= maxDeltaE))
+					maxDeltaE = deltaE;
+			}
+		}
+	}
+
+	// The samples of the adaptation level read by the pixels of the block
+	const unsigned int level = ctx.adaptation_level;
+	const unsigned int levelWidth = ctx.imageA->pyramid.GetLevelWidth(level);
+	const unsigned int levelHeight = ctx.imageA->pyramid.GetLevelHeight(level);
+	const unsigned int sx0 = x0 >> level;
+	const unsigned int sy0 = y0 >> level;
+	const unsigned int sx1 = std::min(((x1 - 1) >> level) + 1, levelWidth - 1);
+	const unsigned int sy1 = std::min(((y1 - 1) >> level) + 1, levelHeight - 1);
+
+	float minAdapt = INFINITY, maxAdapt = 0.f;
+	for (unsigned int sy = sy0; sy <= sy1; ++sy) {
+		for (unsigned int sx = sx0; sx <= sx1; ++sx) {
+			const float adapt = 0.5f * (ra.Get_Value(sx << level, sy << level, level) +
+					rb.Get_Value(sx << level, sy << level, level));
+			if (!(adapt >= minAdapt))
+				minAdapt = adapt;
+			if (!(adapt <= maxAdapt))
+				maxAdapt = adapt;
+		}
+	}
+	if (minAdapt < 1e-5f) minAdapt = 1e-5f;
+	if (maxAdapt < 1e-5f) maxAdapt = 1e-5f;
+
+	if (!(maxDeltaL <= YEE_COARSE_TVI_MARGIN * TviLowerBound(minAdapt, maxAdapt)))
+		return false;
+	if (!ctx.LuminanceOnly && !(maxDeltaE * std::max(ctx.ColorFactor, 0.f) <= 1.f))
+		return false;
+
+	return true;
+}
+
+void YeeCoarseContext::BlockTile(const unsigned int /* threadIndex */,
+		const unsigned int first, const unsigned int last) {
+	for (unsigned int block = first; block < last; ++block) {
+		const unsigned int bx = block % blocksX;
+		const unsigned int by = block / blocksX;
+
+		bool passes;
+		switch (ctx.storage) {
+			case YEE_STORAGE_HALF:
+				passes = BlockPasses(MakePackedReader<HalfImageReader>(*ctx.imageA),
+						MakePackedReader<HalfImageReader>(*ctx.imageB), bx, by);
+				break;
+			case YEE_STORAGE_BFLOAT16:
+				passes = BlockPasses(MakePackedReader<BFloat16ImageReader>(*ctx.imageA),
+						MakePackedReader<BFloat16ImageReader>(*ctx.imageB), bx, by);
+				break;
+			default:
+				passes = BlockPasses(MakeFloatReader(*ctx.imageA), MakeFloatReader(*ctx.imageB), bx, by);
+				break;
+		}
+
+		blockPasses[block] = passes ? 1 : 0;
+	}
+}
+
+template <class Reader> unsigned int YeeCoarseContext::TestRange(const Reader &ra, const Reader &rb,
+		const unsigned int first, const unsigned int last) const {
+	unsigned int pixels_failed = 0;
+	for (unsigned int index = first; index < last; index++) {
+		const unsigned int x = index % ctx.width;
+		const unsigned int y = index / ctx.width;
+
+		if (blockPasses[(y >> blockLevel) * blocksX + (x >> blockLevel)]) {
+			if (ctx.diff)
+				(*ctx.diff)[ctx.outputOffset + index] = true;
+		} else if (!ctx.TestPixel(ra, rb, index))
+			pixels_failed++;
+	}
+
+	return pixels_failed;
+}
+
+void YeeCoarseContext::TestTile(const unsigned int /* threadIndex */,
+		const unsigned int first, const unsigned int last) {
+	unsigned int pixels_failed;
+	switch (ctx.storage) {
+		case YEE_STORAGE_HALF:
+			pixels_failed = TestRange(MakePackedReader<HalfImageReader>(*ctx.imageA),
+					MakePackedReader<HalfImageReader>(*ctx.imageB), first, last);
+			break;
+		case YEE_STORAGE_BFLOAT16:
+			pixels_failed = TestRange(MakePackedReader<BFloat16ImageReader>(*ctx.imageA),
+					MakePackedReader<BFloat16ImageReader>(*ctx.imageB), first, last);
+			break;
+		default:
+			pixels_failed = TestRange(MakeFloatReader(*ctx.imageA), MakeFloatReader(*ctx.imageB), first, last);
+			break;
+	}
+
+	tileFailed[first / YEE_TILE_SIZE] = pixels_failed;
+}
+
+template <class Reader> void YeeMultiContext::TestRange(const std::vector<Reader> &readers,
+		const Reader &rt, const unsigned int first, const unsigned int last,
+		unsigned int *pixelsFailed) const {
+	YeePixelValues vr, vt;
+	for (unsigned int index = first; index < last; index++) {
+		const unsigned int x = index % ctx.width;
+		const unsigned int y = index / ctx.width;
+
+		bool testRead = false;
+		for (unsigned int i = 0; i < readers.size(); ++i) {
+			const YeeCoarseContext &coarseCtx = *coarseCtxs[i];
+			if (coarseCtx.blockPasses[(y >> coarseCtx.blockLevel) * coarseCtx.blocksX +
+					(x >> coarseCtx.blockLevel)])
+				continue;
+
+			if (!testRead) {
+				ctx.GetPixelValues(rt, index, vt);
+				testRead = true;
+			}
+
+			ctx.GetPixelValues(readers[i], index, vr);
+			if (!ctx.TestPixel(vr, vt, index))
+				pixelsFailed[i]++;
+		}
+	}
+}
+
+void YeeMultiContext::TestTile(const unsigned int /* threadIndex */,
+		const unsigned int first, const unsigned int last) {
+	unsigned int *pixelsFailed = &tileFailed[(first / YEE_TILE_SIZE) * coarseCtxs.size()];
+
+	switch (ctx.storage) {
+		case YEE_STORAGE_HALF: {
+			std::vector<HalfImageReader> readers;
+			for (unsigned int i = 0; i < coarseCtxs.size(); ++i)
+				readers.push_back(MakePackedReader<HalfImageReader>(*coarseCtxs[i]->ctx.imageA));
+			TestRange(readers, MakePackedReader<HalfImageReader>(*ctx.imageB),
+					first, last, pixelsFailed);
+			break;
+		}
+		case YEE_STORAGE_BFLOAT16: {
+			std::vector<BFloat16ImageReader> readers;
+			for (unsigned int i = 0; i < coarseCtxs.size(); ++i)
+				readers.push_back(MakePackedReader<BFloat16ImageReader>(*coarseCtxs[i]->ctx.imageA));
+			TestRange(readers, MakePackedReader<BFloat16ImageReader>(*ctx.imageB),
+					first, last, pixelsFailed);
+			break;
+		}
+		default: {
+			std::vector<FloatImageReader> readers;
+			for (unsigned int i = 0; i < coarseCtxs.size(); ++i)
+				readers.push_back(MakeFloatReader(*coarseCtxs[i]->ctx.imageA));
+			TestRange(readers, MakeFloatReader(*ctx.imageB), first, last, pixelsFailed);
+			break;
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+// YeeImage
+//------------------------------------------------------------------------------
+
+YeeImage::YeeImage(const unsigned int w, const unsigned int h) :
+	A(NULL), B(NULL), pyramid(0, 0), width(0), height(0),
+	gamma(2.2f), luminance(100.f), chromaSize(0),
+	storage(YEE_STORAGE_FLOAT), packedStorage(YEE_STORAGE_FLOAT) {
+	Resize(w, h);
+}
+
+YeeImage::~YeeImage() {
+}
+
+size_t YeeImage::GetChromaSize(const unsigned int width, const unsigned int height) {
+	const size_t alignment = LUX_BUFFER_ALIGNMENT / sizeof(float);
+	return ((width * height + alignment - 1) / alignment) * alignment;
+}
+
+size_t YeeImage::GetDataSize(const unsigned int width, const unsigned int height) {
+	return 2 * GetChromaSize(width, height) + LPyramid::GetLevelsSize(width, height);
+}
+
+void YeeImage::Resize(const unsigned int w, const unsigned int h) {
+	width = w;
+	height = h;
+
+	chromaSize = GetChromaSize(width, height);
+
+	chromaBuffer.Resize(2 * chromaSize);
+	A = chromaBuffer.Get();
+	B = A + chromaSize;
+
+	pyramid.Resize(width, height);
+	packedStorage = YEE_STORAGE_FLOAT;
+}
+
+void YeeImage::Map(const unsigned int w, const unsigned int h,
+		const float g, const float l, float *data) {
+	width = w;
+	height = h;
+	gamma = g;
+	luminance = l;
+
+	chromaSize = GetChromaSize(width, height);
+
+	chromaBuffer.Free();
+	A = data;
+	B = A + chromaSize;
+
+	pyramid.Map(width, height, B + chromaSize);
+	Pack();
+}
+
+void YeeImage::ConvertTile(const ColorSpaceConverter *converter, const float *rgb,
+		const unsigned int /* threadIndex */, const unsigned int first, const unsigned int last) {
+	converter->RGBToLumAB(&rgb[3 * first], last - first,
+			&pyramid.GetBaseLevel()[first], &A[first], &B[first]);
+}
+
+void YeeImage::Build(const float *rgb, const float g, const float l) {
+	gamma = g;
+	luminance = l;
+
+	// assuming colorspaces are in Adobe RGB (1998) convert to XYZ, the
+	// luminance is written directly in the base level of the pyramid
+	const ColorSpaceConverter converter(gamma, luminance);
+	ParallelFor(width * height, YEE_TILE_SIZE, boost::bind(&YeeImage::ConvertTile, this,
+			&converter, rgb, _1, _2, _3));
+
+	// Constructing Laplacian Pyramid
+	pyramid.Build();
+
+	Pack();
+}
+
+static void PackTile(const YeeStorage storage, const float *src, unsigned short *dst,
+		const unsigned int /* threadIndex */, const unsigned int first, const unsigned int last) {
+	if (storage == YEE_STORAGE_HALF) {
+		for (unsigned int i = first; i < last; ++i)
+			dst[i] = FloatToHalf(src[i]);
+	} else {
+		for (unsigned int i = first; i < last; ++i)
+			dst[i] = FloatToBFloat16(src[i]);
 	}
-	L = 116.0f * f[1] - 16.0f;
-	A = 500.0f * (f[0] - f[1]);
-	B = 200.0f * (f[1] - f[2]);
 }
 
+void YeeImage::Pack() {
+	packedStorage = YEE_STORAGE_FLOAT;
+	if (storage == YEE_STORAGE_FLOAT)
+		return;
+
+	const size_t levelsSize = pyramid.GetLevelsSize();
+	packedBuffer.Resize(2 * chromaSize + levelsSize);
+	unsigned short *packed = packedBuffer.Get();
+
+	ParallelFor(chromaSize, YEE_TILE_SIZE, boost::bind(PackTile, storage, A, packed, _1, _2, _3));
+	ParallelFor(chromaSize, YEE_TILE_SIZE, boost::bind(PackTile, storage, B, packed + chromaSize, _1, _2, _3));
+	ParallelFor(levelsSize, YEE_TILE_SIZE, boost::bind(PackTile, storage, pyramid.GetLevels(),
+			packed + 2 * chromaSize, _1, _2, _3));
+
+	packedStorage = storage;
+}
+
+//------------------------------------------------------------------------------
+// YeeWorkspace
+//------------------------------------------------------------------------------
+
+YeeWorkspace::YeeWorkspace(const unsigned int w, const unsigned int h) :
+	width(0), height(0) {
+	Resize(w, h);
+}
+
+YeeWorkspace::~YeeWorkspace() {
+}
+
+void YeeWorkspace::Resize(const unsigned int w, const unsigned int h) {
+	width = w;
+	height = h;
+
+	a.Resize(width, height);
+	b.Resize(width, height);
+
+	tileFailed.resize((width * height + YEE_TILE_SIZE - 1) / YEE_TILE_SIZE, 0);
+}
+
+//------------------------------------------------------------------------------
+
 unsigned int lux::Yee_Compare(
 		const float *rgbA,
 		const float *rgbB,
@@ -133,6 +972,7 @@ unsigned int lux::Yee_Compare(
 		float *tviBuffer,
 		const unsigned int width,
 		const unsigned int height,
+		YeeWorkspace *workspace,
 		const bool LuminanceOnly,
 		const float FieldOfView,
 		const float Gamma,
@@ -153,150 +993,432 @@ unsigned int lux::Yee_Compare(
 		// Images are binary identical
 		return true;
 	}
-	
-	// assuming colorspaces are in Adobe RGB (1998) convert to XYZ
-	float *aX = new float[dim];
-	float *aY = new float[dim];
-	float *aZ = new float[dim];
-	float *bX = new float[dim];
-	float *bY = new float[dim];
-	float *bZ = new float[dim];
-	float *aLum = new float[dim];
-	float *bLum = new float[dim];
-	
-	float *aA = new float[dim];
-	float *bA = new float[dim];
-	float *aB = new float[dim];
-	float *bB = new float[dim];
-	
-	unsigned int x, y;
-	for (y = 0; y < height; y++) {
-		for (x = 0; x < width; x++) {
-			float r, g, b, l;
-			i = x + y * width;
-			r = powf(rgbA[3 * i], Gamma);
-			g = powf(rgbA[3 * i + 1], Gamma);
-			b = powf(rgbA[3 * i + 2], Gamma);						
-			AdobeRGBToXYZ(r,g,b,aX[i],aY[i],aZ[i]);			
-			XYZToLAB(aX[i], aY[i], aZ[i], l, aA[i], aB[i]);
-			r = powf(rgbB[3 * i], Gamma);
-			g = powf(rgbB[3 * i + 1], Gamma);
-			b = powf(rgbB[3 * i + 2], Gamma);						
-			AdobeRGBToXYZ(r,g,b,bX[i],bY[i],bZ[i]);
-			XYZToLAB(bX[i], bY[i], bZ[i], l, bA[i], bB[i]);
-			aLum[i] = aY[i] * Luminance;
-			bLum[i] = bY[i] * Luminance;
-		}
-	}
 
-	// Constructing Laplacian Pyramids
-	
-	LPyramid *la = new LPyramid(aLum, width, height);
-	LPyramid *lb = new LPyramid(bLum, width, height);
+	// Use a temporary workspace if the caller has not provided one
+	YeeWorkspace *localWorkspace = NULL;
+	if (!workspace) {
+		localWorkspace = new YeeWorkspace(width, height);
+		workspace = localWorkspace;
+	} else if ((workspace->width != width) || (workspace->height != height))
+		workspace->Resize(width, height);
+
+	workspace->a.Build(rgbA, Gamma, Luminance);
+	workspace->b.Build(rgbB, Gamma, Luminance);
+
+	const unsigned int pixels_failed = (DownSample > 0) ?
+		Yee_CompareCoarseToFine(workspace->a, workspace->b, diff, tviBuffer,
+				DownSample, LuminanceOnly, FieldOfView, ColorFactor, &workspace->csfTables) :
+		Yee_Compare(workspace->a, workspace->b,
+				diff, tviBuffer, workspace, LuminanceOnly, FieldOfView, ColorFactor);
+
+	delete localWorkspace;
 	
+	return pixels_failed;
+}
+
+void lux::Yee_InitParameters(const unsigned int width, const float FieldOfView,
+		YeeParameters &params)
+{
+	unsigned int i;
 	float num_one_degree_pixels = (float) (2 * tan(FieldOfView * 0.5 * M_PI / 180) * 180 / M_PI);
 	float pixels_per_degree = width / num_one_degree_pixels;
 	
-	// Performing test
-	
 	float num_pixels = 1;
-	unsigned int adaptation_level = 0;
+	params.adaptationLevel = 0;
 	for (i = 0; i < MAX_PYR_LEVELS; i++) {
-		adaptation_level = i;
+		params.adaptationLevel = i;
 		if (num_pixels > num_one_degree_pixels) break;
 		num_pixels *= 2;
 	}
 	
-	float cpd[MAX_PYR_LEVELS];
-	cpd[0] = 0.5f * pixels_per_degree;
-	for (i = 1; i < MAX_PYR_LEVELS; i++) cpd[i] = 0.5f * cpd[i - 1];
+	params.cpd[0] = 0.5f * pixels_per_degree;
+	for (i = 1; i < MAX_PYR_LEVELS; i++) params.cpd[i] = 0.5f * params.cpd[i - 1];
 	float csf_max = csf(3.248f, 100.0f);
 	
-	float F_freq[MAX_PYR_LEVELS - 2];
-	for (i = 0; i < MAX_PYR_LEVELS - 2; i++) F_freq[i] = csf_max / csf( cpd[i], 100.0f);
+	for (i = 0; i < MAX_PYR_LEVELS - 2; i++) params.F_freq[i] = csf_max / csf(params.cpd[i], 100.0f);
+}
+
+// Sets up the per comparison parameters of the metric, csfTables are
+// updated for the width of the images
+static void InitCompareContext(
+		YeeCompareContext &ctx,
+		const YeeImage &imageA,
+		const YeeImage &imageB,
+		std::vector<bool> *diff,
+		float *tviBuffer,
+		YeeCsfTables &csfTables,
+		const bool LuminanceOnly,
+		const float FieldOfView,
+		const float ColorFactor)
+{
+	ctx.diff = diff;
+	ctx.tviBuffer = tviBuffer;
+	ctx.width = imageA.GetWidth();
+	ctx.height = imageA.GetHeight();
+	ctx.LuminanceOnly = LuminanceOnly;
+	ctx.ColorFactor = ColorFactor;
+
+	ctx.imageA = &imageA;
+	ctx.imageB = &imageB;
+	ctx.storage = (imageA.GetPackedStorage() == imageB.GetPackedStorage()) ?
+		imageA.GetPackedStorage() : YEE_STORAGE_FLOAT;
+	ctx.tileFailed = NULL;
+	ctx.firstPixel = 0;
+	ctx.outputOffset = 0;
 	
+	YeeParameters params;
+	Yee_InitParameters(ctx.width, FieldOfView, params);
+	ctx.adaptation_level = params.adaptationLevel;
+	std::copy(params.cpd, params.cpd + MAX_PYR_LEVELS, ctx.cpd);
+	std::copy(params.F_freq, params.F_freq + MAX_PYR_LEVELS - 2, ctx.F_freq);
+
+	boost::call_once(tablesInitFlag, InitTables);
+	csfTables.Update(ctx.width, FieldOfView);
+	ctx.csfTables = csfTables.Get();
+	ctx.functionTables = functionTables;
+}
+
+void lux::Yee_SetFunctionTables(const bool enabled) {
+	functionTables = enabled;
+}
+
+bool lux::Yee_GetFunctionTables() {
+	return functionTables;
+}
+
+unsigned int lux::Yee_Compare(
+		const YeeImage &imageA,
+		const YeeImage &imageB,
+		std::vector<bool> *diff,
+		float *tviBuffer,
+		YeeWorkspace *workspace,
+		const bool LuminanceOnly,
+		const float FieldOfView,
+		const float ColorFactor)
+{
+	unsigned int i, dim;
+	dim = imageA.GetWidth() * imageA.GetHeight();
+	if (dim == 0)
+		return 0;
+
+	YeeCsfTables localCsfTables;
+	YeeCompareContext ctx;
+	InitCompareContext(ctx, imageA, imageB, diff, tviBuffer,
+			workspace ? workspace->csfTables : localCsfTables,
+			LuminanceOnly, FieldOfView, ColorFactor);
+
+	const unsigned int tileCount = (dim + YEE_TILE_SIZE - 1) / YEE_TILE_SIZE;
+	std::vector<unsigned int> localTileFailed;
+	if (workspace && (workspace->tileFailed.size() >= tileCount))
+		ctx.tileFailed = &workspace->tileFailed[0];
+	else {
+		localTileFailed.resize(tileCount, 0);
+		ctx.tileFailed = &localTileFailed[0];
+	}
+	
+	// Performing test
+	ParallelFor(dim, YEE_TILE_SIZE, boost::bind(&YeeCompareContext::TestTile, &ctx, _1, _2, _3));
+
 	unsigned int pixels_failed = 0;
-	for (y = 0; y < height; y++) {
-	  for (x = 0; x < width; x++) {
-		int index = x + y * width;
-		float contrast[MAX_PYR_LEVELS - 2];
-		float sum_contrast = 0;
-		for (i = 0; i < MAX_PYR_LEVELS - 2; i++) {
-			float n1 = fabsf(la->Get_Value(x,y,i) - la->Get_Value(x,y,i + 1));
-			float n2 = fabsf(lb->Get_Value(x,y,i) - lb->Get_Value(x,y,i + 1));
-			float numerator = (n1 > n2) ? n1 : n2;
-			float d1 = fabsf(la->Get_Value(x,y,i+2));
-			float d2 = fabsf(lb->Get_Value(x,y,i+2));
-			float denominator = (d1 > d2) ? d1 : d2;
-			if (denominator < 1e-5f) denominator = 1e-5f;
-			contrast[i] = numerator / denominator;
-			sum_contrast += contrast[i];
-		}
-		if (sum_contrast < 1e-5) sum_contrast = 1e-5f;
-		float F_mask[MAX_PYR_LEVELS - 2];
-		float adapt = la->Get_Value(x,y,adaptation_level) + lb->Get_Value(x,y,adaptation_level);
-		adapt *= 0.5f;
-		if (adapt < 1e-5) adapt = 1e-5f;
-		for (i = 0; i < MAX_PYR_LEVELS - 2; i++) {
-			F_mask[i] = mask(contrast[i] * csf(cpd[i], adapt)); 
+	for (i = 0; i < tileCount; i++)
+		pixels_failed += ctx.tileFailed[i];
+	
+	return pixels_failed;
+}
+
+unsigned int lux::Yee_CompareCoarseToFine(
+		const YeeImage &imageA,
+		const YeeImage &imageB,
+		std::vector<bool> *diff,
+		float *tviBuffer,
+		const unsigned int BlockLevel,
+		const bool LuminanceOnly,
+		const float FieldOfView,
+		const float ColorFactor,
+		YeeCsfTables *csfTables)
+{
+	const unsigned int dim = imageA.GetWidth() * imageA.GetHeight();
+	if (dim == 0)
+		return 0;
+
+	YeeCsfTables localCsfTables;
+	YeeCompareContext ctx;
+	InitCompareContext(ctx, imageA, imageB, diff, tviBuffer,
+			csfTables ? *csfTables : localCsfTables,
+			LuminanceOnly, FieldOfView, ColorFactor);
+
+	YeeCoarseContext coarseCtx(ctx, std::min(BlockLevel, (unsigned int)YEE_COARSE_MAX_LEVEL));
+
+	// Coarse pass, the skipped blocks would not fill the TVI output
+	if (!tviBuffer) {
+		ParallelFor(coarseCtx.blocksX * coarseCtx.blocksY, YEE_SAMPLE_TILE_SIZE,
+				boost::bind(&YeeCoarseContext::BlockTile, &coarseCtx, _1, _2, _3));
+	}
+
+	// Refinement of the blocks not known to pass
+	coarseCtx.tileFailed.resize((dim + YEE_TILE_SIZE - 1) / YEE_TILE_SIZE, 0);
+	ParallelFor(dim, YEE_TILE_SIZE, boost::bind(&YeeCoarseContext::TestTile, &coarseCtx, _1, _2, _3));
+
+	unsigned int pixels_failed = 0;
+	for (unsigned int i = 0; i < coarseCtx.tileFailed.size(); i++)
+		pixels_failed += coarseCtx.tileFailed[i];
+
+	return pixels_failed;
+}
+
+YeeMultiResult lux::Yee_CompareMulti(
+		const std::vector<const YeeImage *> &references,
+		const YeeImage &test,
+		const bool LuminanceOnly,
+		const float FieldOfView,
+		const float ColorFactor,
+		YeeCsfTables *csfTables)
+{
+	const unsigned int dim = test.GetWidth() * test.GetHeight();
+
+	YeeMultiResult result;
+	result.pixelsFailed.resize(references.size(), dim);
+	result.bestReference = 0;
+
+	// The references of a different size fail all the pixels
+	std::vector<const YeeImage *> compared;
+	std::vector<unsigned int> comparedIndex;
+	for (unsigned int i = 0; i < references.size(); ++i) {
+		if ((references[i]->GetWidth() == test.GetWidth()) &&
+				(references[i]->GetHeight() == test.GetHeight())) {
+			compared.push_back(references[i]);
+			comparedIndex.push_back(i);
 		}
-		float factor = 0;
-		for (i = 0; i < MAX_PYR_LEVELS - 2; i++) {
-			factor += contrast[i] * F_freq[i] * F_mask[i] / sum_contrast;
+	}
+
+	if ((dim > 0) && !compared.empty()) {
+		// One context for each reference, the one of the first is also used
+		// for the test image
+		std::vector<YeeCompareContext> refCtxs(compared.size());
+		std::vector<YeeCoarseContext *> coarseCtxs(compared.size());
+		// All the images have the same width, so the same tables
+		YeeCsfTables localCsfTables;
+		for (unsigned int i = 0; i < compared.size(); ++i) {
+			InitCompareContext(refCtxs[i], *compared[i], test, NULL, NULL,
+					csfTables ? *csfTables : localCsfTables,
+					LuminanceOnly, FieldOfView, ColorFactor);
+			coarseCtxs[i] = new YeeCoarseContext(refCtxs[i], YEE_MULTI_BLOCK_LEVEL);
+			ParallelFor(coarseCtxs[i]->blocksX * coarseCtxs[i]->blocksY, YEE_SAMPLE_TILE_SIZE,
+					boost::bind(&YeeCoarseContext::BlockTile, coarseCtxs[i], _1, _2, _3));
 		}
-		if (factor < 1) factor = 1;
-		if (factor > 10) factor = 10;
-		float delta = fabsf(la->Get_Value(x,y,0) - lb->Get_Value(x,y,0));
-		bool pass = true;
-		// pure luminance test
-		const float tviValue = tvi(adapt);
-		if (tviBuffer)
-			tviBuffer[x + y * width] = tviValue;
-		if (delta > factor * tviValue) {
-			pass = false;
-		} else if (!LuminanceOnly) {
-			// CIE delta E test with modifications
-			float color_scale = ColorFactor;
-			// ramp down the color test in scotopic regions
-			if (adapt < 10.0f) {
-				// Don't do color test at all.
-				color_scale = 0.0;
-			}
-			float da = aA[index] - bA[index];
-			float db = aB[index] - bB[index];
-			da = da * da;
-			db = db * db;
-			float delta_e = (da + db) * color_scale;
-			if (delta_e > factor) {
-				pass = false;
-			}
+
+		// The 16bit copies are used only if all the images have the same one
+		YeeCompareContext &ctx = refCtxs[0];
+		for (unsigned int i = 1; i < compared.size(); ++i) {
+			if (refCtxs[i].storage != ctx.storage)
+				ctx.storage = YEE_STORAGE_FLOAT;
 		}
-		if (!pass) {
-			pixels_failed++;
 
-			if (diff)
-				(*diff)[index] = false;
-		} else {
-			if (diff)
-				(*diff)[index] = true;
+		YeeMultiContext multiCtx(ctx, coarseCtxs);
+		const unsigned int tileCount = (dim + YEE_TILE_SIZE - 1) / YEE_TILE_SIZE;
+		multiCtx.tileFailed.resize(tileCount * compared.size(), 0);
+		ParallelFor(dim, YEE_TILE_SIZE, boost::bind(&YeeMultiContext::TestTile, &multiCtx, _1, _2, _3));
+
+		for (unsigned int i = 0; i < compared.size(); ++i) {
+			unsigned int pixels_failed = 0;
+			for (unsigned int t = 0; t < tileCount; ++t)
+				pixels_failed += multiCtx.tileFailed[t * compared.size() + i];
+			result.pixelsFailed[comparedIndex[i]] = pixels_failed;
+
+			delete coarseCtxs[i];
 		}
-	  }
 	}
-	
-	if (aX) delete[] aX;
-	if (aY) delete[] aY;
-	if (aZ) delete[] aZ;
-	if (bX) delete[] bX;
-	if (bY) delete[] bY;
-	if (bZ) delete[] bZ;
-	if (aLum) delete[] aLum;
-	if (bLum) delete[] bLum;
-	if (la) delete la;
-	if (lb) delete lb;
-	if (aA) delete[] aA;
-	if (bA) delete[] bA;
-	if (aB) delete[] aB;
-	if (bB) delete[] bB;
-	
+
+	for (unsigned int i = 1; i < references.size(); ++i) {
+		if (result.pixelsFailed[i] < result.pixelsFailed[result.bestReference])
+			result.bestReference = i;
+	}
+
+	return result;
+}
+
+YeeBoundedResult lux::Yee_CompareBounded(
+		const YeeImage &imageA,
+		const YeeImage &imageB,
+		const unsigned int failedThreshold,
+		const bool LuminanceOnly,
+		const float FieldOfView,
+		const float ColorFactor,
+		YeeCsfTables *csfTables)
+{
+	const unsigned int dim = imageA.GetWidth() * imageA.GetHeight();
+
+	YeeCsfTables localCsfTables;
+	YeeCompareContext ctx;
+	InitCompareContext(ctx, imageA, imageB, NULL, NULL,
+			csfTables ? *csfTables : localCsfTables,
+			LuminanceOnly, FieldOfView, ColorFactor);
+
+	YeeBoundedContext boundedCtx(ctx, failedThreshold);
+	if (failedThreshold == 0)
+		boundedCtx.done = true;
+	ParallelFor(dim, YEE_TILE_SIZE, boost::bind(&YeeBoundedContext::TestTile, &boundedCtx, _1, _2, _3));
+
+	YeeBoundedResult result;
+	result.pixelsFailed = boundedCtx.pixelsFailed;
+	result.pixelsTested = boundedCtx.pixelsTested;
+	result.failed = (boundedCtx.pixelsFailed >= failedThreshold);
+
+	return result;
+}
+
+YeeEstimate lux::Yee_CompareEstimate(
+		const YeeImage &imageA,
+		const YeeImage &imageB,
+		const unsigned int sampleCount,
+		const bool LuminanceOnly,
+		const float FieldOfView,
+		const float ColorFactor,
+		YeeCsfTables *csfTables)
+{
+	const unsigned int width = imageA.GetWidth();
+	const unsigned int height = imageA.GetHeight();
+	const unsigned int dim = width * height;
+
+	YeeEstimate estimate;
+	estimate.samples = 0;
+	estimate.samplesFailed = 0;
+	estimate.failedFraction = 0.f;
+	estimate.low = 0.f;
+	estimate.high = 1.f;
+	if ((dim == 0) || (sampleCount == 0))
+		return estimate;
+
+	YeeCsfTables localCsfTables;
+	YeeCompareContext ctx;
+	InitCompareContext(ctx, imageA, imageB, NULL, NULL,
+			csfTables ? *csfTables : localCsfTables,
+			LuminanceOnly, FieldOfView, ColorFactor);
+
+	if (sampleCount >= dim) {
+		// Cheaper to test all pixels, the result is exact
+		std::vector<unsigned int> tileFailed((dim + YEE_TILE_SIZE - 1) / YEE_TILE_SIZE, 0);
+		ctx.tileFailed = &tileFailed[0];
+		ParallelFor(dim, YEE_TILE_SIZE, boost::bind(&YeeCompareContext::TestTile, &ctx, _1, _2, _3));
+
+		estimate.samples = dim;
+		for (unsigned int i = 0; i < tileFailed.size(); i++)
+			estimate.samplesFailed += tileFailed[i];
+		estimate.failedFraction = estimate.samplesFailed / (float)dim;
+		estimate.low = estimate.failedFraction;
+		estimate.high = estimate.failedFraction;
+
+		return estimate;
+	}
+
+	// A grid of strata with about the aspect ratio of the image and one
+	// sample in each of them
+	const float aspect = width / (float)height;
+	const unsigned int strataX = std::max(1u, std::min(width,
+			(unsigned int)ceilf(sqrtf(sampleCount * aspect))));
+	const unsigned int strataY = std::max(1u, std::min(height,
+			(sampleCount + strataX - 1) / strataX));
+	const unsigned int strataCount = strataX * strataY;
+
+	YeeSampleContext sampleCtx(ctx, strataX, strataY);
+	sampleCtx.tileFailed.resize((strataCount + YEE_SAMPLE_TILE_SIZE - 1) / YEE_SAMPLE_TILE_SIZE, 0);
+	ParallelFor(strataCount, YEE_SAMPLE_TILE_SIZE, boost::bind(&YeeSampleContext::TestTile, &sampleCtx, _1, _2, _3));
+
+	estimate.samples = strataCount;
+	for (unsigned int i = 0; i < sampleCtx.tileFailed.size(); i++)
+		estimate.samplesFailed += sampleCtx.tileFailed[i];
+
+	// 95% Wilson score interval. Stratification can only reduce the
+	// variance of the estimate, so the binomial interval is conservative.
+	const double z = 1.96;
+	const double n = estimate.samples;
+	const double p = estimate.samplesFailed / n;
+	const double scale = 1.0 / (1.0 + z * z / n);
+	const double center = (p + z * z / (2.0 * n)) * scale;
+	const double halfWidth = z * sqrt(p * (1.0 - p) / n + z * z / (4.0 * n * n)) * scale;
+
+	estimate.failedFraction = (float)p;
+	estimate.low = (float)std::max(0.0, center - halfWidth);
+	estimate.high = (float)std::min(1.0, center + halfWidth);
+
+	return estimate;
+}
+
+unsigned int lux::Yee_CompareBanded(
+		const YeeRowReader &readA,
+		const YeeRowReader &readB,
+		std::vector<bool> *diff,
+		float *tviBuffer,
+		const unsigned int width,
+		const unsigned int height,
+		const unsigned int bandHeight,
+		const bool LuminanceOnly,
+		const float FieldOfView,
+		const float Gamma,
+		const float Luminance,
+		const float ColorFactor,
+		const YeeStorage Storage)
+{
+	if ((width == 0) || (height == 0))
+		return 0;
+
+	const unsigned int band = std::max(1u, (bandHeight + YEE_BAND_ALIGNMENT - 1) / YEE_BAND_ALIGNMENT) *
+			YEE_BAND_ALIGNMENT;
+	const unsigned int maxRegionHeight = std::min(height, band + 2 * YEE_BAND_HALO);
+
+	// Everything is allocated once for the largest band
+	AlignedBuffer<float> rgbA, rgbB;
+	rgbA.Resize(3 * width * maxRegionHeight);
+	rgbB.Resize(3 * width * maxRegionHeight);
+	YeeImage imageA(width, maxRegionHeight);
+	YeeImage imageB(width, maxRegionHeight);
+	imageA.SetStorage(Storage);
+	imageB.SetStorage(Storage);
+	std::vector<unsigned int> tileFailed((width * band + YEE_TILE_SIZE - 1) / YEE_TILE_SIZE, 0);
+
+	// The parameters of the metric only depend on the width
+	YeeCsfTables csfTables;
+	YeeCompareContext ctx;
+	InitCompareContext(ctx, imageA, imageB, diff, tviBuffer, csfTables,
+			LuminanceOnly, FieldOfView, ColorFactor);
+	ctx.storage = Storage;
+	ctx.tileFailed = &tileFailed[0];
+
+	bool identical = true;
+	unsigned int pixels_failed = 0;
+	for (unsigned int y0 = 0; y0 < height; y0 += band) {
+		// The band and the rows around it
+		const unsigned int y1 = std::min(height, y0 + band);
+		const unsigned int regionStart = (y0 > YEE_BAND_HALO) ? (y0 - YEE_BAND_HALO) : 0;
+		const unsigned int regionEnd = std::min(height, y1 + YEE_BAND_HALO);
+		const unsigned int regionSize = 3 * width * (regionEnd - regionStart);
+
+		readA(regionStart, regionEnd, rgbA.Get());
+		readB(regionStart, regionEnd, rgbB.Get());
+		if (identical)
+			identical = std::equal(rgbA.Get(), rgbA.Get() + regionSize, rgbB.Get());
+
+		imageA.Resize(width, regionEnd - regionStart);
+		imageB.Resize(width, regionEnd - regionStart);
+		imageA.Build(rgbA.Get(), Gamma, Luminance);
+		imageB.Build(rgbB.Get(), Gamma, Luminance);
+
+		ctx.height = imageA.GetHeight();
+		ctx.firstPixel = (y0 - regionStart) * width;
+		ctx.outputOffset = regionStart * width;
+
+		const unsigned int count = (y1 - y0) * width;
+		ParallelFor(count, YEE_TILE_SIZE, boost::bind(&YeeCompareContext::TestTile, &ctx, _1, _2, _3));
+
+		const unsigned int tileCount = (count + YEE_TILE_SIZE - 1) / YEE_TILE_SIZE;
+		for (unsigned int i = 0; i < tileCount; i++)
+			pixels_failed += tileFailed[i];
+	}
+
+	if (identical) {
+		// Images are binary identical
+		return true;
+	}
+
 	return pixels_failed;
 }
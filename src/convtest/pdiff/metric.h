@@ -21,10 +21,155 @@ if not, write to the Free Software Foundation, Inc., 59 Temple Place, Suite 330,
 
 #include <vector>
 
+#include <boost/function.hpp>
+
+#include "convtest/alignedbuffer.h"
+#include "convtest/colorspace.h"
+#include "convtest/pdiff/lpyramid.h"
+
 namespace lux {
 
+// Storage of the data read by the comparison, see YeeImage::SetStorage()
+enum YeeStorage {
+	YEE_STORAGE_FLOAT,
+	YEE_STORAGE_HALF,
+	YEE_STORAGE_BFLOAT16
+};
+
+// The per image data used by the metric: the CIE L*a*b* chroma planes and
+// the luminance pyramid. It depends only on the image (and on the gamma and
+// luminance used to convert it), so it can be built once and compared any
+// number of times, or stored in a cache file.
+class YeeImage {
+public:
+	YeeImage(const unsigned int width = 0, const unsigned int height = 0);
+	~YeeImage();
+
+	void Resize(const unsigned int width, const unsigned int height);
+	// Uses external storage (e.g. a memory mapped cache file) laid out as
+	// the chroma planes (GetChromaSize() floats each) followed by the
+	// pyramid levels
+	void Map(const unsigned int width, const unsigned int height,
+			const float gamma, const float luminance, float *data);
+
+	// Converts the RGB image and builds the pyramid
+	void Build(const float *rgb, const float gamma = 2.2f, const float luminance = 100.f);
+
+	unsigned int GetWidth() const { return width; }
+	unsigned int GetHeight() const { return height; }
+	float GetGamma() const { return gamma; }
+	float GetLuminance() const { return luminance; }
+	// Size of each chroma plane, including the alignment padding
+	size_t GetChromaSize() const { return chromaSize; }
+
+	// With a 16bit storage, Build() and Map() also make a 16bit copy of the
+	// chroma planes and of the pyramid levels, laid out as the Map() data.
+	// The comparison of two images with the same packed storage reads the
+	// copy: half the memory traffic for some precision (half floats keep
+	// 11 bits, bfloat16 only 8 bits).
+	void SetStorage(const YeeStorage s) { storage = s; }
+	YeeStorage GetStorage() const { return storage; }
+	// The storage of the current 16bit copy, YEE_STORAGE_FLOAT if there is none
+	YeeStorage GetPackedStorage() const { return packedStorage; }
+	const unsigned short *GetPackedData() const { return packedBuffer.Get(); }
+	// Number of floats of the storage used by Map()
+	static size_t GetDataSize(const unsigned int width, const unsigned int height);
+
+	// CIE L*a*b* chroma planes
+	float *A, *B;
+	// Luminance pyramid, the base level holds the luminance itself
+	LPyramid pyramid;
+
+private:
+	// Not copyable
+	YeeImage(const YeeImage &);
+	YeeImage &operator=(const YeeImage &);
+
+	static size_t GetChromaSize(const unsigned int width, const unsigned int height);
+	void ConvertTile(const ColorSpaceConverter *converter, const float *rgb,
+			const unsigned int threadIndex, const unsigned int first, const unsigned int last);
+	void Pack();
+
+	unsigned int width, height;
+	float gamma, luminance;
+	size_t chromaSize;
+	AlignedBuffer<float> chromaBuffer;
+
+	YeeStorage storage, packedStorage;
+	AlignedBuffer<unsigned short> packedBuffer;
+};
+
+// The csf() tables of the pyramid levels used by the test. They depend only
+// on the image width and on the field of view, so they can be kept across
+// the comparisons (e.g. in a YeeWorkspace) and are built again only when one
+// of them changes.
+class YeeCsfTables {
+public:
+	YeeCsfTables();
+	~YeeCsfTables();
+
+	// Builds the tables, unless they are already the ones of width and
+	// FieldOfView
+	void Update(const unsigned int width, const float FieldOfView);
+
+	// Defined in metric.cpp
+	class Tables;
+	const Tables *Get() const { return tables; }
+
+private:
+	// Not copyable
+	YeeCsfTables(const YeeCsfTables &);
+	YeeCsfTables &operator=(const YeeCsfTables &);
+
+	unsigned int width;
+	float fieldOfView;
+	Tables *tables;
+};
+
+// All the memory used by Yee_Compare(). It is sized once for a given image
+// size and can then be reused by any number of comparisons without
+// allocations.
+class YeeWorkspace {
+public:
+	YeeWorkspace(const unsigned int width = 0, const unsigned int height = 0);
+	~YeeWorkspace();
+
+	void Resize(const unsigned int width, const unsigned int height);
+
+	unsigned int width, height;
+
+	YeeImage a, b;
+	// Failed pixel count of each tile
+	std::vector<unsigned int> tileFailed;
+	// Kept across the comparisons of images of the same width
+	YeeCsfTables csfTables;
+
+private:
+	// Not copyable
+	YeeWorkspace(const YeeWorkspace &);
+	YeeWorkspace &operator=(const YeeWorkspace &);
+};
+
+// The parameters of the metric depending only on the image width and on the
+// field of view, see Yee_InitParameters()
+typedef struct {
+	// The pyramid level used for the adaptation luminance
+	unsigned int adaptationLevel;
+	// Cycles per degree of each level
+	float cpd[MAX_PYR_LEVELS];
+	// Frequency weight of each level used by the test
+	float F_freq[MAX_PYR_LEVELS - 2];
+} YeeParameters;
+
+extern void Yee_InitParameters(const unsigned int width, const float FieldOfView,
+		YeeParameters &params);
+
 // Image comparison metric using Yee's method
 // References: A Perceptual Metric for Production Testing, Hector Yee, Journal of Graphics Tools 2004
+//
+// If workspace is NULL, a temporary one is allocated for the comparison. If
+// DownSample is not 0, the comparison is done coarse to fine with blocks of
+// 2^DownSample x 2^DownSample pixels, see Yee_CompareCoarseToFine().
 extern unsigned int Yee_Compare(
 		const float *rgbA,
 		const float *rgbB,
@@ -32,6 +177,7 @@ extern unsigned int Yee_Compare(
 		float *tviBuffer,
 		const unsigned int width,
 		const unsigned int height,
+		YeeWorkspace *workspace,
 		const bool LuminanceOnly = false,
 		const float FieldOfView = 45.f,
 		const float Gamma = 2.2f,
@@ -39,6 +185,140 @@ extern unsigned int Yee_Compare(
 		const float ColorFactor = 1.f,
 		const unsigned int DownSample = 0);
 
+// The same metric on images already built, the gamma and luminance are the
+// ones used to build them. The workspace is optional, it only provides the
+// per tile counters and the csf() tables.
+//
+// The comparisons of images already built below also take optional csf()
+// tables, they are built for the comparison when csfTables is NULL.
+extern unsigned int Yee_Compare(
+		const YeeImage &imageA,
+		const YeeImage &imageB,
+		std::vector<bool> *diff,
+		float *tviBuffer,
+		YeeWorkspace *workspace,
+		const bool LuminanceOnly = false,
+		const float FieldOfView = 45.f,
+		const float ColorFactor = 1.f);
+
+// The same metric done coarse to fine: a first pass looks at blocks of
+// 2^BlockLevel x 2^BlockLevel pixels (up to 256 x 256) and only the pixels
+// of the blocks it can not prove to pass are tested one by one.
+//
+// A block is skipped only if its largest luminance difference is below 99%
+// of the lowest tvi() of the adaptation luminances of its pixels (tvi() is
+// not monotone, it drops at two of its breakpoints) and its largest color
+// difference passes with no masking. Both are sufficient
+// conditions for all its pixels to pass, so the failed pixel count and the
+// diff output are the same of Yee_Compare(): the result differs from the full
+// resolution comparison by 0 pixels. The gain depends on the images, it is
+// large when most differences are well below threshold (i.e. converged
+// renderings). When tviBuffer is not NULL, all pixels are tested.
+extern unsigned int Yee_CompareCoarseToFine(
+		const YeeImage &imageA,
+		const YeeImage &imageB,
+		std::vector<bool> *diff,
+		float *tviBuffer,
+		const unsigned int BlockLevel = 3,
+		const bool LuminanceOnly = false,
+		const float FieldOfView = 45.f,
+		const float ColorFactor = 1.f,
+		YeeCsfTables *csfTables = NULL);
+
+typedef struct {
+	// Failed pixels against each reference
+	std::vector<unsigned int> pixelsFailed;
+	// The reference with the fewest failed pixels, the first one on a tie
+	unsigned int bestReference;
+} YeeMultiResult;
+
+// The same metric of a test image against several references (e.g. the ones
+// of the different engines or film sizes of a scene) in a single pass: the
+// values of the test image are read once per pixel and, as in
+// Yee_CompareCoarseToFine(), only the pixels of the blocks not known to pass
+// are tested against each reference. The counts are the same of a
+// Yee_Compare() against each reference (checked by the yee_compare_multi row
+// of the convtest benchmark). All the images are built with the
+// same gamma and luminance, a reference of a different size fails all the
+// pixels.
+extern YeeMultiResult Yee_CompareMulti(
+		const std::vector<const YeeImage *> &references,
+		const YeeImage &test,
+		const bool LuminanceOnly = false,
+		const float FieldOfView = 45.f,
+		const float ColorFactor = 1.f,
+		YeeCsfTables *csfTables = NULL);
+
+typedef struct {
+	// Failed pixels among the tested ones
+	unsigned int pixelsFailed;
+	unsigned int pixelsTested;
+	// True if at least failedThreshold pixels fail, it is exact even if not
+	// all pixels have been tested
+	bool failed;
+} YeeBoundedResult;
+
+// The same metric when only the comparison against a threshold is needed:
+// it stops as soon as failedThreshold pixels have failed or the remaining
+// pixels can not reach it anymore. The failed pixel count is exact only if
+// pixelsTested is the number of pixels of the image.
+extern YeeBoundedResult Yee_CompareBounded(
+		const YeeImage &imageA,
+		const YeeImage &imageB,
+		const unsigned int failedThreshold,
+		const bool LuminanceOnly = false,
+		const float FieldOfView = 45.f,
+		const float ColorFactor = 1.f,
+		YeeCsfTables *csfTables = NULL);
+
+typedef struct {
+	unsigned int samples, samplesFailed;
+	// Estimated fraction of failed pixels and its 95% confidence interval
+	float failedFraction, low, high;
+} YeeEstimate;
+
+// Estimates the fraction of failed pixels by testing one pixel in each cell
+// of a grid of about sampleCount strata. The samples are always the same for
+// a given image size, so the estimate is repeatable.
+extern YeeEstimate Yee_CompareEstimate(
+		const YeeImage &imageA,
+		const YeeImage &imageB,
+		const unsigned int sampleCount,
+		const bool LuminanceOnly = false,
+		const float FieldOfView = 45.f,
+		const float ColorFactor = 1.f,
+		YeeCsfTables *csfTables = NULL);
+
+// Writes the RGB of rows [firstRow, lastRow) of an image in rgb
+typedef boost::function<void (const unsigned int firstRow,
+		const unsigned int lastRow, float *rgb)> YeeRowReader;
+
+// The same metric on images read one horizontal band at a time, so the
+// memory used depends on width x bandHeight instead of the image size. Each
+// band is read and built with a halo of 256 rows above and below it, the
+// result is the same of the whole image comparison. bandHeight is rounded
+// up to a multiple of 128 rows, larger bands read fewer halo rows.
+extern unsigned int Yee_CompareBanded(
+		const YeeRowReader &readA,
+		const YeeRowReader &readB,
+		std::vector<bool> *diff,
+		float *tviBuffer,
+		const unsigned int width,
+		const unsigned int height,
+		const unsigned int bandHeight = 1024,
+		const bool LuminanceOnly = false,
+		const float FieldOfView = 45.f,
+		const float Gamma = 2.2f,
+		const float Luminance = 100.f,
+		const float ColorFactor = 1.f,
+		const YeeStorage Storage = YEE_STORAGE_FLOAT);
+
+// The comparisons use the lookup tables of tvi(), csf() and mask() by
+// default. They can be turned off to check the tables against the analytic
+// functions; the setting is read when a comparison starts.
+extern void Yee_SetFunctionTables(const bool enabled);
+extern bool Yee_GetFunctionTables();
+
 }
 
 #endif
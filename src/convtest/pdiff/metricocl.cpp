@@ -0,0 +1,548 @@
+ /***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: http://www.luxrender.net                             *
+ ***************************************************************************/
+
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+#include <boost/algorithm/string/trim.hpp>
+
+#include "convtest/pdiff/metricocl.h"
+
+using namespace std;
+using namespace lux;
+
+//------------------------------------------------------------------------------
+// Kernels
+//------------------------------------------------------------------------------
+
+static const char *KernelSource =
+"#pragma OPENCL FP_CONTRACT OFF\n"
+"\n"
+"#define MAX_PYR_LEVELS 8\n"
+"\n"
+"//------------------------------------------------------------------------------\n"
+"// Color space conversion, as ColorSpaceConverter::RGBToLumAB()\n"
+"//------------------------------------------------------------------------------\n"
+"\n"
+"void AdobeRGBToXYZ(const float r, const float g, const float b, float *x, float *y, float *z) {\n"
+"	*x = r * 0.576700f + g * 0.185556f + b * 0.188212f;\n"
+"	*y = r * 0.297361f + g * 0.627355f + b * 0.0752847f;\n"
+"	*z = r * 0.0270328f + g * 0.0706879f + b * 0.991248f;\n"
+"}\n"
+"\n"
+"float Linearize(const float v, const float gamma) {\n"
+"	return (v > 0.f) ? pow(v, gamma) : 0.f;\n"
+"}\n"
+"\n"
+"float LabF(const float r) {\n"
+"	const float epsilon  = 216.0f / 24389.0f;\n"
+"	const float kappa = 24389.0f / 27.0f;\n"
+"	return (r > epsilon) ? cbrt(r) : ((kappa * r + 16.0f) / 116.0f);\n"
+"}\n"
+"\n"
+"// The image data is laid out as YeeImage::Map(): the a* and b* planes\n"
+"// followed by the pyramid levels\n"
+"__kernel void YeeConvert(const uint pixelCount, __global const float *rgb,\n"
+"		const float gamma, const float luminance,\n"
+"		const uint chromaSize, __global float *image) {\n"
+"	const uint i = get_global_id(0);\n"
+"	if (i >= pixelCount)\n"
+"		return;\n"
+"\n"
+"	float x, y, z;\n"
+"	AdobeRGBToXYZ(Linearize(rgb[3 * i], gamma), Linearize(rgb[3 * i + 1], gamma),\n"
+"			Linearize(rgb[3 * i + 2], gamma), &x, &y, &z);\n"
+"\n"
+"	float xw, yw, zw;\n"
+"	AdobeRGBToXYZ(1.f, 1.f, 1.f, &xw, &yw, &zw);\n"
+"\n"
+"	const float f0 = LabF(x / xw);\n"
+"	const float f1 = LabF(y / yw);\n"
+"	const float f2 = LabF(z / zw);\n"
+"\n"
+"	image[i] = 500.0f * (f0 - f1);\n"
+"	image[chromaSize + i] = 200.0f * (f1 - f2);\n"
+"	image[2 * chromaSize + i] = y * luminance;\n"
+"}\n"
+"\n"
+"//------------------------------------------------------------------------------\n"
+"// Pyramid level, as LPyramid::Convolve(): the vertical pass followed by the\n"
+"// horizontal one, with the same order of the additions\n"
+"//------------------------------------------------------------------------------\n"
+"\n"
+"int Mirror(int i, const int n) {\n"
+"	if (i < 0) i = -i;\n"
+"	if (i >= n) i = 2 * n - i - 1;\n"
+"	if (i < 0) i = 0;\n"
+"	if (i >= n) i = n - 1;\n"
+"	return i;\n"
+"}\n"
+"\n"
+"float VerticalPass(__global const float *src, const int srcWidth,\n"
+"		const int r0, const int r1, const int r2, const int r3, const int r4, const int x) {\n"
+"	return 0.05f * src[r0 * srcWidth + x] +\n"
+"			0.25f * src[r1 * srcWidth + x] +\n"
+"			0.4f * src[r2 * srcWidth + x] +\n"
+"			0.25f * src[r3 * srcWidth + x] +\n"
+"			0.05f * src[r4 * srcWidth + x];\n"
+"}\n"
+"\n"
+"__kernel void YeeDownsample(const int srcWidth, const int srcHeight, const uint srcOffset,\n"
+"		const int dstWidth, const int dstHeight, const uint dstOffset,\n"
+"		__global float *image) {\n"
+"	const int index = get_global_id(0);\n"
+"	if (index >= dstWidth * dstHeight)\n"
+"		return;\n"
+"\n"
+"	__global const float *src = &image[srcOffset];\n"
+"	const int x = 2 * (index % dstWidth);\n"
+"	const int y = 2 * (index / dstWidth);\n"
+"\n"
+"	const int r0 = Mirror(y - 2, srcHeight);\n"
+"	const int r1 = Mirror(y - 1, srcHeight);\n"
+"	const int r3 = Mirror(y + 1, srcHeight);\n"
+"	const int r4 = Mirror(y + 2, srcHeight);\n"
+"\n"
+"	image[dstOffset + index] =\n"
+"			0.05f * VerticalPass(src, srcWidth, r0, r1, y, r3, r4, Mirror(x - 2, srcWidth)) +\n"
+"			0.25f * VerticalPass(src, srcWidth, r0, r1, y, r3, r4, Mirror(x - 1, srcWidth)) +\n"
+"			0.4f * VerticalPass(src, srcWidth, r0, r1, y, r3, r4, x) +\n"
+"			0.25f * VerticalPass(src, srcWidth, r0, r1, y, r3, r4, Mirror(x + 1, srcWidth)) +\n"
+"			0.05f * VerticalPass(src, srcWidth, r0, r1, y, r3, r4, Mirror(x + 2, srcWidth));\n"
+"}\n"
+"\n"
+"//------------------------------------------------------------------------------\n"
+"// Per pixel test, as Yee_Compare() with the exact tvi(), csf() and mask()\n"
+"//------------------------------------------------------------------------------\n"
+"\n"
+"float tvi(const float adaptation_luminance) {\n"
+"	const float log_a = log10(adaptation_luminance);\n"
+"\n"
+"	float r;\n"
+"	if (log_a < -3.94f)\n"
+"		r = -2.86f;\n"
+"	else if (log_a < -1.44f)\n"
+"		r = pow(0.405f * log_a + 1.6f , 2.18f) - 2.86f;\n"
+"	else if (log_a < -0.0184f)\n"
+"		r = log_a - 0.395f;\n"
+"	else if (log_a < 1.9f)\n"
+"		r = pow(0.249f * log_a + 0.65f, 2.7f) - 0.72f;\n"
+"	else\n"
+"		r = log_a - 1.255f;\n"
+"\n"
+"	return pow(10.0f, r);\n"
+"}\n"
+"\n"
+"float csf(const float cpd, const float lum) {\n"
+"	const float a = 440.0f * pow((1.0f + 0.7f / lum), -0.2f);\n"
+"	const float b = 0.3f * pow((1.0f + 100.0f / lum), 0.15f);\n"
+"\n"
+"	return a * cpd * exp(-b * cpd) * sqrt(1.0f + 0.06f * exp(b * cpd));\n"
+"}\n"
+"\n"
+"float mask(const float contrast) {\n"
+"	const float a = pow(392.498f * contrast,  0.7f);\n"
+"	const float b = pow(0.0153f * a, 4.0f);\n"
+"\n"
+"	return pow(1.0f + b, 0.25f);\n"
+"}\n"
+"\n"
+"// levelInfo holds the offset, the width and the height of each level\n"
+"float LevelLookup(__global const float *image, __global const uint *levelInfo,\n"
+"		const int x, const int y, const int level) {\n"
+"	__global const float *data = &image[levelInfo[3 * level]];\n"
+"	const int w = levelInfo[3 * level + 1];\n"
+"	const int h = levelInfo[3 * level + 2];\n"
+"\n"
+"	if (level == 0)\n"
+"		return data[x + y * w];\n"
+"\n"
+"	const int scale = 1 << level;\n"
+"	const float invScale = 1.f / scale;\n"
+"\n"
+"	const int x0 = x >> level;\n"
+"	const int y0 = y >> level;\n"
+"	const int x1 = (x0 + 1 < w) ? (x0 + 1) : x0;\n"
+"	const int y1 = (y0 + 1 < h) ? (y0 + 1) : y0;\n"
+"	const float fx = (x & (scale - 1)) * invScale;\n"
+"	const float fy = (y & (scale - 1)) * invScale;\n"
+"\n"
+"	const float v00 = data[y0 * w + x0];\n"
+"	const float v01 = data[y0 * w + x1];\n"
+"	const float v10 = data[y1 * w + x0];\n"
+"	const float v11 = data[y1 * w + x1];\n"
+"	const float v0 = v00 + fx * (v01 - v00);\n"
+"	const float v1 = v10 + fx * (v11 - v10);\n"
+"\n"
+"	return v0 + fy * (v1 - v0);\n"
+"}\n"
+"\n"
+"// params holds the cpd and F_freq of the levels used by the test. The\n"
+"// pixels in [firstPixel, lastPixel) are tested.\n"
+"__kernel void YeeTest(const int width, const int firstPixel, const int lastPixel,\n"
+"		const uint chromaSize,\n"
+"		__global const float *imageA, __global const float *imageB,\n"
+"		__global const uint *levelInfo, __global const float *params,\n"
+"		const int adaptationLevel, const int luminanceOnly, const float colorFactor,\n"
+"		__global uint *pixelsFailed) {\n"
+"	const int index = firstPixel + get_global_id(0);\n"
+"	if (index >= lastPixel)\n"
+"		return;\n"
+"\n"
+"	const int x = index % width;\n"
+"	const int y = index / width;\n"
+"\n"
+"	float contrast[MAX_PYR_LEVELS - 2];\n"
+"	float sum_contrast = 0.f;\n"
+"	for (int i = 0; i < MAX_PYR_LEVELS - 2; i++) {\n"
+"		const float n1 = fabs(LevelLookup(imageA, levelInfo, x, y, i) - LevelLookup(imageA, levelInfo, x, y, i + 1));\n"
+"		const float n2 = fabs(LevelLookup(imageB, levelInfo, x, y, i) - LevelLookup(imageB, levelInfo, x, y, i + 1));\n"
+"		const float numerator = (n1 > n2) ? n1 : n2;\n"
+"		const float d1 = fabs(LevelLookup(imageA, levelInfo, x, y, i + 2));\n"
+"		const float d2 = fabs(LevelLookup(imageB, levelInfo, x, y, i + 2));\n"
+"		float denominator = (d1 > d2) ? d1 : d2;\n"
+"		if (denominator < 1e-5f) denominator = 1e-5f;\n"
+"		contrast[i] = numerator / denominator;\n"
+"		sum_contrast += contrast[i];\n"
+"	}\n"
+"	if (sum_contrast < 1e-5f) sum_contrast = 1e-5f;\n"
+"\n"
+"	float adapt = LevelLookup(imageA, levelInfo, x, y, adaptationLevel) +\n"
+"			LevelLookup(imageB, levelInfo, x, y, adaptationLevel);\n"
+"	adapt *= 0.5f;\n"
+"	if (adapt < 1e-5f) adapt = 1e-5f;\n"
+"\n"
+"	float factor = 0.f;\n"
+"	for (int i = 0; i < MAX_PYR_LEVELS - 2; i++) {\n"
+"		const float F_mask = mask(contrast[i] * csf(params[i], adapt));\n"
+"		factor += contrast[i] * params[MAX_PYR_LEVELS - 2 + i] * F_mask / sum_contrast;\n"
+"	}\n"
+"	if (factor < 1.f) factor = 1.f;\n"
+"	if (factor > 10.f) factor = 10.f;\n"
+"\n"
+"	const float delta = fabs(LevelLookup(imageA, levelInfo, x, y, 0) - LevelLookup(imageB, levelInfo, x, y, 0));\n"
+"	bool pass = true;\n"
+"	if (delta > factor * tvi(adapt))\n"
+"		pass = false;\n"
+"	else if (!luminanceOnly) {\n"
+"		// Don't do the color test in scotopic regions\n"
+"		const float color_scale = (adapt < 10.0f) ? 0.f : colorFactor;\n"
+"		float da = imageA[index] - imageB[index];\n"
+"		float db = imageA[chromaSize + index] - imageB[chromaSize + index];\n"
+"		da = da * da;\n"
+"		db = db * db;\n"
+"		const float delta_e = (da + db) * color_scale;\n"
+"		if (delta_e > factor)\n"
+"			pass = false;\n"
+"	}\n"
+"\n"
+"	if (!pass)\n"
+"		atomic_inc(pixelsFailed);\n"
+"}\n";
+
+// Work group size of all the kernels, reduced if a device doesn't support it
+#define OCL_WORK_GROUP_SIZE 64
+// The bounded test runs in this many launches, the failed pixel count is
+// read back after each of them
+#define OCL_BOUNDED_STEPS 16
+
+//------------------------------------------------------------------------------
+// OCLYeeCompare
+//------------------------------------------------------------------------------
+
+OCLYeeCompare::OCLYeeCompare(const cl::Device &dev) : device(dev),
+	width(0), height(0), chromaSize(0), dataSize(0) {
+	vector<cl::Device> devices(1, device);
+	context = cl::Context(devices);
+	queue = cl::CommandQueue(context, device);
+
+	cl::Program::Sources sources(1, make_pair(KernelSource, strlen(KernelSource)));
+	program = cl::Program(context, sources);
+	try {
+		program.build(devices);
+	} catch (cl::Error &err) {
+		const string log = program.getBuildInfo<CL_PROGRAM_BUILD_LOG>(device);
+		throw runtime_error("Unable to compile the pdiff OpenCL kernels: " + log);
+	}
+
+	convertKernel = cl::Kernel(program, "YeeConvert");
+	downsampleKernel = cl::Kernel(program, "YeeDownsample");
+	testKernel = cl::Kernel(program, "YeeTest");
+
+	levelInfoBuffer = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(levelInfo));
+	paramsBuffer = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(float) * 2 * (MAX_PYR_LEVELS - 2));
+	pixelsFailedBuffer = cl::Buffer(context, CL_MEM_READ_WRITE, sizeof(cl_uint));
+}
+
+OCLYeeCompare::~OCLYeeCompare() {
+}
+
+void OCLYeeCompare::Resize(const unsigned int w, const unsigned int h) {
+	if ((w == width) && (h == height))
+		return;
+	if ((w == 0) || (h == 0))
+		throw runtime_error("Empty image in OCLYeeCompare::Resize()");
+
+	width = w;
+	height = h;
+
+	const size_t levelsSize = LPyramid::GetLevelsSize(width, height);
+	dataSize = YeeImage::GetDataSize(width, height);
+	chromaSize = (dataSize - levelsSize) / 2;
+
+	int levelWidth[MAX_PYR_LEVELS], levelHeight[MAX_PYR_LEVELS];
+	size_t offsets[MAX_PYR_LEVELS];
+	LPyramid::Layout(width, height, levelWidth, levelHeight, offsets);
+	for (unsigned int i = 0; i < MAX_PYR_LEVELS; ++i) {
+		levelInfo[3 * i] = (cl_uint)(2 * chromaSize + offsets[i]);
+		levelInfo[3 * i + 1] = levelWidth[i];
+		levelInfo[3 * i + 2] = levelHeight[i];
+	}
+	queue.enqueueWriteBuffer(levelInfoBuffer, CL_TRUE, 0, sizeof(levelInfo), levelInfo);
+
+	rgbBuffer = cl::Buffer(context, CL_MEM_READ_ONLY, sizeof(float) * 3 * width * height);
+	imageBuffers[0] = cl::Buffer(context, CL_MEM_READ_WRITE, sizeof(float) * dataSize);
+	imageBuffers[1] = cl::Buffer(context, CL_MEM_READ_WRITE, sizeof(float) * dataSize);
+}
+
+void OCLYeeCompare::Run(cl::Kernel &kernel, const size_t workItems) {
+	const size_t workGroupSize = min((size_t)OCL_WORK_GROUP_SIZE,
+			kernel.getWorkGroupInfo<CL_KERNEL_WORK_GROUP_SIZE>(device));
+	const size_t globalSize = ((workItems + workGroupSize - 1) / workGroupSize) * workGroupSize;
+
+	queue.enqueueNDRangeKernel(kernel, cl::NullRange, cl::NDRange(globalSize),
+			cl::NDRange(workGroupSize));
+}
+
+void OCLYeeCompare::Build(const unsigned int index, const float *rgb,
+		const float gamma, const float luminance) {
+	const unsigned int pixelCount = width * height;
+	queue.enqueueWriteBuffer(rgbBuffer, CL_TRUE, 0, sizeof(float) * 3 * pixelCount, rgb);
+
+	convertKernel.setArg(0, (cl_uint)pixelCount);
+	convertKernel.setArg(1, rgbBuffer);
+	convertKernel.setArg(2, gamma);
+	convertKernel.setArg(3, luminance);
+	convertKernel.setArg(4, (cl_uint)chromaSize);
+	convertKernel.setArg(5, imageBuffers[index]);
+	Run(convertKernel, pixelCount);
+
+	// Each level is built from the previous one, the in order queue takes
+	// care of the dependencies
+	for (unsigned int i = 1; i < MAX_PYR_LEVELS; ++i) {
+		downsampleKernel.setArg(0, (cl_int)levelInfo[3 * (i - 1) + 1]);
+		downsampleKernel.setArg(1, (cl_int)levelInfo[3 * (i - 1) + 2]);
+		downsampleKernel.setArg(2, levelInfo[3 * (i - 1)]);
+		downsampleKernel.setArg(3, (cl_int)levelInfo[3 * i + 1]);
+		downsampleKernel.setArg(4, (cl_int)levelInfo[3 * i + 2]);
+		downsampleKernel.setArg(5, levelInfo[3 * i]);
+		downsampleKernel.setArg(6, imageBuffers[index]);
+		Run(downsampleKernel, levelInfo[3 * i + 1] * levelInfo[3 * i + 2]);
+	}
+}
+
+void OCLYeeCompare::Write(const unsigned int index, const float *data) {
+	queue.enqueueWriteBuffer(imageBuffers[index], CL_TRUE, 0, sizeof(float) * dataSize, data);
+}
+
+void OCLYeeCompare::Read(const unsigned int index, float *data) {
+	queue.enqueueReadBuffer(imageBuffers[index], CL_TRUE, 0, sizeof(float) * dataSize, data);
+}
+
+void OCLYeeCompare::InitTest(const bool luminanceOnly, const float fieldOfView,
+		const float colorFactor) {
+	YeeParameters params;
+	Yee_InitParameters(width, fieldOfView, params);
+
+	float levelParams[2 * (MAX_PYR_LEVELS - 2)];
+	copy(params.cpd, params.cpd + MAX_PYR_LEVELS - 2, levelParams);
+	copy(params.F_freq, params.F_freq + MAX_PYR_LEVELS - 2, levelParams + MAX_PYR_LEVELS - 2);
+	queue.enqueueWriteBuffer(paramsBuffer, CL_TRUE, 0, sizeof(levelParams), levelParams);
+
+	cl_uint pixelsFailed = 0;
+	queue.enqueueWriteBuffer(pixelsFailedBuffer, CL_TRUE, 0, sizeof(cl_uint), &pixelsFailed);
+
+	testKernel.setArg(0, (cl_int)width);
+	testKernel.setArg(3, (cl_uint)chromaSize);
+	testKernel.setArg(4, imageBuffers[0]);
+	testKernel.setArg(5, imageBuffers[1]);
+	testKernel.setArg(6, levelInfoBuffer);
+	testKernel.setArg(7, paramsBuffer);
+	testKernel.setArg(8, (cl_int)params.adaptationLevel);
+	testKernel.setArg(9, (cl_int)(luminanceOnly ? 1 : 0));
+	testKernel.setArg(10, colorFactor);
+	testKernel.setArg(11, pixelsFailedBuffer);
+}
+
+unsigned int OCLYeeCompare::RunTest(const unsigned int firstPixel, const unsigned int lastPixel) {
+	testKernel.setArg(1, (cl_int)firstPixel);
+	testKernel.setArg(2, (cl_int)lastPixel);
+	Run(testKernel, lastPixel - firstPixel);
+
+	cl_uint pixelsFailed;
+	queue.enqueueReadBuffer(pixelsFailedBuffer, CL_TRUE, 0, sizeof(cl_uint), &pixelsFailed);
+
+	return pixelsFailed;
+}
+
+unsigned int OCLYeeCompare::Compare(const bool luminanceOnly, const float fieldOfView,
+		const float colorFactor) {
+	InitTest(luminanceOnly, fieldOfView, colorFactor);
+
+	return RunTest(0, width * height);
+}
+
+YeeBoundedResult OCLYeeCompare::CompareBounded(const unsigned int failedThreshold,
+		const bool luminanceOnly, const float fieldOfView, const float colorFactor) {
+	InitTest(luminanceOnly, fieldOfView, colorFactor);
+
+	// As Yee_CompareBounded(), it stops as soon as the result is known
+	const unsigned int pixelCount = width * height;
+	const unsigned int stepSize = (pixelCount + OCL_BOUNDED_STEPS - 1) / OCL_BOUNDED_STEPS;
+	YeeBoundedResult result;
+	result.pixelsFailed = 0;
+	result.pixelsTested = 0;
+	while (result.pixelsTested < pixelCount) {
+		const unsigned int lastPixel = min(pixelCount, result.pixelsTested + stepSize);
+		result.pixelsFailed = RunTest(result.pixelsTested, lastPixel);
+		result.pixelsTested = lastPixel;
+
+		if ((result.pixelsFailed >= failedThreshold) ||
+				(result.pixelsFailed + (pixelCount - result.pixelsTested) < failedThreshold))
+			break;
+	}
+	result.failed = (result.pixelsFailed >= failedThreshold);
+
+	return result;
+}
+
+// Some OpenCL implementations return the names with trailing blanks or
+// null characters
+static string CleanName(const string &name) {
+	return boost::algorithm::trim_copy(string(name.c_str()));
+}
+
+bool OCLYeeCompare::FindDevice(const string &platformName, const string &deviceName,
+		cl::Device &device) {
+	vector<cl::Platform> platforms;
+	cl::Platform::get(&platforms);
+
+	for (unsigned int i = 0; i < platforms.size(); ++i) {
+		if (CleanName(platforms[i].getInfo<CL_PLATFORM_NAME>()) != CleanName(platformName))
+			continue;
+
+		vector<cl::Device> devices;
+		platforms[i].getDevices(CL_DEVICE_TYPE_ALL, &devices);
+		for (unsigned int j = 0; j < devices.size(); ++j) {
+			if (CleanName(devices[j].getInfo<CL_DEVICE_NAME>()) == CleanName(deviceName)) {
+				device = devices[j];
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+//------------------------------------------------------------------------------
+// OCLPdiffImageMetric
+//------------------------------------------------------------------------------
+
+OCLPdiffImageMetric::OCLPdiffImageMetric(const float threshold, const cl::Device &device,
+		const bool exact) : ImageMetric(threshold), compare(device), exactCount(exact) {
+}
+
+OCLPdiffImageMetric::~OCLPdiffImageMetric() {
+}
+
+void OCLPdiffImageMetric::SetReference(const unsigned int w, const unsigned int h, const float *rgb) {
+	width = w;
+	height = h;
+
+	compare.Resize(width, height);
+	compare.Build(0, rgb, PDIFF_GAMMA, PDIFF_LUMINANCE);
+}
+
+bool OCLPdiffImageMetric::LoadReference(const unsigned int w, const unsigned int h,
+		const string &fileName, const unsigned long long key) {
+	// The cache file is only needed until it is uploaded to the device
+	YeeImage image;
+	YeeImageCacheFile file;
+	if (!file.Map(fileName, key, w, h, PDIFF_GAMMA, PDIFF_LUMINANCE, image))
+		return false;
+
+	width = w;
+	height = h;
+
+	compare.Resize(width, height);
+	compare.Write(0, image.A);
+
+	return true;
+}
+
+bool OCLPdiffImageMetric::SaveReference(const string &fileName, const unsigned long long key) const {
+	AlignedBuffer<float> data;
+	data.Resize(YeeImage::GetDataSize(width, height));
+	try {
+		compare.Read(0, data.Get());
+	} catch (cl::Error &err) {
+		return false;
+	}
+
+	YeeImage image;
+	image.Map(width, height, PDIFF_GAMMA, PDIFF_LUMINANCE, data.Get());
+
+	return YeeImageCacheFile::Save(fileName, key, image);
+}
+
+ImageMetricResult OCLPdiffImageMetric::Test(const float *rgb) {
+	const unsigned int pixelCount = width * height;
+	compare.Build(1, rgb, PDIFF_GAMMA, PDIFF_LUMINANCE);
+
+	const unsigned int failedThreshold = (unsigned int)ceil(threshold * (double)pixelCount / 100.0);
+	YeeBoundedResult bounded;
+	if (exactCount) {
+		bounded.pixelsFailed = compare.Compare();
+		bounded.pixelsTested = pixelCount;
+		bounded.failed = (bounded.pixelsFailed >= failedThreshold);
+	} else
+		bounded = compare.CompareBounded(failedThreshold);
+
+	ImageMetricResult result;
+	result.value = (pixelCount > 0) ? (100.f * bounded.pixelsFailed / (float)pixelCount) : 0.f;
+	result.passed = !bounded.failed;
+
+	stringstream ss;
+	if (bounded.pixelsTested == pixelCount)
+		ss << bounded.pixelsFailed << " different pixels, " << fixed << setprecision(2) << result.value << "%";
+	else if (result.passed)
+		ss << "less than " << fixed << setprecision(2) << threshold << "% different pixels";
+	else
+		ss << "at least " << bounded.pixelsFailed << " different pixels, " << fixed << setprecision(2) << result.value << "%";
+	result.description = ss.str();
+
+	return result;
+}
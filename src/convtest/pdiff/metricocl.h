@@ -0,0 +1,148 @@
+ /***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: http://www.luxrender.net                             *
+ ***************************************************************************/
+
+#ifndef _PDIFF_METRICOCL_H
+#define _PDIFF_METRICOCL_H
+
+#include <string>
+
+// To avoid reference to OpenCL 1.2 symbols in cl.hpp file
+#define CL_USE_DEPRECATED_OPENCL_1_1_APIS
+#define __CL_ENABLE_EXCEPTIONS
+
+#if defined(__APPLE__)
+#include <OpenCL/cl.hpp>
+#else
+#include <CL/cl.hpp>
+#endif
+
+#include "convtest/imagemetric.h"
+#include "convtest/referencecache.h"
+#include "convtest/pdiff/metric.h"
+
+namespace lux {
+
+//------------------------------------------------------------------------------
+// OCLYeeCompare
+//
+// Yee's metric on an OpenCL device: the color space conversion, the pyramid
+// and the per pixel test run as kernels. The device holds two images, laid
+// out as YeeImage::Map(), and only the failed pixel count is read back.
+//
+// The conversion and the pyramid evaluate the same expressions of the C++
+// code. The test uses tvi(), csf() and mask() directly instead of their
+// lookup tables and the OpenCL pow() is only accurate within a few ulps, so
+// the failed pixel count can differ from Yee_Compare() by a few pixels
+// lying exactly on the threshold (less than 0.01% of the pixels).
+//------------------------------------------------------------------------------
+
+class OCLYeeCompare {
+public:
+	OCLYeeCompare(const cl::Device &device);
+	~OCLYeeCompare();
+
+	void Resize(const unsigned int width, const unsigned int height);
+
+	// Converts the RGB image and builds its pyramid in image 0 or 1
+	void Build(const unsigned int index, const float *rgb, const float gamma, const float luminance);
+	// Copies YeeImage::GetDataSize() floats, laid out as YeeImage::Map(),
+	// from or to image 0 or 1
+	void Write(const unsigned int index, const float *data);
+	void Read(const unsigned int index, float *data);
+
+	// Returns the number of different pixels of image 0 and image 1
+	unsigned int Compare(const bool luminanceOnly = false, const float fieldOfView = 45.f,
+			const float colorFactor = 1.f);
+	// The same test stopping when the result against failedThreshold is
+	// known, as Yee_CompareBounded(). The pixels are tested in a few steps
+	// and the count is read back after each one.
+	YeeBoundedResult CompareBounded(const unsigned int failedThreshold,
+			const bool luminanceOnly = false, const float fieldOfView = 45.f,
+			const float colorFactor = 1.f);
+
+	const cl::Device &GetDevice() const { return device; }
+
+	// Looks for an OpenCL device by its platform and device names, as
+	// reported by LuxCore
+	static bool FindDevice(const std::string &platformName, const std::string &deviceName,
+			cl::Device &device);
+
+private:
+	// Not copyable
+	OCLYeeCompare(const OCLYeeCompare &);
+	OCLYeeCompare &operator=(const OCLYeeCompare &);
+
+	void Run(cl::Kernel &kernel, const size_t workItems);
+	// Sets the arguments of the test and clears the failed pixel count
+	void InitTest(const bool luminanceOnly, const float fieldOfView, const float colorFactor);
+	// Tests the pixels in [firstPixel, lastPixel), returns the failed pixel
+	// count so far
+	unsigned int RunTest(const unsigned int firstPixel, const unsigned int lastPixel);
+
+	cl::Device device;
+	cl::Context context;
+	cl::CommandQueue queue;
+	cl::Program program;
+	cl::Kernel convertKernel, downsampleKernel, testKernel;
+
+	unsigned int width, height;
+	size_t chromaSize, dataSize;
+	// Offset, width and height of each pyramid level in the image data
+	cl_uint levelInfo[3 * MAX_PYR_LEVELS];
+
+	cl::Buffer rgbBuffer, imageBuffers[2];
+	cl::Buffer levelInfoBuffer, paramsBuffer, pixelsFailedBuffer;
+};
+
+//------------------------------------------------------------------------------
+// OCLPdiffImageMetric
+//
+// PdiffImageMetric on an OpenCL device. As PdiffImageMetric, unless
+// exactCount is set the test stops as soon as the verdict is known (see
+// OCLYeeCompare::CompareBounded()). The cache files are shared with
+// PdiffImageMetric.
+//------------------------------------------------------------------------------
+
+class OCLPdiffImageMetric : public ImageMetric {
+public:
+	OCLPdiffImageMetric(const float threshold, const cl::Device &device,
+			const bool exactCount = false);
+	virtual ~OCLPdiffImageMetric();
+
+	virtual ImageMetricType GetType() const { return IMAGE_METRIC_PDIFF; }
+	virtual const char *GetName() const { return Type2String(IMAGE_METRIC_PDIFF); }
+
+	virtual void SetReference(const unsigned int w, const unsigned int h, const float *rgb);
+	virtual bool LoadReference(const unsigned int w, const unsigned int h,
+			const std::string &fileName, const unsigned long long key);
+	virtual bool SaveReference(const std::string &fileName, const unsigned long long key) const;
+	virtual ImageMetricResult Test(const float *rgb);
+
+private:
+	// Mutable because SaveReference() reads the reference back from the
+	// device
+	mutable OCLYeeCompare compare;
+	bool exactCount;
+};
+
+}
+
+#endif
@@ -0,0 +1,176 @@
+ /***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: http://www.luxrender.net                             *
+ ***************************************************************************/
+
+#include <cstring>
+#include <fstream>
+
+#include <boost/static_assert.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/iostreams/device/mapped_file.hpp>
+
+#include "convtest/referencecache.h"
+
+using namespace lux;
+
+// Bump the version every time the YeeImage layout or the way it is built
+// changes, so old cache files are rebuilt
+#define CACHE_FILE_MAGIC "LXMPDIFF"
+#define CACHE_FILE_VERSION 2
+
+namespace {
+
+typedef struct {
+	char magic[8];
+	unsigned int version;
+	unsigned int width, height;
+	float gamma, luminance;
+	unsigned int pad0;
+	unsigned long long key;
+	// Number of floats following the header
+	unsigned long long dataSize;
+	// Keeps the data aligned
+	unsigned char pad1[16];
+} CacheFileHeader;
+
+BOOST_STATIC_ASSERT(sizeof(CacheFileHeader) == LUX_BUFFER_ALIGNMENT);
+
+}
+
+unsigned long long lux::HashImageData(const void *data, const size_t size) {
+	const unsigned char *bytes = static_cast<const unsigned char *>(data);
+
+	unsigned long long hash = 14695981039346656037ull;
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+std::string lux::GetReferenceCacheFileName(const std::string &referenceFileName) {
+	return referenceFileName + ".pdiffcache";
+}
+
+//------------------------------------------------------------------------------
+// YeeImageCacheFile
+//------------------------------------------------------------------------------
+
+YeeImageCacheFile::YeeImageCacheFile() : file(NULL) {
+}
+
+YeeImageCacheFile::~YeeImageCacheFile() {
+	Unmap();
+}
+
+void YeeImageCacheFile::Unmap() {
+	delete file;
+	file = NULL;
+}
+
+bool YeeImageCacheFile::Map(const std::string &fileName, const unsigned long long key,
+		const unsigned int width, const unsigned int height,
+		const float gamma, const float luminance, YeeImage &image) {
+	Unmap();
+
+	if (!boost::filesystem::exists(fileName))
+		return false;
+
+	boost::iostreams::mapped_file *mappedFile = new boost::iostreams::mapped_file();
+	try {
+		boost::iostreams::mapped_file_params params(fileName);
+		params.flags = boost::iostreams::mapped_file::priv;
+		mappedFile->open(params);
+	} catch (std::exception &) {
+		delete mappedFile;
+		return false;
+	}
+
+	bool valid = false;
+	if (mappedFile->size() >= sizeof(CacheFileHeader)) {
+		CacheFileHeader header;
+		memcpy(&header, mappedFile->const_data(), sizeof(CacheFileHeader));
+
+		const unsigned long long dataSize = YeeImage::GetDataSize(width, height);
+
+		valid = (memcmp(header.magic, CACHE_FILE_MAGIC, sizeof(header.magic)) == 0) &&
+				(header.version == CACHE_FILE_VERSION) &&
+				(header.width == width) && (header.height == height) &&
+				(header.gamma == gamma) && (header.luminance == luminance) &&
+				(header.key == key) && (header.dataSize == dataSize) &&
+				(mappedFile->size() == sizeof(CacheFileHeader) + dataSize * sizeof(float));
+	}
+
+	if (!valid) {
+		delete mappedFile;
+		return false;
+	}
+
+	file = mappedFile;
+	image.Map(width, height, gamma, luminance,
+			reinterpret_cast<float *>(file->data() + sizeof(CacheFileHeader)));
+
+	return true;
+}
+
+bool YeeImageCacheFile::Save(const std::string &fileName, const unsigned long long key,
+		const YeeImage &image) {
+	CacheFileHeader header;
+	memset(&header, 0, sizeof(CacheFileHeader));
+	memcpy(header.magic, CACHE_FILE_MAGIC, sizeof(header.magic));
+	header.version = CACHE_FILE_VERSION;
+	header.width = image.GetWidth();
+	header.height = image.GetHeight();
+	header.gamma = image.GetGamma();
+	header.luminance = image.GetLuminance();
+	header.key = key;
+	header.dataSize = YeeImage::GetDataSize(image.GetWidth(), image.GetHeight());
+
+	// Write a temporary file first, so a reader never sees a partial file
+	const std::string tmpFileName = fileName + ".tmp";
+	{
+		std::ofstream out(tmpFileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!out.good())
+			return false;
+
+		out.write(reinterpret_cast<const char *>(&header), sizeof(CacheFileHeader));
+		out.write(reinterpret_cast<const char *>(image.A), image.GetChromaSize() * sizeof(float));
+		out.write(reinterpret_cast<const char *>(image.B), image.GetChromaSize() * sizeof(float));
+		out.write(reinterpret_cast<const char *>(image.pyramid.GetLevels()),
+				image.pyramid.GetLevelsSize() * sizeof(float));
+
+		if (!out.good()) {
+			out.close();
+			boost::system::error_code ec;
+			boost::filesystem::remove(tmpFileName, ec);
+			return false;
+		}
+	}
+
+	boost::system::error_code ec;
+	boost::filesystem::rename(tmpFileName, fileName, ec);
+	if (ec) {
+		boost::filesystem::remove(tmpFileName, ec);
+		return false;
+	}
+
+	return true;
+}
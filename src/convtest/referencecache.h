@@ -0,0 +1,80 @@
+ /***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: http://www.luxrender.net                             *
+ ***************************************************************************/
+
+#ifndef LUX_REFERENCECACHE_H
+#define LUX_REFERENCECACHE_H
+
+#include <string>
+#include <cstddef>
+
+#include "convtest/pdiff/metric.h"
+
+namespace boost {
+namespace iostreams {
+class mapped_file;
+}
+}
+
+namespace lux {
+
+// 64bit FNV-1a hash of a buffer, used as key of the cache files
+extern unsigned long long HashImageData(const void *data, const size_t size);
+
+// The sidecar cache file of a reference image (e.g. reference.raw.pdiffcache)
+extern std::string GetReferenceCacheFileName(const std::string &referenceFileName);
+
+//------------------------------------------------------------------------------
+// YeeImageCacheFile
+//
+// A file holding a built YeeImage, so the reference side of a comparison is
+// computed only once. The file is memory mapped (copy on write), the key
+// identifies the source image and a stale or corrupted file is just
+// ignored.
+//------------------------------------------------------------------------------
+
+class YeeImageCacheFile {
+public:
+	YeeImageCacheFile();
+	~YeeImageCacheFile();
+
+	// Maps the file and sets the image to use it, returns false (and leaves
+	// the image unchanged) if the file is missing or doesn't match the key,
+	// size and conversion parameters
+	bool Map(const std::string &fileName, const unsigned long long key,
+			const unsigned int width, const unsigned int height,
+			const float gamma, const float luminance, YeeImage &image);
+	void Unmap();
+	bool IsMapped() const { return file != NULL; }
+
+	static bool Save(const std::string &fileName, const unsigned long long key,
+			const YeeImage &image);
+
+private:
+	// Not copyable
+	YeeImageCacheFile(const YeeImageCacheFile &);
+	YeeImageCacheFile &operator=(const YeeImageCacheFile &);
+
+	boost::iostreams::mapped_file *file;
+};
+
+}
+
+#endif
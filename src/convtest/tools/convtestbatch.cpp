@@ -0,0 +1,496 @@
+ /***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: http://www.luxrender.net                             *
+ ***************************************************************************/
+
+// Compares a directory of rendered frames against their references with one
+// of the image metrics, many images at a time.
+//
+// Usage: luxmark_convtest_batch [options] <test directory> <reference directory or file>
+//
+// Each test image is compared with the reference with the same file name,
+// or else with the same name without extension, in the reference directory.
+// If a reference file is given, all the test images are compared with it.
+// Supported formats: binary PPM (8 or 16 bit), PFM and raw 8 bit RGB (as
+// the LuxMark reference.raw, the size must be given with --size).
+//
+// One CSV line is printed for each image, as soon as it is done, and a
+// summary is printed on the standard error. The exit code is 0 only if all
+// the images pass.
+
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/bind.hpp>
+#include <boost/chrono.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/thread.hpp>
+
+#include "convtest/imagemetric.h"
+#include "convtest/parallel.h"
+#include "convtest/referencecache.h"
+
+using namespace std;
+using namespace lux;
+
+typedef unsigned int u_int;
+
+//------------------------------------------------------------------------------
+// Image files
+//------------------------------------------------------------------------------
+
+static void ReadFile(const string &fileName, vector<char> &data) {
+	ifstream file(fileName.c_str(), ios::in | ios::binary);
+	if (!file)
+		throw runtime_error("Unable to open: " + fileName);
+
+	file.seekg(0, ios::end);
+	const streamoff size = file.tellg();
+	file.seekg(0, ios::beg);
+
+	data.resize((size_t)size);
+	if ((size > 0) && !file.read(&data[0], size))
+		throw runtime_error("Unable to read: " + fileName);
+}
+
+// Reads the header fields of a PPM or PFM file, returns the offset of the
+// pixel data
+static size_t ReadHeader(const vector<char> &data, const string &fileName,
+		string &magic, u_int &width, u_int &height, string &scale) {
+	// The pixel data starts after a single white space following the last
+	// field. PPM files can have comments, from a '#' to the end of the line,
+	// before each field.
+	string fields[4];
+	size_t offset = 0;
+	for (u_int i = 0; i < 4; ++i) {
+		for (;;) {
+			while ((offset < data.size()) && isspace((unsigned char)data[offset]))
+				++offset;
+			if ((offset >= data.size()) || (data[offset] != '#'))
+				break;
+			while ((offset < data.size()) && (data[offset] != '\n') && (data[offset] != '\r'))
+				++offset;
+		}
+		while ((offset < data.size()) && !isspace((unsigned char)data[offset]))
+			fields[i] += data[offset++];
+	}
+	if (offset >= data.size())
+		throw runtime_error("Truncated image header: " + fileName);
+
+	magic = fields[0];
+	width = (u_int)atoi(fields[1].c_str());
+	height = (u_int)atoi(fields[2].c_str());
+	scale = fields[3];
+	if ((width == 0) || (height == 0))
+		throw runtime_error("Wrong image size: " + fileName);
+
+	return offset + 1;
+}
+
+static void CheckDataSize(const vector<char> &data, const size_t offset,
+		const size_t size, const string &fileName) {
+	if (data.size() < offset + size)
+		throw runtime_error("Truncated image data: " + fileName);
+}
+
+// Reads an image as RGB floats. width and height must be set for raw files.
+static void ReadImage(const string &fileName, const vector<char> &data,
+		u_int &width, u_int &height, vector<float> &rgb) {
+	const string extension = boost::filesystem::path(fileName).extension().string();
+
+	if ((extension == ".raw") || (extension == ".RAW")) {
+		if ((width == 0) || (height == 0))
+			throw runtime_error("The image size of raw files must be given with --size: " + fileName);
+		if (data.size() != (size_t)width * height * 3)
+			throw runtime_error("Wrong image size: " + fileName);
+
+		rgb.resize((size_t)width * height * 3);
+		for (size_t i = 0; i < rgb.size(); ++i)
+			rgb[i] = (unsigned char)data[i] / 255.f;
+		return;
+	}
+
+	string magic, scale;
+	const size_t offset = ReadHeader(data, fileName, magic, width, height, scale);
+	const size_t pixelCount = (size_t)width * height;
+	rgb.resize(pixelCount * 3);
+
+	if (magic == "P6") {
+		const u_int maxValue = (u_int)atoi(scale.c_str());
+		if ((maxValue == 0) || (maxValue > 65535))
+			throw runtime_error("Wrong PPM maximum value: " + fileName);
+
+		const unsigned char *pixels = reinterpret_cast<const unsigned char *>(&data[offset]);
+		if (maxValue < 256) {
+			CheckDataSize(data, offset, pixelCount * 3, fileName);
+			for (size_t i = 0; i < pixelCount * 3; ++i)
+				rgb[i] = pixels[i] / (float)maxValue;
+		} else {
+			// 16 bit values are big endian
+			CheckDataSize(data, offset, pixelCount * 6, fileName);
+			for (size_t i = 0; i < pixelCount * 3; ++i)
+				rgb[i] = ((pixels[2 * i] << 8) | pixels[2 * i + 1]) / (float)maxValue;
+		}
+	} else if ((magic == "PF") || (magic == "Pf")) {
+		// The sign of the scale gives the endianness, the rows are stored
+		// bottom to top
+		const bool color = (magic == "PF");
+		const bool littleEndian = (atof(scale.c_str()) < 0.0);
+		const u_int channels = color ? 3 : 1;
+		CheckDataSize(data, offset, pixelCount * channels * 4, fileName);
+
+		const unsigned char *pixels = reinterpret_cast<const unsigned char *>(&data[offset]);
+		for (u_int y = 0; y < height; ++y) {
+			for (u_int x = 0; x < width * channels; ++x) {
+				const unsigned char *bytes = &pixels[4 * ((size_t)(height - 1 - y) * width * channels + x)];
+				const unsigned int bits = littleEndian ?
+					(bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((u_int)bytes[3] << 24)) :
+					(bytes[3] | (bytes[2] << 8) | (bytes[1] << 16) | ((u_int)bytes[0] << 24));
+				float value;
+				memcpy(&value, &bits, sizeof(float));
+
+				if (color)
+					rgb[3 * (size_t)y * width + x] = value;
+				else {
+					const size_t index = 3 * ((size_t)y * width + x);
+					rgb[index] = rgb[index + 1] = rgb[index + 2] = value;
+				}
+			}
+		}
+	} else
+		throw runtime_error("Unsupported image format: " + fileName);
+}
+
+static bool IsImageFile(const boost::filesystem::path &path) {
+	const string extension = path.extension().string();
+
+	return (extension == ".ppm") || (extension == ".PPM") ||
+			(extension == ".pfm") || (extension == ".PFM") ||
+			(extension == ".raw") || (extension == ".RAW");
+}
+
+//------------------------------------------------------------------------------
+// Batch comparison
+//------------------------------------------------------------------------------
+
+class BatchJob {
+public:
+	string testFileName, referenceFileName;
+};
+
+class BatchComparison {
+public:
+	BatchComparison(const vector<BatchJob> &j, const ImageMetricType type,
+			const float t, const u_int w, const u_int h, const bool cache) :
+		jobs(j), metricType(type), threshold(t), rawWidth(w), rawHeight(h),
+		useCache(cache), nextJob(0), passed(0), failed(0), errors(0) {
+	}
+
+	void Run(const u_int threadCount) {
+		cout << "test,reference,result,value,load_ms,compare_ms,description" << endl;
+
+		boost::thread_group threads;
+		for (u_int i = 0; i < threadCount; ++i)
+			threads.create_thread(boost::bind(&BatchComparison::Worker, this));
+		threads.join_all();
+	}
+
+	const vector<BatchJob> &jobs;
+	const ImageMetricType metricType;
+	const float threshold;
+	const u_int rawWidth, rawHeight;
+	const bool useCache;
+
+	u_int nextJob;
+	u_int passed, failed, errors;
+	boost::mutex jobsMutex, cacheMutex;
+
+private:
+	ImageMetric *CreateMetric() const {
+		// The batch results are read by people, the exact number of
+		// different pixels is worth the slower comparison
+		if (metricType == IMAGE_METRIC_PDIFF)
+			return new PdiffImageMetric(threshold, true);
+		else
+			return ImageMetric::Create(metricType, threshold);
+	}
+
+	void Compare(ImageMetric *metric, const BatchJob &job,
+			vector<float> &testRGB, vector<float> &referenceRGB,
+			ImageMetricResult &result, double &loadTime, double &compareTime) {
+		typedef boost::chrono::steady_clock Clock;
+		const Clock::time_point start = Clock::now();
+
+		vector<char> data;
+		u_int testWidth = rawWidth, testHeight = rawHeight;
+		ReadFile(job.testFileName, data);
+		ReadImage(job.testFileName, data, testWidth, testHeight, testRGB);
+
+		u_int referenceWidth = rawWidth, referenceHeight = rawHeight;
+		ReadFile(job.referenceFileName, data);
+		ReadImage(job.referenceFileName, data, referenceWidth, referenceHeight, referenceRGB);
+		if ((testWidth != referenceWidth) || (testHeight != referenceHeight))
+			throw runtime_error("The test image and the reference have a different size");
+
+		// The prepared reference is cached only by the metrics supporting it
+		bool loaded = false;
+		if (useCache) {
+			const unsigned long long key = HashImageData(&data[0], data.size());
+			const string cacheFileName = GetReferenceCacheFileName(job.referenceFileName);
+
+			loaded = metric->LoadReference(referenceWidth, referenceHeight, cacheFileName, key);
+			if (!loaded) {
+				metric->SetReference(referenceWidth, referenceHeight, &referenceRGB[0]);
+				loaded = true;
+
+				// Many jobs can share the same reference, only one at a time
+				// writes its cache file
+				boost::unique_lock<boost::mutex> lock(cacheMutex);
+				metric->SaveReference(cacheFileName, key);
+			}
+		}
+		if (!loaded)
+			metric->SetReference(referenceWidth, referenceHeight, &referenceRGB[0]);
+
+		const Clock::time_point loadEnd = Clock::now();
+		result = metric->Test(&testRGB[0]);
+		const Clock::time_point compareEnd = Clock::now();
+
+		loadTime = boost::chrono::duration<double, boost::milli>(loadEnd - start).count();
+		compareTime = boost::chrono::duration<double, boost::milli>(compareEnd - loadEnd).count();
+	}
+
+	void Worker() {
+		ImageMetric *metric = CreateMetric();
+		// Reused by all the jobs of the thread
+		vector<float> testRGB, referenceRGB;
+
+		for (;;) {
+			u_int index;
+			{
+				boost::unique_lock<boost::mutex> lock(jobsMutex);
+				if (nextJob >= jobs.size())
+					break;
+				index = nextJob++;
+			}
+
+			const BatchJob &job = jobs[index];
+			ImageMetricResult result;
+			double loadTime = 0.0, compareTime = 0.0;
+			string status;
+			try {
+				Compare(metric, job, testRGB, referenceRGB, result, loadTime, compareTime);
+				status = result.passed ? "pass" : "fail";
+			} catch (exception &err) {
+				status = "error";
+				result.description = err.what();
+			}
+
+			// Quotes in the description are doubled, as required by CSV
+			string description;
+			for (u_int i = 0; i < result.description.length(); ++i) {
+				if (result.description[i] == '"')
+					description += '"';
+				description += result.description[i];
+			}
+
+			boost::unique_lock<boost::mutex> lock(jobsMutex);
+			if (status == "pass")
+				++passed;
+			else if (status == "fail")
+				++failed;
+			else
+				++errors;
+
+			cout << job.testFileName << "," << job.referenceFileName << "," << status << "," <<
+					result.value << "," << loadTime << "," << compareTime << ",\"" <<
+					description << "\"" << endl;
+		}
+
+		delete metric;
+	}
+};
+
+//------------------------------------------------------------------------------
+// Command line
+//------------------------------------------------------------------------------
+
+// Pairs each test image with its reference
+static void FindJobs(const boost::filesystem::path &testDir,
+		const boost::filesystem::path &referencePath, vector<BatchJob> &jobs) {
+	if (!boost::filesystem::is_directory(testDir))
+		throw runtime_error("Not a directory: " + testDir.string());
+
+	vector<boost::filesystem::path> testFiles;
+	for (boost::filesystem::directory_iterator it(testDir); it != boost::filesystem::directory_iterator(); ++it) {
+		if (boost::filesystem::is_regular_file(it->path()) && IsImageFile(it->path()))
+			testFiles.push_back(it->path());
+	}
+	sort(testFiles.begin(), testFiles.end());
+
+	const bool referenceDir = boost::filesystem::is_directory(referencePath);
+	if (!referenceDir && !boost::filesystem::is_regular_file(referencePath))
+		throw runtime_error("Reference not found: " + referencePath.string());
+
+	// The references by file name and by name without extension
+	map<string, boost::filesystem::path> referencesByName, referencesByStem;
+	if (referenceDir) {
+		for (boost::filesystem::directory_iterator it(referencePath); it != boost::filesystem::directory_iterator(); ++it) {
+			if (boost::filesystem::is_regular_file(it->path()) && IsImageFile(it->path())) {
+				referencesByName[it->path().filename().string()] = it->path();
+				referencesByStem[it->path().stem().string()] = it->path();
+			}
+		}
+	}
+
+	for (u_int i = 0; i < testFiles.size(); ++i) {
+		BatchJob job;
+		job.testFileName = testFiles[i].string();
+
+		if (referenceDir) {
+			map<string, boost::filesystem::path>::const_iterator it =
+					referencesByName.find(testFiles[i].filename().string());
+			if (it != referencesByName.end())
+				job.referenceFileName = it->second.string();
+			else {
+				it = referencesByStem.find(testFiles[i].stem().string());
+				if (it == referencesByStem.end()) {
+					cerr << "WARNING: no reference for " << job.testFileName << endl;
+					continue;
+				}
+				job.referenceFileName = it->second.string();
+			}
+		} else
+			job.referenceFileName = referencePath.string();
+
+		jobs.push_back(job);
+	}
+}
+
+static float GetDefaultThreshold(const ImageMetricType type) {
+	switch (type) {
+		case IMAGE_METRIC_PDIFF:
+			// As the LuxMark image validation
+			return 33.f;
+		case IMAGE_METRIC_MSE:
+			return 1e-3f;
+		case IMAGE_METRIC_PSNR:
+			return 30.f;
+		case IMAGE_METRIC_RELMSE:
+			return 1e-2f;
+		case IMAGE_METRIC_SSIM:
+			return .95f;
+		default:
+			throw runtime_error("Unknown image metric type in GetDefaultThreshold()");
+	}
+}
+
+static void PrintUsage() {
+	cerr << "Usage: luxmark_convtest_batch [options] <test directory> <reference directory or file>" << endl <<
+			"  --metric <name>      pdiff, mse, psnr, relmse or ssim (default: pdiff)" << endl <<
+			"  --threshold <value>  threshold of the metric (default: 33 for pdiff, 1e-3 for mse," << endl <<
+			"                       30 for psnr, 1e-2 for relmse, 0.95 for ssim)" << endl <<
+			"  --size <w>x<h>       size of the raw images" << endl <<
+			"  --jobs <n>           images compared at the same time (default: hardware threads)" << endl <<
+			"  --cache              use and write the reference cache files of pdiff" << endl;
+}
+
+int main(int argc, char *argv[]) {
+	try {
+		ImageMetricType metricType = IMAGE_METRIC_PDIFF;
+		float threshold = -1.f;
+		u_int rawWidth = 0, rawHeight = 0;
+		u_int jobCount = max(1u, boost::thread::hardware_concurrency());
+		bool useCache = false;
+		vector<string> paths;
+
+		for (int i = 1; i < argc; ++i) {
+			const string arg = argv[i];
+			if ((arg == "-h") || (arg == "--help")) {
+				PrintUsage();
+				return EXIT_SUCCESS;
+			} else if (arg == "--cache")
+				useCache = true;
+			else if ((arg.length() > 2) && (arg.compare(0, 2, "--") == 0)) {
+				if (i + 1 >= argc)
+					throw runtime_error("Missing value of option: " + arg);
+				const string value = argv[++i];
+
+				if (arg == "--metric")
+					metricType = ImageMetric::String2Type(value);
+				else if (arg == "--threshold")
+					threshold = (float)atof(value.c_str());
+				else if (arg == "--size") {
+					char separator = 0;
+					stringstream ss(value);
+					if (!(ss >> rawWidth >> separator >> rawHeight) || (separator != 'x'))
+						throw runtime_error("Wrong image size: " + value);
+				} else if (arg == "--jobs") {
+					const int v = atoi(value.c_str());
+					if (v <= 0)
+						throw runtime_error("Wrong job count: " + value);
+					jobCount = (u_int)v;
+				} else
+					throw runtime_error("Unknown option: " + arg);
+			} else
+				paths.push_back(arg);
+		}
+
+		if (paths.size() != 2)
+			throw runtime_error("A test directory and a reference are required");
+		if (threshold < 0.f)
+			threshold = GetDefaultThreshold(metricType);
+
+		vector<BatchJob> jobs;
+		FindJobs(paths[0], paths[1], jobs);
+		jobCount = max(1u, min(jobCount, (u_int)jobs.size()));
+
+		// The images are compared in parallel, the threads left are used
+		// inside each comparison
+		const u_int hardwareThreads = max(1u, boost::thread::hardware_concurrency());
+		SetParallelThreadCount(max(1u, hardwareThreads / jobCount));
+
+		typedef boost::chrono::steady_clock Clock;
+		const Clock::time_point start = Clock::now();
+
+		BatchComparison batch(jobs, metricType, threshold, rawWidth, rawHeight, useCache);
+		batch.Run(jobCount);
+
+		const double seconds = boost::chrono::duration<double>(Clock::now() - start).count();
+		const u_int total = (u_int)jobs.size();
+		cerr << "Images: " << total << ", passed: " << batch.passed << ", failed: " << batch.failed <<
+				" (" << ((total > 0) ? (100.0 * batch.failed / total) : 0.0) << "%), errors: " <<
+				batch.errors << ", time: " << seconds << " secs (" << jobCount << " jobs)" << endl;
+
+		return ((batch.failed == 0) && (batch.errors == 0)) ? EXIT_SUCCESS : EXIT_FAILURE;
+	} catch (exception &err) {
+		cerr << "ERROR: " << err.what() << endl;
+		PrintUsage();
+		return EXIT_FAILURE;
+	}
+}
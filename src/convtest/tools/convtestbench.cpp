@@ -0,0 +1,868 @@
+ /***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: http://www.luxrender.net                             *
+ ***************************************************************************/
+
+// Microbenchmark of the convergence test code, it links only the convtest
+// sources so it can be run (and profiled) without LuxCore, Qt or OpenCL.
+//
+// When built with LUXMARK_CONVTEST_OPENCL, the OpenCL version of the metric
+// is also run on each OpenCL device.
+//
+// Usage: luxmark_convtest_bench [--sizes 720p,1080p,1440p,4k,8k,<w>x<h>]
+//		[--threads 1,2,4,...] [--iterations <n>] [--format csv|json]
+//
+// Each benchmark is run once to warm up and then timed for the given number
+// of iterations, for each image size and thread count. One line is printed
+// for each run, in CSV (with a header line) or JSON lines format, with the
+// minimum and mean time per pixel in nanoseconds and the peak resident
+// memory of the process after the run. The exit status is EXIT_FAILURE if
+// one of the checks of the results (e.g. the accuracy of the fast math
+// functions) has failed.
+
+#include <cstdlib>
+#include <cmath>
+#include <cstring>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/chrono.hpp>
+#include <boost/function.hpp>
+#include <boost/bind.hpp>
+#include <boost/thread.hpp>
+
+#if defined(WIN32)
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "convtest/colorspace.h"
+#include "convtest/convtest.h"
+#include "convtest/imagemetric.h"
+#include "convtest/parallel.h"
+#include "convtest/pdiff/metric.h"
+#if defined(LUXMARK_CONVTEST_OPENCL)
+#include "convtest/pdiff/metricocl.h"
+#endif
+
+using namespace std;
+using namespace lux;
+
+typedef unsigned int u_int;
+
+//------------------------------------------------------------------------------
+// Synthetic images
+//------------------------------------------------------------------------------
+
+static inline u_int HashUInt(u_int v) {
+	v ^= v >> 16;
+	v *= 0x7feb352du;
+	v ^= v >> 15;
+	v *= 0x846ca68bu;
+	v ^= v >> 16;
+
+	return v;
+}
+
+static inline float HashFloat(const u_int v) {
+	return (HashUInt(v) >> 8) * (1.f / 16777216.f);
+}
+
+// A smooth image with some high frequency detail, quantized to 8 bits like
+// the reference images
+static void MakeReferenceImage(const u_int width, const u_int height, vector<float> &rgb) {
+	rgb.resize(width * height * 3);
+	for (u_int y = 0; y < height; ++y) {
+		for (u_int x = 0; x < width; ++x) {
+			const u_int index = x + y * width;
+			const float u = x / (float)width;
+			const float v = y / (float)height;
+
+			for (u_int c = 0; c < 3; ++c) {
+				float value = .5f + .3f * sinf(6.f * (c + 1) * u) * cosf(5.f * v) +
+						.1f * sinf(200.f * u * v) + .05f * (HashFloat(3 * index + c) - .5f);
+				value = max(0.f, min(1.f, value));
+				rgb[3 * index + c] = (u_int)(value * 255.f + .5f) / 255.f;
+			}
+		}
+	}
+}
+
+// The reference with some rendering noise added, it is not quantized like
+// the film output tested by LuxMark
+static void MakeTestImage(const vector<float> &reference, const float noise,
+		vector<float> &rgb) {
+	rgb.resize(reference.size());
+	for (u_int i = 0; i < reference.size(); ++i)
+		rgb[i] = max(0.f, reference[i] + noise * (HashFloat(i ^ 0x9e3779b9u) - .5f));
+}
+
+// A gray ramp and a copy brighter by delta cd/m^2 (with the default gamma
+// and luminance of YeeImage::Build()). The adaptation luminance of the
+// comparison grows along x from 10^(logAdapt - .00043) to 10^(logAdapt +
+// .00057), so logAdapt is inside a block and not on its edge.
+static void MakeAdaptationRamp(const u_int width, const u_int height,
+		const float logAdapt, const float delta, vector<float> &reference, vector<float> &test) {
+	reference.resize(width * height * 3);
+	test.resize(width * height * 3);
+	for (u_int x = 0; x < width; ++x) {
+		const float adapt = powf(10.f, logAdapt - .00043f + .001f * x / (width - 1));
+		const float r = powf((adapt - .5f * delta) / 100.f, 1.f / 2.2f);
+		const float t = powf((adapt + .5f * delta) / 100.f, 1.f / 2.2f);
+		for (u_int y = 0; y < height; ++y) {
+			for (u_int c = 0; c < 3; ++c) {
+				reference[3 * (x + y * width) + c] = r;
+				test[3 * (x + y * width) + c] = t;
+			}
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+// Measurements
+//------------------------------------------------------------------------------
+
+// Peak resident memory of the process in bytes
+static size_t GetPeakMemory() {
+#if defined(WIN32)
+	PROCESS_MEMORY_COUNTERS counters;
+	if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		return counters.PeakWorkingSetSize;
+	return 0;
+#else
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0)
+		return 0;
+#if defined(__APPLE__)
+	return usage.ru_maxrss;
+#else
+	return (size_t)usage.ru_maxrss * 1024;
+#endif
+#endif
+}
+
+typedef boost::function<void ()> BenchFunc;
+
+class BenchResult {
+public:
+	string name;
+	u_int width, height, threads, iterations;
+	double minNsPerPixel, meanNsPerPixel;
+	size_t peakMemory;
+	// A value computed by the benchmark, to check the results across runs
+	string check;
+};
+
+static void Run(const string &name, const u_int width, const u_int height,
+		const u_int iterations, const BenchFunc &func, BenchResult &result) {
+	typedef boost::chrono::steady_clock Clock;
+
+	// Warm up
+	func();
+
+	double minTime = 0.0, totalTime = 0.0;
+	for (u_int i = 0; i < iterations; ++i) {
+		const Clock::time_point start = Clock::now();
+		func();
+		const double t = boost::chrono::duration<double>(Clock::now() - start).count();
+
+		minTime = (i == 0) ? t : min(minTime, t);
+		totalTime += t;
+	}
+
+	const double pixels = (double)width * height;
+	result.name = name;
+	result.width = width;
+	result.height = height;
+	result.threads = GetParallelThreadCount();
+	result.iterations = iterations;
+	result.minNsPerPixel = minTime * 1e9 / pixels;
+	result.meanNsPerPixel = totalTime * 1e9 / (iterations * pixels);
+	result.peakMemory = GetPeakMemory();
+}
+
+enum OutputFormat {
+	FORMAT_CSV,
+	FORMAT_JSON
+};
+
+static void PrintHeader(const OutputFormat format) {
+	if (format == FORMAT_CSV)
+		cout << "benchmark,width,height,threads,iterations,min_ns_per_pixel,mean_ns_per_pixel,peak_memory_mb,check" << endl;
+}
+
+static void Print(const OutputFormat format, const BenchResult &result) {
+	const double peakMemoryMB = result.peakMemory / (1024.0 * 1024.0);
+
+	if (format == FORMAT_CSV) {
+		cout << result.name << "," << result.width << "," << result.height << "," <<
+				result.threads << "," << result.iterations << "," <<
+				result.minNsPerPixel << "," << result.meanNsPerPixel << "," <<
+				peakMemoryMB << "," << result.check << endl;
+	} else {
+		cout << "{\"benchmark\": \"" << result.name << "\", \"width\": " << result.width <<
+				", \"height\": " << result.height << ", \"threads\": " << result.threads <<
+				", \"iterations\": " << result.iterations <<
+				", \"min_ns_per_pixel\": " << result.minNsPerPixel <<
+				", \"mean_ns_per_pixel\": " << result.meanNsPerPixel <<
+				", \"peak_memory_mb\": " << peakMemoryMB <<
+				", \"check\": \"" << result.check << "\"}" << endl;
+	}
+}
+
+//------------------------------------------------------------------------------
+// Benchmarks
+//------------------------------------------------------------------------------
+
+class BenchImages {
+public:
+	BenchImages(const u_int w, const u_int h) : width(w), height(h),
+		referenceImage(w, h), testImage(w, h), convTest(w, h) {
+		MakeReferenceImage(width, height, reference);
+		MakeTestImage(reference, .02f, test);
+
+		lum.resize(width * height);
+		a.resize(width * height);
+		b.resize(width * height);
+	}
+
+	void Convert(const ColorSpaceConverter *converter) {
+		converter->RGBToLumAB(&test[0], width * height, &lum[0], &a[0], &b[0]);
+	}
+
+	void ConvertReference(const ColorSpaceConverter *converter) {
+		converter->RGBToLumABReference(&test[0], width * height, &lum[0], &a[0], &b[0]);
+	}
+
+	void Build() {
+		testImage.Build(&test[0]);
+	}
+
+	void Compare() {
+		pixelsFailed = Yee_Compare(referenceImage, testImage, NULL, NULL, NULL);
+	}
+
+	void CompareAnalytic() {
+		Yee_SetFunctionTables(false);
+		pixelsFailed = Yee_Compare(referenceImage, testImage, NULL, NULL, NULL);
+		Yee_SetFunctionTables(true);
+	}
+
+	void ComparePacked(const YeeImage *a, const YeeImage *b) {
+		pixelsFailed = Yee_Compare(*a, *b, NULL, NULL, NULL);
+	}
+
+	void CompareCoarseToFine() {
+		pixelsFailed = Yee_CompareCoarseToFine(referenceImage, testImage, NULL, NULL);
+	}
+
+	// The images are read 256 rows at a time: 3 to 17 bands for the named
+	// sizes, the last one shorter than the others
+	void CompareBanded() {
+		pixelsFailed = Yee_CompareBanded(
+				boost::bind(&BenchImages::ReadRows, this, &reference, _1, _2, _3),
+				boost::bind(&BenchImages::ReadRows, this, &test, _1, _2, _3),
+				NULL, NULL, width, height, 256);
+	}
+
+	void CompareMulti(const vector<const YeeImage *> *references) {
+		multiResult = Yee_CompareMulti(*references, testImage);
+	}
+
+	void CompareBounded() {
+		// The threshold used by the LuxMark image validation
+		boundedFailed = Yee_CompareBounded(referenceImage, testImage, width * height / 3).failed;
+	}
+
+	void ConvergenceTestRun() {
+		// The first Test() only stores the reference, so each run resets
+		// the test and compares two images like the benchmark refresh does
+		convTest.Reset();
+		convTest.Test(&reference[0]);
+		pixelsFailed = convTest.Test(&test[0]);
+	}
+
+	void MetricTest(ImageMetric *metric) {
+		const ImageMetricResult result = metric->Test(&test[0]);
+		metricPassed = result.passed;
+	}
+
+	// As the LuxMark image validation: the film rows are bottom-up
+	void MetricTestFilm(ImageMetric *metric, const vector<float> *film) {
+		vector<float> rgb(film->size());
+		FilmToImage(width, height, &(*film)[0], &rgb[0]);
+		const ImageMetricResult result = metric->Test(&rgb[0]);
+		metricPassed = result.passed;
+	}
+
+	void ReadRows(const vector<float> *rgb, const u_int firstRow, const u_int lastRow, float *dst) const {
+		copy(&(*rgb)[3 * firstRow * width], &(*rgb)[0] + 3 * lastRow * width, dst);
+	}
+
+	const u_int width, height;
+	vector<float> reference, test;
+	vector<float> lum, a, b;
+	YeeImage referenceImage, testImage;
+	ConvergenceTest convTest;
+
+	u_int pixelsFailed;
+	YeeMultiResult multiResult;
+	bool boundedFailed, metricPassed;
+};
+
+static void FastPowRun(const vector<float> *in, vector<float> *out) {
+	FastPow(&(*in)[0], 2.2f, in->size(), &(*out)[0]);
+}
+
+// The largest difference between the fast and the powf() color space
+// conversion of the test image
+static float ConversionError(BenchImages &images, const ColorSpaceConverter &converter) {
+	const u_int count = images.width * images.height;
+
+	images.ConvertReference(&converter);
+	const vector<float> lum(images.lum), a(images.a), b(images.b);
+	images.Convert(&converter);
+
+	float maxError = 0.f;
+	for (u_int i = 0; i < count; ++i) {
+		maxError = max(maxError, fabsf(images.lum[i] - lum[i]) / max(lum[i], 1e-6f));
+		maxError = max(maxError, fabsf(images.a[i] - a[i]));
+		maxError = max(maxError, fabsf(images.b[i] - b[i]));
+	}
+
+	return maxError;
+}
+
+template <class T> static string ToString(const T &v) {
+	stringstream ss;
+	ss << v;
+	return ss.str();
+}
+
+//------------------------------------------------------------------------------
+// Checks
+//
+// Some benchmarks also check their results against a bound: the check column
+// then ends with "ok" or "FAILED" and the benchmark exits with EXIT_FAILURE if
+// any of them has failed.
+//------------------------------------------------------------------------------
+
+static bool checkFailed = false;
+
+static string CheckResult(const string &values, const bool ok) {
+	if (!ok)
+		checkFailed = true;
+
+	return values + (ok ? ";ok" : ";FAILED");
+}
+
+// Logarithmically spaced values in [low, high]
+static void MakeLogSpaced(const double low, const double high, const u_int count, vector<float> &values) {
+	values.resize(count);
+	for (u_int i = 0; i < count; ++i)
+		values[i] = (float)(low * pow(high / low, i / (count - 1.0)));
+}
+
+static double RelativeError(const float v, const double expected) {
+	return fabs(v - expected) / expected;
+}
+
+// The errors of the fast transcendental functions, scalar and array versions,
+// against the bounds documented in colorspace.h
+static string FastMathCheck() {
+	const u_int count = 1 << 20;
+	vector<float> x, y;
+	bool ok = true;
+	stringstream ss;
+
+	// FastLog2(): absolute error below 2e-6 in [1e-10, 1e10]
+	MakeLogSpaced(1e-10, 1e10, count, x);
+	double maxError = 0.0;
+	for (u_int i = 0; i < count; ++i)
+		maxError = max(maxError, fabs(FastLog2(x[i]) - log2((double)x[i])));
+	ok = ok && (maxError < 2e-6);
+	ss << "log2=" << maxError;
+
+	// FastExp2(): relative error below 1e-7 in [-126, 127]
+	maxError = 0.0;
+	for (u_int i = 0; i < count; ++i) {
+		const float v = (float)(-126.0 + 253.0 * i / (count - 1.0));
+		maxError = max(maxError, RelativeError(FastExp2(v), exp2((double)v)));
+	}
+	ok = ok && (maxError < 1e-7);
+	ss << ";exp2=" << maxError;
+
+	// FastCbrt(): relative error below 1e-6 in [1e-10, 1e10]
+	y.resize(count);
+	FastCbrt(&x[0], count, &y[0]);
+	maxError = 0.0;
+	for (u_int i = 0; i < count; ++i) {
+		const double expected = cbrt((double)x[i]);
+		maxError = max(maxError, RelativeError(FastCbrt(x[i]), expected));
+		maxError = max(maxError, RelativeError(y[i], expected));
+	}
+	ok = ok && (maxError < 1e-6);
+	ss << ";cbrt=" << maxError;
+
+	// FastPow(x, 2.2): relative error below 1e-5 in [1e-10, 1e10] and below
+	// 2e-6 in [1e-4, 3]
+	const double bounds[2][3] = { { 1e-10, 1e10, 1e-5 }, { 1e-4, 3.0, 2e-6 } };
+	for (u_int b = 0; b < 2; ++b) {
+		MakeLogSpaced(bounds[b][0], bounds[b][1], count, x);
+		FastPow(&x[0], 2.2f, count, &y[0]);
+
+		maxError = 0.0;
+		for (u_int i = 0; i < count; ++i) {
+			const double expected = pow((double)x[i], (double)2.2f);
+			maxError = max(maxError, RelativeError(FastPow(x[i], 2.2f), expected));
+			maxError = max(maxError, RelativeError(y[i], expected));
+		}
+		ok = ok && (maxError < bounds[b][2]);
+		ss << ";pow" << b << "=" << maxError;
+	}
+
+	return CheckResult(ss.str(), ok);
+}
+
+// The failed pixel counts of the lookup tables of tvi(), csf() and mask() and
+// of the analytic functions can differ only for the pixels at the threshold:
+// at most 1 in 10000 pixels
+static string FunctionTablesCheck(const u_int width, const u_int height,
+		const u_int tablesFailed, const u_int analyticFailed) {
+	const u_int difference = (tablesFailed > analyticFailed) ?
+		(tablesFailed - analyticFailed) : (analyticFailed - tablesFailed);
+
+	return CheckResult("failed=" + ToString(analyticFailed) +
+			";tables_difference=" + ToString(difference),
+			difference <= (u_int)((double)width * height * 1e-4));
+}
+
+// The failed pixel count with a 16bit storage against the float one: within
+// 0.1% with half floats and 2% with bfloat16, which keeps only 8 bits
+static string StorageCheck(const YeeStorage storage,
+		const u_int floatFailed, const u_int packedFailed) {
+	const u_int difference = (floatFailed > packedFailed) ?
+		(floatFailed - packedFailed) : (packedFailed - floatFailed);
+	const double tolerance = (storage == YEE_STORAGE_HALF) ? 1e-3 : 2e-2;
+
+	return CheckResult("failed=" + ToString(packedFailed) +
+			";float_difference=" + ToString(difference),
+			difference <= (u_int)(floatFailed * tolerance));
+}
+
+// tvi() drops where two of its pieces meet, at log10(adapt) = -1.44 and 1.9.
+// On a ramp of the adaptation luminance across each of them, with a
+// luminance difference between the tvi() before and after the drop, the
+// coarse to fine comparisons at all block sizes must fail the same pixels as
+// Yee_Compare(), and so must Yee_CompareMulti()
+static string TviBreakpointsCheck() {
+	const u_int width = 512, height = 64;
+	const float logAdapts[] = { -1.44f, 1.9f };
+	const float deltas[] = { .01464f, 4.42f };
+
+	stringstream ss;
+	u_int maxDifference = 0;
+	bool allFailing = true;
+	for (u_int i = 0; i < sizeof(logAdapts) / sizeof(logAdapts[0]); ++i) {
+		vector<float> reference, test;
+		MakeAdaptationRamp(width, height, logAdapts[i], deltas[i], reference, test);
+		YeeImage referenceImage(width, height), testImage(width, height);
+		referenceImage.Build(&reference[0]);
+		testImage.Build(&test[0]);
+
+		const u_int failed = Yee_Compare(referenceImage, testImage, NULL, NULL, NULL);
+		allFailing = allFailing && (failed > 0);
+		for (u_int level = 1; level <= 8; ++level) {
+			const u_int coarseFailed = Yee_CompareCoarseToFine(referenceImage, testImage, NULL, NULL, level);
+			maxDifference = max(maxDifference, (coarseFailed > failed) ? (coarseFailed - failed) : (failed - coarseFailed));
+		}
+		const u_int multiFailed = Yee_CompareMulti(vector<const YeeImage *>(1, &referenceImage), testImage).pixelsFailed[0];
+		maxDifference = max(maxDifference, (multiFailed > failed) ? (multiFailed - failed) : (failed - multiFailed));
+
+		ss << (i ? "," : "tvi_ramp_failed=") << failed;
+	}
+	ss << ";tvi_ramp_difference=" << maxDifference;
+
+	return CheckResult(ss.str(), allFailing && (maxDifference == 0));
+}
+
+// Each count of Yee_CompareMulti() must be the one of a Yee_Compare() against
+// the same reference, and the best reference the one with the fewest failed
+// pixels
+static string MultiCheck(const vector<const YeeImage *> &references, const YeeImage &test,
+		const YeeMultiResult &result) {
+	stringstream ss;
+	u_int maxDifference = 0;
+	u_int bestReference = 0;
+	vector<u_int> failed(references.size());
+	for (u_int i = 0; i < references.size(); ++i) {
+		failed[i] = Yee_Compare(*references[i], test, NULL, NULL, NULL);
+		maxDifference = max(maxDifference, (result.pixelsFailed[i] > failed[i]) ?
+			(result.pixelsFailed[i] - failed[i]) : (failed[i] - result.pixelsFailed[i]));
+		if (failed[i] < failed[bestReference])
+			bestReference = i;
+
+		ss << (i ? "," : "failed=") << result.pixelsFailed[i];
+	}
+	ss << ";best=" << result.bestReference << ";single_difference=" << maxDifference;
+
+	return CheckResult(ss.str(), (maxDifference == 0) && (result.bestReference == bestReference));
+}
+
+// The 8 bit values must be linearized exactly as powf() does, checked on
+// pixels with a single non zero channel
+static string GammaLUTCheck(const ColorSpaceConverter &converter) {
+	vector<float> rgb(3 * 3 * 256, 0.f);
+	for (u_int c = 0; c < 3; ++c)
+		for (u_int i = 0; i < 256; ++i)
+			rgb[3 * (c * 256 + i) + c] = i / 255.f;
+
+	const u_int count = 3 * 256;
+	vector<float> lum(count), a(count), b(count), refLum(count);
+	converter.RGBToLumAB(&rgb[0], count, &lum[0], &a[0], &b[0]);
+	converter.RGBToLumABReference(&rgb[0], count, &refLum[0], &a[0], &b[0]);
+
+	u_int mismatches = 0;
+	for (u_int i = 0; i < count; ++i)
+		if (lum[i] != refLum[i])
+			++mismatches;
+
+	return CheckResult("lut_mismatches=" + ToString(mismatches), mismatches == 0);
+}
+
+#if defined(LUXMARK_CONVTEST_OPENCL)
+static void OCLCompareRun(OCLYeeCompare *compare, const vector<float> *test, u_int *pixelsFailed) {
+	compare->Build(1, &(*test)[0], PDIFF_GAMMA, PDIFF_LUMINANCE);
+	*pixelsFailed = compare->Compare();
+}
+
+// The OpenCL version of the metric on each OpenCL device, checked against
+// the CPU failed pixel count: they can differ only for the pixels at the
+// threshold, at most 1 in 10000 pixels (see OCLYeeCompare)
+static void RunOCL(BenchImages &images, const u_int iterations, const u_int cpuFailed,
+		const OutputFormat format) {
+	vector<cl::Platform> platforms;
+	try {
+		cl::Platform::get(&platforms);
+	} catch (cl::Error &err) {
+		cerr << "WARNING: no OpenCL platform: " << err.what() << "(" << err.err() << ")" << endl;
+		return;
+	}
+
+	for (u_int i = 0; i < platforms.size(); ++i) {
+		vector<cl::Device> devices;
+		try {
+			platforms[i].getDevices(CL_DEVICE_TYPE_ALL, &devices);
+		} catch (cl::Error &) {
+			continue;
+		}
+
+		for (u_int j = 0; j < devices.size(); ++j) {
+			// The name goes in a CSV field
+			string deviceName = devices[j].getInfo<CL_DEVICE_NAME>().c_str();
+			replace(deviceName.begin(), deviceName.end(), ',', ' ');
+			replace(deviceName.begin(), deviceName.end(), ';', ' ');
+
+			try {
+				OCLYeeCompare compare(devices[j]);
+				compare.Resize(images.width, images.height);
+				compare.Build(0, &images.reference[0], PDIFF_GAMMA, PDIFF_LUMINANCE);
+
+				u_int oclFailed = 0;
+				BenchResult result;
+				Run("metric_pdiff_ocl", images.width, images.height, iterations,
+						boost::bind(OCLCompareRun, &compare, &images.test, &oclFailed), result);
+
+				const u_int difference = (oclFailed > cpuFailed) ?
+					(oclFailed - cpuFailed) : (cpuFailed - oclFailed);
+				result.check = CheckResult("device=" + deviceName + ";failed=" + ToString(oclFailed) +
+						";cpu_difference=" + ToString(difference),
+						difference <= (u_int)((double)images.width * images.height * 1e-4));
+				Print(format, result);
+			} catch (cl::Error &err) {
+				cerr << "WARNING: unable to run the OpenCL metric on " << deviceName << ": " <<
+						err.what() << "(" << err.err() << ")" << endl;
+			}
+		}
+	}
+}
+#endif
+
+static void RunSize(const u_int width, const u_int height, const vector<u_int> &threadCounts,
+		const u_int iterations, const OutputFormat format) {
+	for (u_int t = 0; t < threadCounts.size(); ++t) {
+		SetParallelThreadCount(threadCounts[t]);
+
+		BenchImages images(width, height);
+		images.referenceImage.Build(&images.reference[0]);
+		const ColorSpaceConverter converter(2.2f, 100.f);
+
+		BenchResult result;
+
+		// The color space conversion is single threaded, it is measured only
+		// once
+		if (t == 0) {
+			Run("convert_fast", width, height, iterations,
+					boost::bind(&BenchImages::Convert, &images, &converter), result);
+			result.check = "max_error=" + ToString(ConversionError(images, converter)) +
+					";" + GammaLUTCheck(converter);
+			Print(format, result);
+
+			vector<float> powOut(images.test.size());
+			Run("fast_pow", width, height, iterations,
+					boost::bind(FastPowRun, &images.test, &powOut), result);
+			result.check = FastMathCheck();
+			Print(format, result);
+
+			Run("convert_powf", width, height, iterations,
+					boost::bind(&BenchImages::ConvertReference, &images, &converter), result);
+			result.check = "";
+			Print(format, result);
+		}
+
+		Run("yee_build", width, height, iterations,
+				boost::bind(&BenchImages::Build, &images), result);
+		Print(format, result);
+
+		Run("yee_compare", width, height, iterations,
+				boost::bind(&BenchImages::Compare, &images), result);
+		result.check = "failed=" + ToString(images.pixelsFailed);
+		Print(format, result);
+		const u_int tablesFailed = images.pixelsFailed;
+
+#if defined(LUXMARK_CONVTEST_OPENCL)
+		// The OpenCL devices don't depend on the thread count
+		if (t == 0)
+			RunOCL(images, iterations, tablesFailed, format);
+#endif
+
+		Run("yee_compare_analytic", width, height, iterations,
+				boost::bind(&BenchImages::CompareAnalytic, &images), result);
+		result.check = FunctionTablesCheck(width, height, tablesFailed, images.pixelsFailed);
+		Print(format, result);
+
+		const YeeStorage storages[] = { YEE_STORAGE_HALF, YEE_STORAGE_BFLOAT16 };
+		const char *storageNames[] = { "half", "bfloat16" };
+		for (u_int i = 0; i < sizeof(storages) / sizeof(storages[0]); ++i) {
+			YeeImage packedReference(width, height), packedTest(width, height);
+			packedReference.SetStorage(storages[i]);
+			packedTest.SetStorage(storages[i]);
+			packedReference.Build(&images.reference[0]);
+			packedTest.Build(&images.test[0]);
+
+			Run(string("yee_compare_") + storageNames[i], width, height, iterations,
+					boost::bind(&BenchImages::ComparePacked, &images, &packedReference, &packedTest), result);
+			result.check = StorageCheck(storages[i], tablesFailed, images.pixelsFailed);
+			Print(format, result);
+		}
+
+		Run("yee_compare_coarse", width, height, iterations,
+				boost::bind(&BenchImages::CompareCoarseToFine, &images), result);
+		// The blocks are skipped only if all their pixels pass, the count is
+		// exact
+		result.check = CheckResult("failed=" + ToString(images.pixelsFailed),
+				images.pixelsFailed == tablesFailed) + ";" + TviBreakpointsCheck();
+		Print(format, result);
+
+		// The band edges must not change the result
+		Run("yee_compare_banded", width, height, iterations,
+				boost::bind(&BenchImages::CompareBanded, &images), result);
+		result.check = CheckResult("failed=" + ToString(images.pixelsFailed),
+				images.pixelsFailed == tablesFailed);
+		Print(format, result);
+
+		// A second reference with more noise than the test image
+		vector<float> noisyReference;
+		MakeTestImage(images.reference, .05f, noisyReference);
+		YeeImage noisyReferenceImage(width, height);
+		noisyReferenceImage.Build(&noisyReference[0]);
+		vector<const YeeImage *> references;
+		references.push_back(&noisyReferenceImage);
+		references.push_back(&images.referenceImage);
+
+		Run("yee_compare_multi", width, height, iterations,
+				boost::bind(&BenchImages::CompareMulti, &images, &references), result);
+		result.check = MultiCheck(references, images.testImage, images.multiResult);
+		Print(format, result);
+
+		Run("yee_compare_bounded", width, height, iterations,
+				boost::bind(&BenchImages::CompareBounded, &images), result);
+		result.check = string("failed=") + (images.boundedFailed ? "true" : "false");
+		Print(format, result);
+
+		Run("convtest", width, height, iterations,
+				boost::bind(&BenchImages::ConvergenceTestRun, &images), result);
+		result.check = "failed=" + ToString(images.pixelsFailed);
+		Print(format, result);
+
+		const ImageMetricType metrics[] = { IMAGE_METRIC_MSE, IMAGE_METRIC_SSIM, IMAGE_METRIC_PDIFF };
+		const float thresholds[] = { 1e-3f, .9f, 33.f };
+		for (u_int i = 0; i < sizeof(metrics) / sizeof(metrics[0]); ++i) {
+			ImageMetric *metric = ImageMetric::Create(metrics[i], thresholds[i]);
+			metric->SetReference(width, height, &images.reference[0]);
+
+			Run(string("metric_") + metric->GetName(), width, height, iterations,
+					boost::bind(&BenchImages::MetricTest, &images, metric), result);
+			result.check = string("passed=") + (images.metricPassed ? "true" : "false");
+			Print(format, result);
+
+			if (metrics[i] == IMAGE_METRIC_PDIFF) {
+				// The test image as a film output must pass, and fail if its
+				// rows are taken in the wrong order
+				vector<float> film(images.test.size());
+				const size_t rowSize = 3 * width;
+				for (u_int y = 0; y < height; ++y)
+					copy(&images.test[y * rowSize], &images.test[y * rowSize] + rowSize,
+							&film[(height - y - 1) * rowSize]);
+
+				images.MetricTestFilm(metric, &images.test);
+				const bool flippedPassed = images.metricPassed;
+				Run(string("metric_") + metric->GetName() + "_film", width, height, iterations,
+						boost::bind(&BenchImages::MetricTestFilm, &images, metric, &film), result);
+				result.check = CheckResult(string("passed=") + (images.metricPassed ? "true" : "false") +
+						";flipped_passed=" + (flippedPassed ? "true" : "false"),
+						images.metricPassed && !flippedPassed);
+				Print(format, result);
+			}
+
+			delete metric;
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+// Command line
+//------------------------------------------------------------------------------
+
+static vector<string> Split(const string &s) {
+	vector<string> tokens;
+	stringstream ss(s);
+	string token;
+	while (getline(ss, token, ','))
+		if (token.length() > 0)
+			tokens.push_back(token);
+
+	return tokens;
+}
+
+static void ParseSize(const string &s, u_int &width, u_int &height) {
+	if (s == "720p") {
+		width = 1280; height = 720;
+	} else if (s == "1080p") {
+		width = 1920; height = 1080;
+	} else if (s == "1440p") {
+		width = 2560; height = 1440;
+	} else if (s == "4k") {
+		width = 3840; height = 2160;
+	} else if (s == "8k") {
+		width = 7680; height = 4320;
+	} else {
+		char separator = 0;
+		stringstream ss(s);
+		if (!(ss >> width >> separator >> height) || (separator != 'x') || (width == 0) || (height == 0))
+			throw runtime_error("Unknown image size: " + s);
+	}
+}
+
+static u_int ParseUInt(const string &s) {
+	const int v = atoi(s.c_str());
+	if (v <= 0)
+		throw runtime_error("Invalid number: " + s);
+
+	return (u_int)v;
+}
+
+static void PrintUsage() {
+	cerr << "Usage: luxmark_convtest_bench [options]" << endl <<
+			"  --sizes <list>       image sizes: 720p, 1080p, 1440p, 4k, 8k or <w>x<h> (default: all the named ones)" << endl <<
+			"  --threads <list>     thread counts (default: 1, 2, 4, ... up to the hardware threads)" << endl <<
+			"  --iterations <n>     timed iterations of each benchmark (default: 5)" << endl <<
+			"  --format csv|json    output format (default: csv)" << endl;
+}
+
+int main(int argc, char *argv[]) {
+	try {
+		vector<string> sizes = Split("720p,1080p,1440p,4k,8k");
+		vector<u_int> threadCounts;
+		u_int iterations = 5;
+		OutputFormat format = FORMAT_CSV;
+
+		for (int i = 1; i < argc; ++i) {
+			const string arg = argv[i];
+			if ((arg == "-h") || (arg == "--help")) {
+				PrintUsage();
+				return EXIT_SUCCESS;
+			}
+
+			if (i + 1 >= argc)
+				throw runtime_error("Missing value of option: " + arg);
+			const string value = argv[++i];
+
+			if (arg == "--sizes")
+				sizes = Split(value);
+			else if (arg == "--threads") {
+				const vector<string> tokens = Split(value);
+				for (u_int j = 0; j < tokens.size(); ++j)
+					threadCounts.push_back(ParseUInt(tokens[j]));
+			} else if (arg == "--iterations")
+				iterations = ParseUInt(value);
+			else if (arg == "--format") {
+				if (value == "csv")
+					format = FORMAT_CSV;
+				else if (value == "json")
+					format = FORMAT_JSON;
+				else
+					throw runtime_error("Unknown output format: " + value);
+			} else
+				throw runtime_error("Unknown option: " + arg);
+		}
+
+		if (threadCounts.size() == 0) {
+			const u_int hardwareThreads = max(1u, boost::thread::hardware_concurrency());
+			for (u_int t = 1; t < hardwareThreads; t *= 2)
+				threadCounts.push_back(t);
+			threadCounts.push_back(hardwareThreads);
+		}
+
+		PrintHeader(format);
+		for (u_int i = 0; i < sizes.size(); ++i) {
+			u_int width, height;
+			ParseSize(sizes[i], width, height);
+
+			RunSize(width, height, threadCounts, iterations, format);
+		}
+	} catch (exception &err) {
+		cerr << "ERROR: " << err.what() << endl;
+		PrintUsage();
+		return EXIT_FAILURE;
+	}
+
+	if (checkFailed) {
+		cerr << "ERROR: some checks have failed" << endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
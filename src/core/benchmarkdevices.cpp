@@ -0,0 +1,125 @@
+/***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: https://www.luxcorerender.org                        *
+ ***************************************************************************/
+
+#include <sstream>
+
+#include "luxcore/luxcore.h"
+#include "core/benchmarkdevices.h"
+
+using namespace luxrays;
+using namespace luxcore;
+
+vector<BenchmarkDeviceDescription> GetBenchmarkDeviceDescs() {
+	vector<BenchmarkDeviceDescription> descs;
+
+	// Retrieve the hardware information with LuxCore
+	const Properties oclDevDescs = GetOpenCLDeviceDescs();
+	const vector<string> oclDevDescPrefixs = oclDevDescs.GetAllUniqueSubNames("opencl.device");
+
+	for (size_t i = 0; i < oclDevDescPrefixs.size(); ++i) {
+		const string &prefix = oclDevDescPrefixs[i];
+
+		BenchmarkDeviceDescription deviceDesc;
+		deviceDesc.deviceName = oclDevDescs.Get(prefix + ".name").Get<string>();
+		deviceDesc.platformName = oclDevDescs.Get(prefix + ".platform.name").Get<string>();
+		deviceDesc.platformVersion = oclDevDescs.Get(prefix + ".platform.version").Get<string>();
+		deviceDesc.deviceType = oclDevDescs.Get(prefix + ".type").Get<string>();
+		deviceDesc.units = oclDevDescs.Get(prefix + ".units").Get<int>();
+		deviceDesc.clock = oclDevDescs.Get(prefix + ".clock").Get<int>();
+		deviceDesc.nativeVectorWidthFloat = oclDevDescs.Get(prefix + ".nativevectorwidthfloat").Get<int>();
+		deviceDesc.globalMem = oclDevDescs.Get(prefix + ".maxmemory").Get<unsigned long long>();
+		deviceDesc.localMem = oclDevDescs.Get(prefix + ".localmemory").Get<unsigned long long>();
+		deviceDesc.constantMem = oclDevDescs.Get(prefix + ".constmemory").Get<unsigned long long>();
+
+		descs.push_back(deviceDesc);
+	}
+
+	return descs;
+}
+
+vector<bool> ParseDeviceSelection(const vector<BenchmarkDeviceDescription> &descs,
+		const string &enabledDevices) {
+	vector<bool> selection;
+
+	for (size_t i = 0; i < descs.size(); ++i) {
+		// The default mode is GPU-only
+		bool enabledDev = !IsCPUDevice(descs[i]);
+
+		if (i < enabledDevices.length())
+			enabledDev = (enabledDevices.at(i) == '1');
+
+		selection.push_back(enabledDev);
+	}
+
+	return selection;
+}
+
+string DeviceSelectionToString(const vector<bool> &selection) {
+	stringstream ss;
+
+	for (size_t i = 0; i < selection.size(); ++i)
+		ss << (selection[i] ? "1" : "0");
+
+	return ss.str();
+}
+
+vector<BenchmarkDeviceDescription> GetSelectedDeviceDescs(
+		const vector<BenchmarkDeviceDescription> &deviceDescs, const vector<bool> &selection,
+		const LuxMarkAppMode mode) {
+	vector<BenchmarkDeviceDescription> descs;
+
+	switch (mode) {
+		case DEMO_LUXCOREUI:
+		case STRESSTEST_OCL_GPU:
+		case STRESSTEST_HYBRID:
+		case BENCHMARK_OCL_GPU:
+		case BENCHMARK_HYBRID:
+			for (size_t i = 0; i < deviceDescs.size(); ++i) {
+				if (!IsCPUDevice(deviceDescs[i]))
+					descs.push_back(deviceDescs[i]);
+			}
+			break;
+		case STRESSTEST_OCL_CPUGPU:
+		case BENCHMARK_OCL_CPUGPU:
+			descs = deviceDescs;
+			break;
+		case STRESSTEST_OCL_CPU:
+		case BENCHMARK_OCL_CPU:
+			for (size_t i = 0; i < deviceDescs.size(); ++i) {
+				if (IsCPUDevice(deviceDescs[i]))
+					descs.push_back(deviceDescs[i]);
+			}
+			break;
+		case BENCHMARK_HYBRID_CUSTOM:
+		case BENCHMARK_OCL_CUSTOM:
+			for (size_t i = 0; i < deviceDescs.size(); ++i) {
+				if ((i < selection.size()) && selection[i])
+					descs.push_back(deviceDescs[i]);
+			}
+			break;
+		case PAUSE:
+		case STRESSTEST_NATIVE:
+		case BENCHMARK_NATIVE:
+			break;
+	}
+
+	return descs;
+}
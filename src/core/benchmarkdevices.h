@@ -0,0 +1,62 @@
+/***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: https://www.luxcorerender.org                        *
+ ***************************************************************************/
+
+#ifndef _BENCHMARKDEVICES_H
+#define	_BENCHMARKDEVICES_H
+
+#include <string>
+#include <vector>
+
+#include "luxmarkdefs.h"
+
+typedef struct {
+	string platformName;
+	string platformVersion;
+	string deviceName;
+	string deviceType;
+	int units;
+	int clock;
+    int nativeVectorWidthFloat;
+	unsigned long long globalMem;
+	unsigned long long localMem;
+	unsigned long long constantMem;
+} BenchmarkDeviceDescription;
+
+// The OpenCL devices reported by LuxCore
+extern vector<BenchmarkDeviceDescription> GetBenchmarkDeviceDescs();
+
+inline bool IsCPUDevice(const BenchmarkDeviceDescription &desc) {
+	return (desc.deviceType == "OPENCL_CPU");
+}
+
+// The device selection of the CUSTOM modes from a --devices string, one
+// '1' or '0' for each device. The devices missing in the string are selected
+// if they aren't CPUs.
+extern vector<bool> ParseDeviceSelection(const vector<BenchmarkDeviceDescription> &descs,
+		const string &enabledDevices);
+extern string DeviceSelectionToString(const vector<bool> &selection);
+
+// The devices used by a mode
+extern vector<BenchmarkDeviceDescription> GetSelectedDeviceDescs(
+		const vector<BenchmarkDeviceDescription> &descs, const vector<bool> &selection,
+		const LuxMarkAppMode mode);
+
+#endif	/* _BENCHMARKDEVICES_H */
@@ -0,0 +1,139 @@
+/***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: https://www.luxcorerender.org                        *
+ ***************************************************************************/
+
+#include <cstring>
+#include <stdexcept>
+
+#include <boost/thread.hpp>
+
+#include "core/benchmarkrunner.h"
+
+using namespace luxrays;
+
+//------------------------------------------------------------------------------
+// Benchmark rules
+//------------------------------------------------------------------------------
+
+LuxMarkAppMode GetSceneMode(const char *sceneName, const LuxMarkAppMode mode) {
+	if (strcmp(sceneName, SCENE_WALLPAPER))
+		return mode;
+
+	if (IsBenchmarkMode(mode))
+		return BENCHMARK_NATIVE;
+	else if (IsStressTestMode(mode))
+		return STRESSTEST_NATIVE;
+	else
+		return mode;
+}
+
+string GetOpenCLCompilerOpts(const bool fastRelaxedMath, const bool madEnabled,
+		const bool strictAliasing, const bool noSignedZeros) {
+	string oclCompilerOpts = "";
+	if (fastRelaxedMath) {
+		if (oclCompilerOpts != "")
+			oclCompilerOpts += " ";
+		oclCompilerOpts += "-cl-fast-relaxed-math";
+	}
+	if (madEnabled) {
+		if (oclCompilerOpts != "")
+			oclCompilerOpts += " ";
+		oclCompilerOpts += "-cl-mad-enable";
+	}
+	if (strictAliasing) {
+		if (oclCompilerOpts != "")
+			oclCompilerOpts += " ";
+		oclCompilerOpts += "-cl-strict-aliasing";
+	}
+	if (noSignedZeros) {
+		if (oclCompilerOpts != "")
+			oclCompilerOpts += " ";
+		oclCompilerOpts += "-cl-no-signed-zeros";
+	}
+
+	return oclCompilerOpts;
+}
+
+double GetSampleSec(const Properties &stats) {
+	const double renderingTime = stats.Get("stats.renderengine.time").Get<double>();
+	const double sampleCount = stats.Get("stats.renderengine.total.samplecount").Get<double>();
+
+	return (renderingTime > 0.0) ? (sampleCount / renderingTime) : 0.0;
+}
+
+bool IsBenchmarkDone(const LuxMarkAppMode mode, const double renderingTime) {
+	return (renderingTime > BENCHMARK_TIME) && !IsStressTestMode(mode);
+}
+
+//------------------------------------------------------------------------------
+// BenchmarkRunner
+//------------------------------------------------------------------------------
+
+BenchmarkRunner::BenchmarkRunner(const char *sceneName, const LuxMarkAppMode m,
+		const string &deviceSelection, const string &oclCompilerOpts,
+		const double overheadShare) :
+		mode(m), session(sceneName, m, deviceSelection, oclCompilerOpts),
+		scheduler(overheadShare), sampleSec(0.0), frameBuffer(NULL) {
+	if (!IsBenchmarkMode(mode))
+		throw runtime_error("Internal error in BenchmarkRunner::BenchmarkRunner(): not a benchmark mode");
+
+	// Nothing is displayed
+	scheduler.EnableTask(REFRESH_FRAME, false);
+	scheduler.EnableTask(REFRESH_DENOISER, false);
+}
+
+BenchmarkRunner::~BenchmarkRunner() {
+}
+
+void BenchmarkRunner::Run(const BenchmarkProgress &progress) {
+	session.Start();
+	scheduler.Start(WallClockTime());
+
+	for (;;) {
+		const double waitTime = scheduler.GetNextTime() - WallClockTime();
+		if (waitTime > 0.0)
+			boost::this_thread::sleep(boost::posix_time::milliseconds((long)(waitTime * 1000.0)));
+
+		const double startTime = WallClockTime();
+		const Properties &stats = session.GetStats();
+		const double renderingTime = stats.Get("stats.renderengine.time").Get<double>();
+		sampleSec = ::GetSampleSec(stats);
+		scheduler.Done(REFRESH_STATS, startTime, WallClockTime());
+
+		if (progress)
+			progress(renderingTime, sampleSec);
+
+		if (IsBenchmarkDone(mode, renderingTime))
+			break;
+	}
+	overheadReport = scheduler.GetReport(WallClockTime());
+
+	// The film is read only once the rendering is stopped
+	session.Halt();
+	frameBuffer = session.UpdateFrameBuffer(0);
+}
+
+u_int BenchmarkRunner::GetFrameBufferWidth() const {
+	return session.GetFrameBufferWidth();
+}
+
+u_int BenchmarkRunner::GetFrameBufferHeight() const {
+	return session.GetFrameBufferHeight();
+}
@@ -0,0 +1,97 @@
+/***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: https://www.luxcorerender.org                        *
+ ***************************************************************************/
+
+#ifndef _BENCHMARKRUNNER_H
+#define	_BENCHMARKRUNNER_H
+
+#include <string>
+
+#include <boost/function.hpp>
+
+#include "luxmarkdefs.h"
+#include "core/luxcorerendersession.h"
+#include "core/refreshscheduler.h"
+
+// The length of a benchmark, in seconds of rendering
+#define BENCHMARK_TIME 120.0
+
+//------------------------------------------------------------------------------
+// Benchmark rules, shared by the GUI and the headless runner
+//------------------------------------------------------------------------------
+
+// The mode a scene is actually rendered with: WALLPAPER can be rendered only
+// with BiDir, so with the native C++ engine
+extern LuxMarkAppMode GetSceneMode(const char *sceneName, const LuxMarkAppMode mode);
+
+// The OpenCL compiler options of the rendering
+extern string GetOpenCLCompilerOpts(const bool fastRelaxedMath, const bool madEnabled,
+		const bool strictAliasing, const bool noSignedZeros);
+
+// The score, i.e. the samples rendered per second so far
+extern double GetSampleSec(const luxrays::Properties &stats);
+// True after BENCHMARK_TIME secs of benchmark, never for the stress tests
+extern bool IsBenchmarkDone(const LuxMarkAppMode mode, const double renderingTime);
+
+//------------------------------------------------------------------------------
+// BenchmarkRunner
+//
+// Runs a benchmark without any display, in the calling thread: it only polls
+// the statistics of the session, at the pace of a RefreshScheduler, and
+// sleeps in between so the rendering threads have the whole machine. The
+// film is read only once, after the end of the benchmark.
+//------------------------------------------------------------------------------
+
+// Called after each poll of the statistics, with the rendering time and the
+// current score
+typedef boost::function<void (const double, const double)> BenchmarkProgress;
+
+class BenchmarkRunner {
+public:
+	BenchmarkRunner(const char *sceneName, const LuxMarkAppMode mode,
+			const string &deviceSelection, const string &oclCompilerOpts,
+			const double overheadShare);
+	~BenchmarkRunner();
+
+	// Renders the scene until the end of the benchmark, it throws an
+	// exception if the rendering can't start
+	void Run(const BenchmarkProgress &progress = BenchmarkProgress());
+
+	double GetSampleSec() const { return sampleSec; }
+	// See RefreshScheduler::GetReport()
+	const string &GetOverheadReport() const { return overheadReport; }
+
+	// The float image pipeline output of the film, valid after Run() and
+	// until the runner is deleted
+	const float *GetFrameBuffer() const { return frameBuffer; }
+	u_int GetFrameBufferWidth() const;
+	u_int GetFrameBufferHeight() const;
+
+private:
+	const LuxMarkAppMode mode;
+	LuxCoreRenderSession session;
+	RefreshScheduler scheduler;
+
+	double sampleSec;
+	string overheadReport;
+	const float *frameBuffer;
+};
+
+#endif	/* _BENCHMARKRUNNER_H */
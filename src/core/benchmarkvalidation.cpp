@@ -0,0 +1,221 @@
+/***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: https://www.luxcorerender.org                        *
+ ***************************************************************************/
+
+#include <cstring>
+#include <algorithm>
+#include <stdexcept>
+
+#include <QFile>
+#include <QCryptographicHash>
+
+#include <boost/foreach.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/scoped_ptr.hpp>
+
+#include "convtest/imagemetric.h"
+#include "convtest/pdiff/metricocl.h"
+#include "core/benchmarkvalidation.h"
+#include "core/luxmarklog.h"
+
+static QString Path2QString(const boost::filesystem::path &fileName) {
+	return QString::fromStdWString(fileName.generic_wstring());
+}
+
+bool IsOfficialScene(const char *sceneName) {
+	return (strcmp(sceneName, SCENE_FOOD) == 0) ||
+			(strcmp(sceneName, SCENE_HALLBENCH) == 0) ||
+			(strcmp(sceneName, SCENE_WALLPAPER) == 0);
+}
+
+//------------------------------------------------------------------------------
+// Scene files validation
+//------------------------------------------------------------------------------
+
+static void AddSceneFiles(vector<boost::filesystem::path> &files, const boost::filesystem::path &path,
+		const ValidationProgress &progress) {
+    for (boost::filesystem::directory_iterator it(path); it != boost::filesystem::directory_iterator(); ++it) {
+		const boost::filesystem::path &fileName = it->path();
+
+		if (boost::filesystem::is_regular_file(fileName)) {
+			// Check if it is one of the scene file extensions or reference images
+			const string ext = fileName.extension().generic_string();
+			if ((ext == ".cfg") || (ext == ".scn") || (ext == ".ply") ||
+					(ext == ".pgi") || (ext == ".exr") || (ext == ".png") ||
+					(ext == ".raw")) {
+				progress("Selecting file [" + fileName.filename().generic_string() + "]");
+				files.push_back(fileName);
+			}
+		}
+	}
+}
+
+bool ValidateSceneFiles(const char *sceneName, const ValidationProgress &progress) {
+	// Extract the scene directory name
+	boost::filesystem::path scenePath = boost::filesystem::path(sceneName).parent_path();
+	LM_LOG("MD5 validation scene path: [" << scenePath << "]");
+
+	// Build the list of files to validate
+	vector<boost::filesystem::path> files;
+	AddSceneFiles(files, scenePath, progress);
+	sort(files.begin(), files.end());
+	LM_LOG("MD5 validation selected files: [" << scenePath << "]");
+	BOOST_FOREACH(boost::filesystem::path fileName, files) {
+		LM_LOG("  [" << fileName << "]");
+	}
+
+	// Validate each file
+	QCryptographicHash hash(QCryptographicHash::Md5);
+	LM_LOG("MD5 validated files: [" << scenePath << "]");
+	BOOST_FOREACH(boost::filesystem::path fileName, files) {
+		LM_LOG("  [" << fileName << "]");
+
+		progress("Validating file [" + fileName.filename().generic_string() + "]");
+
+		// Read all file
+		const QString fname = Path2QString(fileName);
+		QFile file(fname);
+		if (!file.open(QIODevice::ReadOnly))
+			throw runtime_error("Internal error in ValidateSceneFiles(): error while reading file: " + fname.toStdString());
+		QByteArray data = file.readAll();
+		hash.addData(data);
+		file.close();
+	}
+
+	// Check the result
+	const string md5 = QString(hash.result().toHex()).toStdString();
+	LM_LOG("Scene files MD5: [" << md5 << "]");
+
+	if (!strcmp(sceneName, SCENE_FOOD))
+		return (md5 == "2d70f0078c15709f99d28e05b2617735");
+	else if (!strcmp(sceneName, SCENE_HALLBENCH))
+		return (md5 == "12dfdd54a35d3aca3538bbb15ce15bc7");
+	else if (!strcmp(sceneName, SCENE_WALLPAPER))
+		return (md5 == "3b5d82294d227245ddd16d3723a2593f");
+	else {
+		LM_LOG("Internal error in ValidateSceneFiles(): unknown scene");
+		return false;
+	}
+}
+
+//------------------------------------------------------------------------------
+// Image validation
+//------------------------------------------------------------------------------
+
+// The metric used to validate the image of each scene: the perceptual
+// metric, with a larger tolerance for WALLPAPER. It runs on the CPU unless
+// the OpenCL validation is enabled, then on the first OpenCL device used by
+// the benchmark that can run it. The CPU is the default until the agreement
+// of the two versions (see the metric_pdiff_ocl row of the convtest
+// benchmark) has been checked on more OpenCL implementations.
+static lux::ImageMetric *CreateValidationMetric(const char *sceneName,
+		const vector<BenchmarkDeviceDescription> &descs, const bool oclImageValidation) {
+	const float errorTreshold = (strcmp(sceneName, SCENE_WALLPAPER) == 0) ? 50.f : 33.f;
+
+	if (oclImageValidation) {
+		for (size_t i = 0; i < descs.size(); ++i) {
+			try {
+				cl::Device device;
+				if (lux::OCLYeeCompare::FindDevice(descs[i].platformName, descs[i].deviceName, device)) {
+					lux::ImageMetric *metric = new lux::OCLPdiffImageMetric(errorTreshold, device);
+					LM_LOG("Image validation OpenCL device: " << descs[i].deviceName);
+
+					return metric;
+				}
+			} catch (cl::Error &err) {
+				LM_LOG("Unable to use OpenCL device " << descs[i].deviceName << " for the image validation: " <<
+						err.what() << "(" << err.err() << ")");
+			} catch (runtime_error &err) {
+				LM_LOG("Unable to use OpenCL device " << descs[i].deviceName << " for the image validation: " <<
+						err.what());
+			}
+		}
+	}
+
+	return lux::ImageMetric::Create(lux::IMAGE_METRIC_PDIFF, errorTreshold);
+}
+
+bool ValidateImage(const char *sceneName, const LuxMarkAppMode mode,
+		const vector<BenchmarkDeviceDescription> &descs, const bool oclImageValidation,
+		const float *frameBuffer, const u_int width, const u_int height,
+		const ValidationProgress &progress, string &description) {
+	if (!IsOfficialScene(sceneName))
+		throw runtime_error("Internal error in ValidateImage(): unknown scene");
+	if (!IsBenchmarkMode(mode))
+		throw runtime_error("Internal error in ValidateImage(): unknown mode");
+
+	// Extract the scene directory name
+	boost::filesystem::path scenePath = boost::filesystem::path(sceneName).parent_path();
+	LM_LOG("Image validation scene path: [" << scenePath << "]");
+
+	const u_int dataCount = width * height * 3;
+
+	boost::scoped_ptr<lux::ImageMetric> metric(CreateValidationMetric(sceneName, descs, oclImageValidation));
+	LM_LOG("Image validation metric: " << metric->GetName() << " (threshold " << metric->GetThreshold() << ")");
+
+	// Read the reference file, all modes use the same one
+	const boost::filesystem::path fileName = scenePath / "reference.raw";
+	LM_LOG("Image validation file name: [" << fileName << "]");
+
+	// Read the raw data
+	QFile rawFile(Path2QString(fileName));
+	if (!rawFile.open(QIODevice::ReadOnly))
+		throw runtime_error("Internal error in ValidateImage(): unable to open image reference file");
+	const QByteArray rawData = rawFile.readAll();
+	rawFile.close();
+
+	// Check the image size
+	if (rawData.size() != (int)dataCount)
+		throw runtime_error("Internal error in ValidateImage(): wrong image size");
+
+	// Look for the prepared reference in its cache file, it is keyed by the
+	// hash of the reference data
+	const unsigned long long referenceKey = lux::HashImageData(rawData.constData(), rawData.size());
+	const string cacheFileName = lux::GetReferenceCacheFileName(fileName.string());
+	if (metric->LoadReference(width, height, cacheFileName, referenceKey))
+		LM_LOG("Image validation reference cache: [" << cacheFileName << "]");
+	else {
+		// Create reference image
+		vector<float> referenceImage(dataCount);
+		const unsigned char *pixels = reinterpret_cast<const unsigned char *>(rawData.constData());
+		for (u_int i = 0; i < dataCount; ++i)
+			referenceImage[i] = pixels[i] / 255.f;
+
+		metric->SetReference(width, height, &referenceImage[0]);
+
+		// The scene directory can be read only, and not all metrics have a
+		// cache
+		if (!metric->SaveReference(cacheFileName, referenceKey))
+			LM_LOG("Unable to write the image validation reference cache: [" << cacheFileName << "]");
+	}
+
+	// Test image
+	progress("Comparing...");
+
+	// The test image is the float output of the film, without any 8 bit
+	// quantization. The film rows are bottom-up, the reference.raw ones
+	// top-down.
+	vector<float> testImage(dataCount);
+	lux::FilmToImage(width, height, frameBuffer, &testImage[0]);
+	const lux::ImageMetricResult result = metric->Test(&testImage[0]);
+	description = result.description;
+
+	return result.passed;
+}
@@ -0,0 +1,54 @@
+/***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: https://www.luxcorerender.org                        *
+ ***************************************************************************/
+
+#ifndef _BENCHMARKVALIDATION_H
+#define	_BENCHMARKVALIDATION_H
+
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+
+#include "luxmarkdefs.h"
+#include "core/benchmarkdevices.h"
+
+// Receives the progress messages of a validation, e.g. the file being read.
+// It is called by the thread running the validation.
+typedef boost::function<void (const string &)> ValidationProgress;
+
+// The scenes with known files and reference images
+extern bool IsOfficialScene(const char *sceneName);
+
+// Returns true if the MD5 of the scene files is the one of the official
+// scene. It throws an exception if the files can't be read.
+extern bool ValidateSceneFiles(const char *sceneName, const ValidationProgress &progress);
+
+// Compares the float output of the film with the reference image of the
+// scene, returns true if it passes and sets description to the result of
+// the metric. The comparison runs on the first OpenCL device of descs able
+// to run it if oclImageValidation is set, else on the CPU. It throws an
+// exception if the reference can't be read.
+extern bool ValidateImage(const char *sceneName, const LuxMarkAppMode mode,
+		const vector<BenchmarkDeviceDescription> &descs, const bool oclImageValidation,
+		const float *frameBuffer, const u_int width, const u_int height,
+		const ValidationProgress &progress, string &description);
+
+#endif	/* _BENCHMARKVALIDATION_H */
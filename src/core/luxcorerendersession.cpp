@@ -22,25 +22,26 @@
 #include <boost/thread.hpp>
 #include <boost/filesystem.hpp>
 
-#include "luxcorerendersession.h"
-#include "luxmarkapp.h"
-#include "mainwindow.h"
+#include "core/luxcorerendersession.h"
+#include "core/luxmarklog.h"
 
 using namespace luxrays;
 using namespace luxcore;
 
 LuxCoreRenderSession::LuxCoreRenderSession(const std::string &fileName, const LuxMarkAppMode mode,
-		const string &devSel, const string &oclCompOpts) {
+		const string &devSel, const string &oclCompOpts, SceneCache *cache) {
     renderMode = mode;
     
     sceneFileName = fileName;
     deviceSelection = devSel;
 	oclCompilerOpts = oclCompOpts;
+	sceneCache = cache;
 
 	config = NULL;
 	session = NULL;
 
 	started = false;
+	halted = false;
 }
 
 LuxCoreRenderSession::~LuxCoreRenderSession() {
@@ -162,7 +163,9 @@ void LuxCoreRenderSession::Start() {
 		}
 	}
 
-	config = RenderConfig::Create(props);
+	// Only the render engine is built again if the scene is cached, the
+	// configuration doesn't free a scene it hasn't loaded
+	config = RenderConfig::Create(props, sceneCache ? sceneCache->GetScene(props) : NULL);
 	session = RenderSession::Create(config);
 
 	session->Start();
@@ -175,6 +178,15 @@ void LuxCoreRenderSession::Stop() {
 	delete config;
 }
 
+void LuxCoreRenderSession::Halt() {
+	assert (started);
+
+	if (!halted) {
+		session->Stop();
+		halted = true;
+	}
+}
+
 const float *LuxCoreRenderSession::UpdateFrameBuffer(const u_int imagePipelineIndex) {
 	if (frameBufferPtrs.size() <= imagePipelineIndex)
 		frameBufferPtrs.resize(imagePipelineIndex + 1, NULL);
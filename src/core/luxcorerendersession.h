@@ -27,16 +27,23 @@
 
 #include "luxcore/luxcore.h"
 #include "luxmarkdefs.h"
+#include "core/scenecache.h"
 #endif
 
 class LuxCoreRenderSession {
 public:
+	// The scene is taken from sceneCache if there is one, else it is loaded
+	// by the session and freed with it
 	LuxCoreRenderSession(const string &sceneFileName, const LuxMarkAppMode mode,
-			const string &devSel, const string &oclCompOpts);
+			const string &devSel, const string &oclCompOpts,
+			SceneCache *sceneCache = NULL);
 	~LuxCoreRenderSession();
 
 	void Start();
 	void Stop();
+	// Stops the rendering but keeps the film, so its image pipeline output
+	// can still be read until Stop()
+	void Halt();
 
 	const float *UpdateFrameBuffer(const u_int imagePipelineIndex);
 	const float *GetFrameBufferPtr(const u_int imagePipelineIndex);
@@ -52,13 +59,14 @@ private:
 	LuxMarkAppMode renderMode;
 	string deviceSelection;
 	string oclCompilerOpts;
+	SceneCache *sceneCache;
 
 	luxcore::RenderConfig *config;
 	luxcore::RenderSession *session;
 
 	vector<const float *> frameBufferPtrs;
 
-	bool started;
+	bool started, halted;
 };
 
 #endif	/* LUXCORERENDERSESSION_H */
@@ -0,0 +1,47 @@
+/***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: https://www.luxcorerender.org                        *
+ ***************************************************************************/
+
+#include <cstring>
+
+#include "core/luxmarklog.h"
+
+static LuxMarkLogHandler logHandler = NULL;
+
+void SetLuxMarkLogHandler(LuxMarkLogHandler handler) {
+	logHandler = handler;
+}
+
+void LuxMarkLog(const std::string &msg, const bool isError) {
+	if (logHandler)
+		logHandler(msg, isError);
+}
+
+void LuxCoreLogHandler(const char *msg) {
+	if (strncmp(msg, "[LuxRays]", 9) == 0) {
+		LM_LOG_LUXRAYS(&msg[9]);
+	} else if (strncmp(msg, "[SDL]", 5) == 0) {
+		LM_LOG_SDL(&msg[5]);
+	} else if (strncmp(msg, "[LuxCore]", 9) == 0) {
+		LM_LOG_LUXCORE(&msg[9]);
+	} else {
+		LM_LOG_LUXCORE(msg);
+	}
+}
@@ -0,0 +1,52 @@
+/***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: https://www.luxcorerender.org                        *
+ ***************************************************************************/
+
+#ifndef _LUXMARKLOG_H
+#define	_LUXMARKLOG_H
+
+#include <string>
+#include <sstream>
+
+//------------------------------------------------------------------------------
+// Log of the benchmark core
+//
+// The messages go to the handler set by the front end: MainWindow shows them
+// in its log view, the headless runner prints them on stderr. They are
+// dropped while there is no handler. The handler can be called from any
+// thread.
+//------------------------------------------------------------------------------
+
+typedef void (*LuxMarkLogHandler)(const std::string &msg, const bool isError);
+
+extern void SetLuxMarkLogHandler(LuxMarkLogHandler handler);
+extern void LuxMarkLog(const std::string &msg, const bool isError);
+
+// The handler to pass to luxcore::Init()
+extern void LuxCoreLogHandler(const char *msg);
+
+#define LM_LOG(a) { std::stringstream _LM_LOG_LOCAL_SS; _LM_LOG_LOCAL_SS << a; LuxMarkLog(_LM_LOG_LOCAL_SS.str(), false); }
+#define LM_LOG_LUXRAYS(a) { LM_LOG("<FONT COLOR=\"#002200\"><B>[LuxRays]</B></FONT> " << a); }
+#define LM_LOG_SDL(a) { LM_LOG("<FONT COLOR=\"#005500\"><B>[SDL]</B></FONT> " << a); }
+#define LM_LOG_LUXCORE(a) { LM_LOG("<FONT COLOR=\"#009900\"><B>[LuxCore]</B></FONT> " << a); }
+
+#define LM_ERROR(a) { std::stringstream _LM_ERR_LOCAL_SS; _LM_ERR_LOCAL_SS << a; LuxMarkLog(_LM_ERR_LOCAL_SS.str(), true); }
+
+#endif	/* _LUXMARKLOG_H */
@@ -0,0 +1,120 @@
+/***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: https://www.luxcorerender.org                        *
+ ***************************************************************************/
+
+#include <cstdio>
+#include <limits>
+
+#include "core/refreshscheduler.h"
+
+using namespace luxrays;
+
+//------------------------------------------------------------------------------
+// RefreshScheduler
+//------------------------------------------------------------------------------
+
+// The frames are what the user looks at, they get most of the budget
+static const double refreshMinIntervals[REFRESH_TASK_COUNT] = { 1.0, 1.0, 10.0 };
+static const double refreshBudgetWeights[REFRESH_TASK_COUNT] = { 0.2, 0.5, 0.3 };
+static const char *refreshTaskNames[REFRESH_TASK_COUNT] = { "stats", "frames", "denoiser" };
+
+RefreshScheduler::RefreshScheduler(const double share) : overheadShare(share), startTime(0.0) {
+	for (u_int i = 0; i < REFRESH_TASK_COUNT; ++i) {
+		TaskState &task = tasks[i];
+		task.enabled = true;
+		task.minInterval = refreshMinIntervals[i];
+		task.budgetWeight = refreshBudgetWeights[i];
+	}
+
+	Start(0.0);
+}
+
+void RefreshScheduler::EnableTask(const RefreshTask task, const bool enable) {
+	tasks[task].enabled = enable;
+}
+
+void RefreshScheduler::Start(const double time) {
+	startTime = time;
+
+	for (u_int i = 0; i < REFRESH_TASK_COUNT; ++i) {
+		TaskState &task = tasks[i];
+		task.interval = task.minInterval;
+		task.nextTime = time + task.interval;
+		task.cost = 0.0;
+		task.totalTime = 0.0;
+		task.runCount = 0;
+	}
+}
+
+double RefreshScheduler::GetNextTime() const {
+	double nextTime = numeric_limits<double>::infinity();
+	for (u_int i = 0; i < REFRESH_TASK_COUNT; ++i) {
+		if (tasks[i].enabled)
+			nextTime = Min(nextTime, tasks[i].nextTime);
+	}
+
+	return nextTime;
+}
+
+bool RefreshScheduler::IsDue(const RefreshTask task, const double time) const {
+	return tasks[task].enabled && (time >= tasks[task].nextTime);
+}
+
+void RefreshScheduler::Done(const RefreshTask t, const double start, const double end) {
+	TaskState &task = tasks[t];
+
+	const double cost = Max(end - start, 0.0);
+	task.cost = (task.runCount == 0) ? cost : (.5 * task.cost + .5 * cost);
+	task.totalTime += cost;
+	++(task.runCount);
+
+	// The interval keeping the task inside its part of the budget
+	task.interval = Max(task.minInterval, task.cost / (overheadShare * task.budgetWeight));
+	task.nextTime = end + task.interval;
+}
+
+double RefreshScheduler::GetOverheadTime() const {
+	double overheadTime = 0.0;
+	for (u_int i = 0; i < REFRESH_TASK_COUNT; ++i)
+		overheadTime += tasks[i].totalTime;
+
+	return overheadTime;
+}
+
+string RefreshScheduler::GetReport(const double time) const {
+	const double wallTime = time - startTime;
+	const double overheadTime = GetOverheadTime();
+
+	char buf[512];
+	sprintf(buf, "%.3fsecs in %.1fsecs (%.2f%%, budget %.2f%%)", overheadTime, wallTime,
+			(wallTime > 0.0) ? (100.0 * overheadTime / wallTime) : 0.0, 100.0 * overheadShare);
+	string report = buf;
+
+	for (u_int i = 0; i < REFRESH_TASK_COUNT; ++i) {
+		const TaskState &task = tasks[i];
+		if (task.runCount > 0) {
+			sprintf(buf, "[%s: %u runs, %.1fms each, every %.1fsecs]", refreshTaskNames[i],
+					task.runCount, 1000.0 * task.totalTime / task.runCount, task.interval);
+			report += buf;
+		}
+	}
+
+	return report;
+}
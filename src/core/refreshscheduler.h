@@ -0,0 +1,91 @@
+/***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: https://www.luxcorerender.org                        *
+ ***************************************************************************/
+
+#ifndef _REFRESHSCHEDULER_H
+#define	_REFRESHSCHEDULER_H
+
+#include <string>
+
+#include "luxmarkdefs.h"
+
+// The work done to show a running rendering
+enum RefreshTask {
+	// Reading the statistics of the session
+	REFRESH_STATS,
+	// Running the image pipeline and converting the shown image
+	REFRESH_FRAME,
+	// Running the denoiser image pipeline
+	REFRESH_DENOISER,
+	REFRESH_TASK_COUNT
+};
+
+//------------------------------------------------------------------------------
+// RefreshScheduler
+//
+// Chooses when the rendering is observed so the time spent doing it stays
+// under a share of the wall time. The cost of each task is measured at each
+// run, and its interval is the smoothed cost divided by the part of the
+// budget the task gets, but not shorter than a minimum (1sec for the stats
+// and the frames, 10secs for the denoiser). All times are in seconds.
+//------------------------------------------------------------------------------
+
+class RefreshScheduler {
+public:
+	// overheadShare is the share of the wall time, e.g. 0.005 for 0.5%
+	RefreshScheduler(const double overheadShare);
+
+	// The tasks are all enabled by default
+	void EnableTask(const RefreshTask task, const bool enable);
+	// Restarts the measurements, the first run of each task is after its
+	// minimum interval
+	void Start(const double time);
+
+	// The time the next enabled task is due
+	double GetNextTime() const;
+	bool IsDue(const RefreshTask task, const double time) const;
+	// Records a run of the task and schedules the next one
+	void Done(const RefreshTask task, const double startTime, const double endTime);
+
+	double GetOverheadShare() const { return overheadShare; }
+	double GetInterval(const RefreshTask task) const { return tasks[task].interval; }
+	// The total time spent in the tasks since Start()
+	double GetOverheadTime() const;
+	// A summary of the overhead up to the given time
+	std::string GetReport(const double time) const;
+
+private:
+	class TaskState {
+	public:
+		bool enabled;
+		double minInterval, budgetWeight;
+		double interval, nextTime;
+		// Exponential moving average of the cost
+		double cost;
+		double totalTime;
+		u_int runCount;
+	};
+
+	const double overheadShare;
+	double startTime;
+	TaskState tasks[REFRESH_TASK_COUNT];
+};
+
+#endif	/* _REFRESHSCHEDULER_H */
@@ -0,0 +1,60 @@
+/***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: https://www.luxcorerender.org                        *
+ ***************************************************************************/
+
+#include "core/scenecache.h"
+#include "core/luxmarklog.h"
+
+using namespace luxrays;
+using namespace luxcore;
+
+SceneCache::SceneCache() : scene(NULL), imageScale(1.f) {
+}
+
+SceneCache::~SceneCache() {
+	Clear();
+}
+
+void SceneCache::Clear() {
+	delete scene;
+	scene = NULL;
+	sceneFileName = "";
+}
+
+Scene *SceneCache::GetScene(const Properties &cfgProps) {
+	// The same defaults used by RenderConfig when it loads the scene itself
+	const string fileName = cfgProps.Get(Property("scene.file")("scenes/scene.scn")).Get<string>();
+	const float scale = cfgProps.Get(Property("images.scale")(1.f)).Get<float>();
+
+	if (scene && (fileName == sceneFileName) && (scale == imageScale)) {
+		LM_LOG("Reusing the loaded scene: " << fileName);
+		return scene;
+	}
+
+	Clear();
+
+	const double startTime = WallClockTime();
+	scene = Scene::Create(fileName, scale);
+	sceneFileName = fileName;
+	imageScale = scale;
+	LM_LOG("Scene loaded in " << (WallClockTime() - startTime) << " secs: " << fileName);
+
+	return scene;
+}
@@ -0,0 +1,59 @@
+/***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: https://www.luxcorerender.org                        *
+ ***************************************************************************/
+
+#ifndef _SCENECACHE_H
+#define	_SCENECACHE_H
+
+#ifndef Q_MOC_RUN
+#include <string>
+
+#include "luxcore/luxcore.h"
+#include "luxmarkdefs.h"
+#endif
+
+//------------------------------------------------------------------------------
+// SceneCache
+//
+// Keeps the last loaded scene, so the sessions rendering the same scene one
+// after the other (e.g. when the mode is changed) only build a new render
+// engine instead of parsing the scene and reading all its meshes and
+// textures again. Only one session at a time can use the scene.
+//------------------------------------------------------------------------------
+
+class SceneCache {
+public:
+	SceneCache();
+	~SceneCache();
+
+	// Returns the scene of the render configuration, loading it only if it
+	// isn't the cached one. The scene belongs to the cache.
+	luxcore::Scene *GetScene(const luxrays::Properties &cfgProps);
+	// Frees the cached scene
+	void Clear();
+
+private:
+	luxcore::Scene *scene;
+	// The scene file and the image scale the scene was loaded with
+	string sceneFileName;
+	float imageScale;
+};
+
+#endif	/* _SCENECACHE_H */
@@ -0,0 +1,347 @@
+ /***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: http://www.luxrender.net                             *
+ ***************************************************************************/
+
+#include <cmath>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__SSSE3__)
+#include <tmmintrin.h>
+#endif
+
+#include "display/rgbconverter.h"
+
+using namespace lux;
+
+// The sRGB table covers [2^-13, 1) with 128 entries per octave: all values
+// below 2^-13 have code 0 and all values above 1 have code 255
+#define SRGB_MIN_BITS 0x39000000u
+#define SRGB_MAX_BITS 0x3f7fffffu
+#define SRGB_ENTRY_SHIFT 16
+#define SRGB_ENTRIES 1664
+
+// Pixels converted at a time by ConvertPixels()
+#define PIXEL_CHUNK_SIZE 256
+
+static inline unsigned int FloatAsBits(const float f) {
+	unsigned int i;
+	memcpy(&i, &f, sizeof(float));
+	return i;
+}
+
+static inline float BitsAsFloat(const unsigned int i) {
+	float f;
+	memcpy(&f, &i, sizeof(float));
+	return f;
+}
+
+//------------------------------------------------------------------------------
+// RGB888Converter class
+//------------------------------------------------------------------------------
+
+RGB888Converter::RGB888Converter(const bool s) : sRGB(s) {
+	// The smallest value of each code, found by bisection on the bits of
+	// the values in [0, 1]
+	sRGBThresholds[0] = -INFINITY;
+	for (unsigned int code = 1; code < 256; ++code) {
+		unsigned int low = 0;
+		unsigned int high = FloatAsBits(1.f);
+		while (low < high) {
+			const unsigned int middle = low + (high - low) / 2;
+			if (ConvertValueReference(BitsAsFloat(middle), true) >= code)
+				high = middle;
+			else
+				low = middle + 1;
+		}
+
+		sRGBThresholds[code] = BitsAsFloat(low);
+	}
+	sRGBThresholds[256] = INFINITY;
+
+	int code = 0;
+	for (unsigned int i = 0; i < SRGB_ENTRIES; ++i) {
+		const float v = BitsAsFloat(SRGB_MIN_BITS + (i << SRGB_ENTRY_SHIFT));
+		while (v >= sRGBThresholds[code + 1])
+			++code;
+		sRGBCodes[i] = code;
+	}
+}
+
+unsigned char RGB888Converter::ConvertValueReference(const float v, const bool sRGB) {
+	float e = v;
+	if (sRGB)
+		e = (v <= .0031308f) ? (12.92f * v) : (1.055f * powf(v, 1.f / 2.4f) - .055f);
+
+	const float c = e * 255.f + .5f;
+	// Written to also map NaNs to 0
+	return (unsigned char)(!(c >= 0.f) ? 0.f : ((c > 255.f) ? 255.f : c));
+}
+
+unsigned char RGB888Converter::ConvertValue(const float v) const {
+	if (!sRGB)
+		return ConvertValueReference(v, false);
+
+	float x = v;
+	if (!(x >= BitsAsFloat(SRGB_MIN_BITS)))
+		x = BitsAsFloat(SRGB_MIN_BITS);
+	else if (x > BitsAsFloat(SRGB_MAX_BITS))
+		x = BitsAsFloat(SRGB_MAX_BITS);
+
+	int code = sRGBCodes[(FloatAsBits(x) - SRGB_MIN_BITS) >> SRGB_ENTRY_SHIFT];
+	if (x >= sRGBThresholds[code + 1])
+		++code;
+
+	return (unsigned char)code;
+}
+
+#if defined(__AVX2__)
+
+// Packs 32 values in [0, 255] to bytes
+static inline void Pack32(const __m256i a, const __m256i b, const __m256i c, const __m256i d,
+		unsigned char *dst) {
+	// The packs work on each 128bit lane, the permutation puts the groups of
+	// 4 values back in order
+	const __m256i ab = _mm256_packs_epi32(a, b);
+	const __m256i cd = _mm256_packs_epi32(c, d);
+	const __m256i abcd = _mm256_packus_epi16(ab, cd);
+	_mm256_storeu_si256((__m256i *)dst,
+			_mm256_permutevar8x32_epi32(abcd, _mm256_setr_epi32(0, 4, 1, 5, 2, 6, 3, 7)));
+}
+
+static inline __m256i ConvertLinear8(const float *src) {
+	__m256 c = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(src), _mm256_set1_ps(255.f)),
+			_mm256_set1_ps(.5f));
+	// The max returns 0 for NaNs
+	c = _mm256_min_ps(_mm256_max_ps(c, _mm256_setzero_ps()), _mm256_set1_ps(255.f));
+
+	return _mm256_cvttps_epi32(c);
+}
+
+static inline __m256i ConvertSRGB8(const float *src, const int *codes, const float *thresholds) {
+	__m256 x = _mm256_max_ps(_mm256_loadu_ps(src), _mm256_castsi256_ps(_mm256_set1_epi32(SRGB_MIN_BITS)));
+	x = _mm256_min_ps(x, _mm256_castsi256_ps(_mm256_set1_epi32(SRGB_MAX_BITS)));
+
+	const __m256i index = _mm256_srli_epi32(_mm256_sub_epi32(_mm256_castps_si256(x),
+			_mm256_set1_epi32(SRGB_MIN_BITS)), SRGB_ENTRY_SHIFT);
+	const __m256i code = _mm256_i32gather_epi32(codes, index, 4);
+	const __m256 next = _mm256_i32gather_ps(thresholds + 1, code, 4);
+
+	// The comparison mask is -1 where the value reaches the next code
+	return _mm256_sub_epi32(code, _mm256_castps_si256(_mm256_cmp_ps(x, next, _CMP_GE_OQ)));
+}
+
+#elif defined(__SSE2__)
+
+// Packs 16 values in [0, 255] to bytes
+static inline void Pack16(const __m128i a, const __m128i b, const __m128i c, const __m128i d,
+		unsigned char *dst) {
+	_mm_storeu_si128((__m128i *)dst,
+			_mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+}
+
+static inline __m128i ConvertLinear4(const float *src) {
+	__m128 c = _mm_add_ps(_mm_mul_ps(_mm_loadu_ps(src), _mm_set1_ps(255.f)), _mm_set1_ps(.5f));
+	// The max returns 0 for NaNs
+	c = _mm_min_ps(_mm_max_ps(c, _mm_setzero_ps()), _mm_set1_ps(255.f));
+
+	return _mm_cvttps_epi32(c);
+}
+
+#endif
+
+void RGB888Converter::ConvertLinear(const float *src, const unsigned int count, unsigned char *dst) const {
+	unsigned int i = 0;
+#if defined(__AVX2__)
+	for (; i + 32 <= count; i += 32) {
+		Pack32(ConvertLinear8(&src[i]), ConvertLinear8(&src[i + 8]),
+				ConvertLinear8(&src[i + 16]), ConvertLinear8(&src[i + 24]), &dst[i]);
+	}
+#elif defined(__SSE2__)
+	for (; i + 16 <= count; i += 16) {
+		Pack16(ConvertLinear4(&src[i]), ConvertLinear4(&src[i + 4]),
+				ConvertLinear4(&src[i + 8]), ConvertLinear4(&src[i + 12]), &dst[i]);
+	}
+#endif
+
+	for (; i < count; ++i)
+		dst[i] = ConvertValueReference(src[i], false);
+}
+
+void RGB888Converter::ConvertSRGB(const float *src, const unsigned int count, unsigned char *dst) const {
+	unsigned int i = 0;
+#if defined(__AVX2__)
+	for (; i + 32 <= count; i += 32) {
+		Pack32(ConvertSRGB8(&src[i], sRGBCodes, sRGBThresholds),
+				ConvertSRGB8(&src[i + 8], sRGBCodes, sRGBThresholds),
+				ConvertSRGB8(&src[i + 16], sRGBCodes, sRGBThresholds),
+				ConvertSRGB8(&src[i + 24], sRGBCodes, sRGBThresholds), &dst[i]);
+	}
+#endif
+	// SSE2 has no gather, the table lookups are scalar anyway
+
+	for (; i < count; ++i)
+		dst[i] = ConvertValue(src[i]);
+}
+
+void RGB888Converter::Convert(const float *src, const unsigned int count, unsigned char *dst) const {
+	if (sRGB)
+		ConvertSRGB(src, count, dst);
+	else
+		ConvertLinear(src, count, dst);
+}
+
+// Packs count RGB888 pixels to 0xffRRGGBB, rgb is read up to 4 bytes past
+// the last pixel
+static inline void PackRGB32(const unsigned char *rgb, const unsigned int count, unsigned int *dst) {
+	unsigned int i = 0;
+#if defined(__SSSE3__)
+	// 4 pixels at a time: the B, G and R bytes of each one go to the memory
+	// order of a little endian 0xffRRGGBB
+	const __m128i shuffle = _mm_setr_epi8(2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9, -1);
+	const __m128i alpha = _mm_set1_epi32(0xff000000);
+	for (; i + 4 <= count; i += 4) {
+		const __m128i v = _mm_loadu_si128((const __m128i *)&rgb[3 * i]);
+		_mm_storeu_si128((__m128i *)&dst[i], _mm_or_si128(_mm_shuffle_epi8(v, shuffle), alpha));
+	}
+#endif
+
+	for (; i < count; ++i)
+		dst[i] = 0xff000000u | (rgb[3 * i] << 16) | (rgb[3 * i + 1] << 8) | rgb[3 * i + 2];
+}
+
+void RGB888Converter::ConvertPixels(const float *src, const unsigned int count, unsigned int *dst) const {
+	// The bytes of a chunk, with the padding read by PackRGB32()
+	unsigned char rgb[3 * PIXEL_CHUNK_SIZE + 16];
+	for (unsigned int first = 0; first < count; first += PIXEL_CHUNK_SIZE) {
+		const unsigned int size = std::min(count - first, (unsigned int)PIXEL_CHUNK_SIZE);
+		Convert(&src[3 * first], 3 * size, rgb);
+		PackRGB32(rgb, size, &dst[first]);
+	}
+}
+
+void RGB888Converter::ConvertFrameBuffer(const float *frameBuffer, const float *frameBufferDenoised,
+		const unsigned int width, const unsigned int height, unsigned char *dst,
+		const size_t bytesPerLine) const {
+	const size_t rowSize = 3 * (size_t)width;
+	const size_t dstRowSize = (bytesPerLine > 0) ? bytesPerLine :
+		(4 * (size_t)width * (frameBufferDenoised ? 2 : 1));
+
+	for (unsigned int y = 0; y < height; ++y) {
+		unsigned int *dstRow = reinterpret_cast<unsigned int *>(&dst[(height - y - 1) * dstRowSize]);
+
+		ConvertPixels(&frameBuffer[y * rowSize], width, dstRow);
+		if (frameBufferDenoised)
+			ConvertPixels(&frameBufferDenoised[y * rowSize], width, dstRow + width);
+	}
+}
+
+// The RGB sums of count boxes of boxWidth x rows pixels starting at src,
+// times scale. The columns of a box are summed first, then added from left
+// to right. With SSE2 each column is a 4 float vector, the 4th float is the
+// R of the next pixel (it is overwritten by the next box), so the last box
+// is done by the scalar loop to never read or write past the end.
+static void BoxSums(const float *src, const size_t rowSize, const unsigned int boxWidth,
+		const unsigned int rows, const unsigned int count, const float scale, float *dst) {
+	unsigned int i = 0;
+#if defined(__SSE2__)
+	const __m128 s = _mm_set1_ps(scale);
+	for (; i + 1 < count; ++i) {
+		const float *box = &src[3 * boxWidth * i];
+		__m128 sum = _mm_setzero_ps();
+		for (unsigned int x = 0; x < boxWidth; ++x) {
+			__m128 column = _mm_loadu_ps(&box[3 * x]);
+			for (unsigned int y = 1; y < rows; ++y)
+				column = _mm_add_ps(column, _mm_loadu_ps(&box[y * rowSize + 3 * x]));
+			sum = (x == 0) ? column : _mm_add_ps(sum, column);
+		}
+		_mm_storeu_ps(&dst[3 * i], _mm_mul_ps(sum, s));
+	}
+#endif
+
+	for (; i < count; ++i) {
+		const float *box = &src[3 * boxWidth * i];
+		for (unsigned int c = 0; c < 3; ++c) {
+			float sum = 0.f;
+			for (unsigned int x = 0; x < boxWidth; ++x) {
+				float column = box[3 * x + c];
+				for (unsigned int y = 1; y < rows; ++y)
+					column += box[y * rowSize + 3 * x + c];
+				sum = (x == 0) ? column : (sum + column);
+			}
+			dst[3 * i + c] = sum * scale;
+		}
+	}
+}
+
+void RGB888Converter::ConvertScaledRow(const float *image, const unsigned int width,
+		const unsigned int height, const unsigned int factor, const unsigned int oy,
+		unsigned int *dst) {
+	const unsigned int scaledWidth = GetScaledSize(width, factor);
+	const unsigned int y0 = oy * factor;
+	const unsigned int rows = ((y0 + factor < height) ? (y0 + factor) : height) - y0;
+	const size_t rowSize = 3 * (size_t)width;
+	const float *src = &image[y0 * rowSize];
+
+	// The full boxes, then the last one if it is narrower. Each box is
+	// scaled by the inverse of its area.
+	float *boxes = &scaledPixels[0];
+	const unsigned int fullBoxes = width / factor;
+	BoxSums(src, rowSize, factor, rows, fullBoxes, 1.f / (factor * rows), boxes);
+	if (fullBoxes < scaledWidth) {
+		const unsigned int lastWidth = width - fullBoxes * factor;
+		BoxSums(&src[3 * fullBoxes * factor], rowSize, lastWidth, rows, 1,
+				1.f / (lastWidth * rows), &boxes[3 * fullBoxes]);
+	}
+
+	ConvertPixels(boxes, scaledWidth, dst);
+}
+
+void RGB888Converter::ConvertFrameBufferScaled(const float *frameBuffer, const float *frameBufferDenoised,
+		const unsigned int width, const unsigned int height, const unsigned int factor,
+		unsigned char *dst, const size_t bytesPerLine) {
+	if (factor <= 1) {
+		ConvertFrameBuffer(frameBuffer, frameBufferDenoised, width, height, dst, bytesPerLine);
+		return;
+	}
+
+	const unsigned int scaledWidth = GetScaledSize(width, factor);
+	const unsigned int scaledHeight = GetScaledSize(height, factor);
+	const size_t dstRowSize = (bytesPerLine > 0) ? bytesPerLine :
+		(4 * (size_t)scaledWidth * (frameBufferDenoised ? 2 : 1));
+
+	// Allocated only when the size grows
+	if (scaledPixels.size() < 3 * (size_t)scaledWidth)
+		scaledPixels.resize(3 * (size_t)scaledWidth);
+
+	for (unsigned int oy = 0; oy < scaledHeight; ++oy) {
+		unsigned int *dstRow = reinterpret_cast<unsigned int *>(&dst[(scaledHeight - oy - 1) * dstRowSize]);
+
+		ConvertScaledRow(frameBuffer, width, height, factor, oy, dstRow);
+		if (frameBufferDenoised)
+			ConvertScaledRow(frameBufferDenoised, width, height, factor, oy, dstRow + scaledWidth);
+	}
+}
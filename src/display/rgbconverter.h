@@ -0,0 +1,104 @@
+ /***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: http://www.luxrender.net                             *
+ ***************************************************************************/
+
+#ifndef LUX_RGBCONVERTER_H
+#define LUX_RGBCONVERTER_H
+
+#include <cstddef>
+#include <vector>
+
+namespace lux {
+
+//------------------------------------------------------------------------------
+// RGB888Converter
+//
+// Converts the float RGB of the film to the 8 bit RGB shown on screen. Each
+// value becomes (unsigned char)Clamp(v * 255.f + .5f, 0.f, 255.f), optionally
+// after the sRGB gamma encoding. The conversion uses AVX2 or SSE2 when the
+// build enables them; all the versions give the same result of
+// ConvertValue(). The frame buffer conversions write 32 bit 0xffRRGGBB
+// pixels, the layout of QImage::Format_RGB32, which is drawn without any
+// conversion.
+//
+// The sRGB encoding uses a table of 1664 codes, one for each 1/128 of an
+// octave in [2^-13, 1), and the 255 thresholds between codes: there is at most
+// one threshold in each table entry, so one comparison gives the exact result
+// of the powf() version.
+//------------------------------------------------------------------------------
+
+class RGB888Converter {
+public:
+	RGB888Converter(const bool sRGB = false);
+
+	bool IsSRGB() const { return sRGB; }
+
+	// Converts count floats
+	void Convert(const float *src, const unsigned int count, unsigned char *dst) const;
+
+	// Converts a width x height image, and the denoised one if it is not
+	// NULL, in a single pass to 0xffRRGGBB pixels. The rows are flipped
+	// vertically. With the denoised image, each dst row holds the raw row
+	// followed by the denoised one, so dst is 2 * width pixels wide. The dst
+	// rows are bytesPerLine apart (e.g. the rows of a QImage), 0 if they are
+	// packed.
+	void ConvertFrameBuffer(const float *frameBuffer, const float *frameBufferDenoised,
+			const unsigned int width, const unsigned int height, unsigned char *dst,
+			const size_t bytesPerLine = 0) const;
+
+	// Like ConvertFrameBuffer() but each dst pixel is the average of a
+	// factor x factor box of the image, so dst is GetScaledSize(width,
+	// factor) (twice that with the denoised image) x GetScaledSize(height,
+	// factor) pixels. The boxes of the last column and row can be smaller.
+	// It uses a scratch row of the converter, so it is not thread safe.
+	void ConvertFrameBufferScaled(const float *frameBuffer, const float *frameBufferDenoised,
+			const unsigned int width, const unsigned int height, const unsigned int factor,
+			unsigned char *dst, const size_t bytesPerLine = 0);
+	static unsigned int GetScaledSize(const unsigned int size, const unsigned int factor) {
+		return (size + factor - 1) / factor;
+	}
+
+	unsigned char ConvertValue(const float v) const;
+	// The same conversion done with powf()
+	static unsigned char ConvertValueReference(const float v, const bool sRGB);
+
+private:
+	void ConvertLinear(const float *src, const unsigned int count, unsigned char *dst) const;
+	void ConvertSRGB(const float *src, const unsigned int count, unsigned char *dst) const;
+	// Converts count RGB pixels to 0xffRRGGBB
+	void ConvertPixels(const float *src, const unsigned int count, unsigned int *dst) const;
+	// Converts the box filtered row oy of a scaled image
+	void ConvertScaledRow(const float *image, const unsigned int width, const unsigned int height,
+			const unsigned int factor, const unsigned int oy, unsigned int *dst);
+
+	bool sRGB;
+
+	// The code of the first value of each table entry and the smallest value
+	// of each code, sRGBThresholds[256] is +inf
+	int sRGBCodes[1664];
+	float sRGBThresholds[257];
+
+	// The box averages of a row of ConvertFrameBufferScaled()
+	std::vector<float> scaledPixels;
+};
+
+}
+
+#endif
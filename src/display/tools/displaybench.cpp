@@ -0,0 +1,406 @@
+ /***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: http://www.luxrender.net                             *
+ ***************************************************************************/
+
+// Microbenchmark of the conversion of the film output to the 8 bit RGB32
+// image shown by MainWindow::ShowFrameBuffer(), it links only the display
+// sources.
+//
+// Usage: luxmark_display_bench [--sizes 720p,1080p,1440p,4k,8k,<w>x<h>]
+//		[--iterations <n>] [--format csv|json]
+//
+// Each conversion is run once to warm up and then timed for the given number
+// of iterations. One line is printed for each run, in CSV (with a header
+// line) or JSON lines format, with the minimum and mean time per megapixel
+// of the raw image in milliseconds. "scalar" is the per channel loop used
+// before RGB888Converter, "denoised" runs convert the raw and the denoised
+// images side by side. The check is the number of values different from the
+// powf() reference conversion. "preview_<n>" runs are the box filtered
+// conversion of RenderPresenter scaling the image down by n, their check is
+// the size of the preview and the number of values different from the
+// reference conversion of the box averages.
+
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <boost/chrono.hpp>
+#include <boost/function.hpp>
+#include <boost/bind.hpp>
+
+#include "display/rgbconverter.h"
+
+using namespace std;
+using namespace lux;
+
+//------------------------------------------------------------------------------
+// Synthetic images
+//------------------------------------------------------------------------------
+
+static inline unsigned int HashUInt(unsigned int v) {
+	v ^= v >> 16;
+	v *= 0x7feb352du;
+	v ^= v >> 15;
+	v *= 0x846ca68bu;
+	v ^= v >> 16;
+
+	return v;
+}
+
+static inline float HashFloat(const unsigned int v) {
+	return (HashUInt(v) >> 8) * (1.f / 16777216.f);
+}
+
+// A film output with values a bit outside [0, 1], like the tone mapped one
+static void MakeFilmImage(const unsigned int width, const unsigned int height, const unsigned int seed,
+		vector<float> &rgb) {
+	rgb.resize(width * height * 3);
+	for (unsigned int i = 0; i < rgb.size(); ++i)
+		rgb[i] = 1.1f * HashFloat(i ^ seed) - .05f;
+}
+
+//------------------------------------------------------------------------------
+// Measurements
+//------------------------------------------------------------------------------
+
+typedef boost::function<void ()> BenchFunc;
+
+class BenchResult {
+public:
+	string name;
+	unsigned int width, height, iterations;
+	double minMsPerMegapixel, meanMsPerMegapixel;
+	string check;
+};
+
+static void Run(const string &name, const unsigned int width, const unsigned int height,
+		const unsigned int iterations, const BenchFunc &func, BenchResult &result) {
+	typedef boost::chrono::steady_clock Clock;
+
+	// Warm up
+	func();
+
+	double minTime = 0.0, totalTime = 0.0;
+	for (unsigned int i = 0; i < iterations; ++i) {
+		const Clock::time_point start = Clock::now();
+		func();
+		const double t = boost::chrono::duration<double>(Clock::now() - start).count();
+
+		minTime = (i == 0) ? t : min(minTime, t);
+		totalTime += t;
+	}
+
+	const double megapixels = (double)width * height * 1e-6;
+	result.name = name;
+	result.width = width;
+	result.height = height;
+	result.iterations = iterations;
+	result.minMsPerMegapixel = minTime * 1e3 / megapixels;
+	result.meanMsPerMegapixel = totalTime * 1e3 / (iterations * megapixels);
+}
+
+enum OutputFormat {
+	FORMAT_CSV,
+	FORMAT_JSON
+};
+
+static void PrintHeader(const OutputFormat format) {
+	if (format == FORMAT_CSV)
+		cout << "benchmark,width,height,iterations,min_ms_per_megapixel,mean_ms_per_megapixel,check" << endl;
+}
+
+static void Print(const OutputFormat format, const BenchResult &result) {
+	if (format == FORMAT_CSV) {
+		cout << result.name << "," << result.width << "," << result.height << "," <<
+				result.iterations << "," << result.minMsPerMegapixel << "," <<
+				result.meanMsPerMegapixel << "," << result.check << endl;
+	} else {
+		cout << "{\"benchmark\": \"" << result.name << "\", \"width\": " << result.width <<
+				", \"height\": " << result.height << ", \"iterations\": " << result.iterations <<
+				", \"min_ms_per_megapixel\": " << result.minMsPerMegapixel <<
+				", \"mean_ms_per_megapixel\": " << result.meanMsPerMegapixel <<
+				", \"check\": \"" << result.check << "\"}" << endl;
+	}
+}
+
+//------------------------------------------------------------------------------
+// Benchmarks
+//------------------------------------------------------------------------------
+
+class BenchImages {
+public:
+	BenchImages(const unsigned int w, const unsigned int h) : width(w), height(h) {
+		MakeFilmImage(width, height, 0, raw);
+		MakeFilmImage(width, height, 0x9e3779b9u, denoised);
+		pixels.resize(2 * width * height);
+	}
+
+	// The conversion done by ShowFrameBuffer() before RGB888Converter, with
+	// the RGB32 output
+	void ConvertScalar(const bool withDenoised) {
+		const unsigned int rowSize = (withDenoised ? 2 : 1) * width;
+		for (unsigned int y = 0; y < height; ++y) {
+			for (unsigned int x = 0; x < width; ++x) {
+				const unsigned int srcIndex = (x + y * width) * 3;
+				const unsigned int dstIndex = x + (height - y - 1) * rowSize;
+				pixels[dstIndex] = ScalarPixel(&raw[srcIndex]);
+				if (withDenoised)
+					pixels[dstIndex + width] = ScalarPixel(&denoised[srcIndex]);
+			}
+		}
+	}
+
+	void Convert(const RGB888Converter *converter, const bool withDenoised) {
+		converter->ConvertFrameBuffer(&raw[0], withDenoised ? &denoised[0] : NULL,
+				width, height, (unsigned char *)&pixels[0]);
+	}
+
+	void ConvertScaled(RGB888Converter *converter, const unsigned int factor, const bool withDenoised) {
+		converter->ConvertFrameBufferScaled(&raw[0], withDenoised ? &denoised[0] : NULL,
+				width, height, factor, (unsigned char *)&pixels[0]);
+	}
+
+	// The number of values of the last conversion different from the powf()
+	// reference
+	unsigned int Mismatches(const bool sRGB, const bool withDenoised) const {
+		const unsigned int rowSize = (withDenoised ? 2 : 1) * width;
+		unsigned int count = 0;
+		for (unsigned int y = 0; y < height; ++y) {
+			const unsigned int *row = &pixels[(height - y - 1) * rowSize];
+			for (unsigned int x = 0; x < width; ++x) {
+				count += PixelMismatches(row[x], &raw[(y * width + x) * 3], sRGB);
+				if (withDenoised)
+					count += PixelMismatches(row[width + x], &denoised[(y * width + x) * 3], sRGB);
+			}
+		}
+
+		return count;
+	}
+
+	// The same for the last ConvertScaled(), the reference box averages sum
+	// the columns of a box first, like the converter
+	unsigned int ScaledMismatches(const unsigned int factor, const bool withDenoised) const {
+		const unsigned int scaledWidth = RGB888Converter::GetScaledSize(width, factor);
+		const unsigned int scaledHeight = RGB888Converter::GetScaledSize(height, factor);
+		const unsigned int rowSize = (withDenoised ? 2 : 1) * scaledWidth;
+		unsigned int count = 0;
+		for (unsigned int oy = 0; oy < scaledHeight; ++oy) {
+			const unsigned int *row = &pixels[(scaledHeight - oy - 1) * rowSize];
+			for (unsigned int ox = 0; ox < scaledWidth; ++ox) {
+				float rgb[3];
+				BoxAverage(raw, factor, ox, oy, rgb);
+				count += PixelMismatches(row[ox], rgb, false);
+				if (withDenoised) {
+					BoxAverage(denoised, factor, ox, oy, rgb);
+					count += PixelMismatches(row[scaledWidth + ox], rgb, false);
+				}
+			}
+		}
+
+		return count;
+	}
+
+	const unsigned int width, height;
+	vector<float> raw, denoised;
+	// 0xffRRGGBB pixels
+	vector<unsigned int> pixels;
+
+private:
+	void BoxAverage(const vector<float> &image, const unsigned int factor,
+			const unsigned int ox, const unsigned int oy, float *rgb) const {
+		const unsigned int x0 = ox * factor, x1 = min(x0 + factor, width);
+		const unsigned int y0 = oy * factor, y1 = min(y0 + factor, height);
+		const float invArea = 1.f / ((x1 - x0) * (y1 - y0));
+		for (unsigned int c = 0; c < 3; ++c) {
+			float sum = 0.f;
+			for (unsigned int x = x0; x < x1; ++x) {
+				float columnSum = image[(y0 * width + x) * 3 + c];
+				for (unsigned int y = y0 + 1; y < y1; ++y)
+					columnSum += image[(y * width + x) * 3 + c];
+				sum = (x == x0) ? columnSum : (sum + columnSum);
+			}
+			rgb[c] = sum * invArea;
+		}
+	}
+
+	static unsigned int ScalarPixel(const float *rgb) {
+		unsigned int pixel = 0xff000000u;
+		for (unsigned int c = 0; c < 3; ++c)
+			pixel |= (unsigned int)(unsigned char)(min(max(rgb[c] * 255.f + .5f, 0.f), 255.f)) << (8 * (2 - c));
+
+		return pixel;
+	}
+
+	static unsigned int PixelMismatches(const unsigned int pixel, const float *rgb, const bool sRGB) {
+		unsigned int count = ((pixel >> 24) != 0xff) ? 1 : 0;
+		for (unsigned int c = 0; c < 3; ++c) {
+			if (((pixel >> (8 * (2 - c))) & 0xff) != RGB888Converter::ConvertValueReference(rgb[c], sRGB))
+				++count;
+		}
+
+		return count;
+	}
+};
+
+template <class T> static string ToString(const T &v) {
+	stringstream ss;
+	ss << v;
+	return ss.str();
+}
+
+static void RunSize(const unsigned int width, const unsigned int height,
+		const unsigned int iterations, const OutputFormat format) {
+	BenchImages images(width, height);
+	const RGB888Converter linearConverter(false);
+	const RGB888Converter sRGBConverter(true);
+	RGB888Converter previewConverter(false);
+
+	BenchResult result;
+	for (unsigned int d = 0; d < 2; ++d) {
+		const bool withDenoised = (d == 1);
+		const string suffix = withDenoised ? "_denoised" : "";
+
+		Run("scalar" + suffix, width, height, iterations,
+				boost::bind(&BenchImages::ConvertScalar, &images, withDenoised), result);
+		result.check = "mismatches=" + ToString(images.Mismatches(false, withDenoised));
+		Print(format, result);
+
+		Run("linear" + suffix, width, height, iterations,
+				boost::bind(&BenchImages::Convert, &images, &linearConverter, withDenoised), result);
+		result.check = "mismatches=" + ToString(images.Mismatches(false, withDenoised));
+		Print(format, result);
+
+		Run("srgb" + suffix, width, height, iterations,
+				boost::bind(&BenchImages::Convert, &images, &sRGBConverter, withDenoised), result);
+		result.check = "mismatches=" + ToString(images.Mismatches(true, withDenoised));
+		Print(format, result);
+
+		for (unsigned int factor = 2; factor <= 4; factor *= 2) {
+			Run("preview_" + ToString(factor) + suffix, width, height, iterations,
+					boost::bind(&BenchImages::ConvertScaled, &images, &previewConverter, factor, withDenoised), result);
+			result.check = "size=" + ToString(RGB888Converter::GetScaledSize(width, factor)) + "x" +
+					ToString(RGB888Converter::GetScaledSize(height, factor)) +
+					";mismatches=" + ToString(images.ScaledMismatches(factor, withDenoised));
+			Print(format, result);
+		}
+	}
+}
+
+//------------------------------------------------------------------------------
+// Command line
+//------------------------------------------------------------------------------
+
+static vector<string> Split(const string &s) {
+	vector<string> tokens;
+	stringstream ss(s);
+	string token;
+	while (getline(ss, token, ','))
+		if (token.length() > 0)
+			tokens.push_back(token);
+
+	return tokens;
+}
+
+static void ParseSize(const string &s, unsigned int &width, unsigned int &height) {
+	if (s == "720p") {
+		width = 1280; height = 720;
+	} else if (s == "1080p") {
+		width = 1920; height = 1080;
+	} else if (s == "1440p") {
+		width = 2560; height = 1440;
+	} else if (s == "4k") {
+		width = 3840; height = 2160;
+	} else if (s == "8k") {
+		width = 7680; height = 4320;
+	} else {
+		char separator = 0;
+		stringstream ss(s);
+		if (!(ss >> width >> separator >> height) || (separator != 'x') || (width == 0) || (height == 0))
+			throw runtime_error("Unknown image size: " + s);
+	}
+}
+
+static unsigned int ParseUInt(const string &s) {
+	const int v = atoi(s.c_str());
+	if (v <= 0)
+		throw runtime_error("Invalid number: " + s);
+
+	return (unsigned int)v;
+}
+
+static void PrintUsage() {
+	cerr << "Usage: luxmark_display_bench [options]" << endl <<
+			"  --sizes <list>       image sizes: 720p, 1080p, 1440p, 4k, 8k or <w>x<h> (default: all the named ones)" << endl <<
+			"  --iterations <n>     timed iterations of each benchmark (default: 10)" << endl <<
+			"  --format csv|json    output format (default: csv)" << endl;
+}
+
+int main(int argc, char *argv[]) {
+	try {
+		vector<string> sizes = Split("720p,1080p,1440p,4k,8k");
+		unsigned int iterations = 10;
+		OutputFormat format = FORMAT_CSV;
+
+		for (int i = 1; i < argc; ++i) {
+			const string arg = argv[i];
+			if ((arg == "-h") || (arg == "--help")) {
+				PrintUsage();
+				return EXIT_SUCCESS;
+			}
+
+			if (i + 1 >= argc)
+				throw runtime_error("Missing value of option: " + arg);
+			const string value = argv[++i];
+
+			if (arg == "--sizes")
+				sizes = Split(value);
+			else if (arg == "--iterations")
+				iterations = ParseUInt(value);
+			else if (arg == "--format") {
+				if (value == "csv")
+					format = FORMAT_CSV;
+				else if (value == "json")
+					format = FORMAT_JSON;
+				else
+					throw runtime_error("Unknown output format: " + value);
+			} else
+				throw runtime_error("Unknown option: " + arg);
+		}
+
+		PrintHeader(format);
+		for (unsigned int i = 0; i < sizes.size(); ++i) {
+			unsigned int width, height;
+			ParseSize(sizes[i], width, height);
+
+			RunSize(width, height, iterations, format);
+		}
+	} catch (exception &err) {
+		cerr << "ERROR: " << err.what() << endl;
+		PrintUsage();
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -110,79 +110,56 @@ HardwareTreeModel::HardwareTreeModel(MainWindow *w, const string &enabledDevices
 	oclDev->appendChild(oclGPUDev);
 
 	// Retrieve the hardware information with LuxCore
-	const Properties oclDevDescs = GetOpenCLDeviceDescs();
-	const vector<string> oclDevDescPrefixs = oclDevDescs.GetAllUniqueSubNames("opencl.device");
+	deviceDescs = GetBenchmarkDeviceDescs();
+	deviceSelection = ParseDeviceSelection(deviceDescs, enabledDevices);
 
-	for (size_t i = 0; i < oclDevDescPrefixs.size(); ++i) {
-		const string &prefix = oclDevDescPrefixs[i];
+	for (size_t i = 0; i < deviceDescs.size(); ++i) {
+		const BenchmarkDeviceDescription &deviceDesc = deviceDescs[i];
 
-		BenchmarkDeviceDescription deviceDesc;
-
-		deviceDesc.deviceName = oclDevDescs.Get(prefix + ".name").Get<string>();
 		HardwareTreeItem *newNode = new HardwareTreeItem(i, deviceDesc.deviceName.c_str());
 
 		stringstream ss;
-		deviceDesc.platformName = oclDevDescs.Get(prefix + ".platform.name").Get<string>();
 		ss << "Platform: " << deviceDesc.platformName;
 		newNode->appendChild(new HardwareTreeItem(ss.str().c_str()));
 
 		ss.str("");
-		deviceDesc.platformVersion = oclDevDescs.Get(prefix + ".platform.version").Get<string>();
 		ss << "Platform Version: " << deviceDesc.platformVersion;
 		newNode->appendChild(new HardwareTreeItem(ss.str().c_str()));
 
 		ss.str("");
-		deviceDesc.deviceType = oclDevDescs.Get(prefix + ".type").Get<string>();
 		ss << "Type: " << deviceDesc.deviceType;
 		newNode->appendChild(new HardwareTreeItem(ss.str().c_str()));
 
 		ss.str("");
-		deviceDesc.units = oclDevDescs.Get(prefix + ".units").Get<int>();
 		ss << "Compute Units: " << deviceDesc.units;
 		newNode->appendChild(new HardwareTreeItem(ss.str().c_str()));
 
 		ss.str("");
-		deviceDesc.clock = oclDevDescs.Get(prefix + ".clock").Get<int>();
 		ss << "Clock: " << deviceDesc.clock << " MHz";
 		newNode->appendChild(new HardwareTreeItem(ss.str().c_str()));
 
 		ss.str("");
-		deviceDesc.nativeVectorWidthFloat = oclDevDescs.Get(prefix + ".nativevectorwidthfloat").Get<int>();
 		ss << "Preferred vector width: " << deviceDesc.nativeVectorWidthFloat;
 		newNode->appendChild(new HardwareTreeItem(ss.str().c_str()));
 
 		ss.str("");
-		deviceDesc.globalMem = oclDevDescs.Get(prefix + ".maxmemory").Get<unsigned long long>();
 		ss << "Max. Global Memory: " << (deviceDesc.globalMem / 1024) << " Kbytes";
 		newNode->appendChild(new HardwareTreeItem(ss.str().c_str()));
 
 		ss.str("");
-		deviceDesc.localMem = oclDevDescs.Get(prefix + ".localmemory").Get<unsigned long long>();
 		ss << "Local Memory: " << (deviceDesc.localMem / 1024) << " Kbytes";
 		newNode->appendChild(new HardwareTreeItem(ss.str().c_str()));
 
 		ss.str("");
-		deviceDesc.constantMem = oclDevDescs.Get(prefix + ".constmemory").Get<unsigned long long>();
 		ss << "Max. Constant Memory: " << (deviceDesc.constantMem / 1024) << " Kbytes";
 		newNode->appendChild(new HardwareTreeItem(ss.str().c_str()));
 
-		const bool isCPUDev = (deviceDesc.deviceType == "OPENCL_CPU");
-		// The default mode is GPU-only
-		bool enabledDev = isCPUDev ? false : true;
-
-		if ((enabledDevices != "") && (i < enabledDevices.length()))
-			enabledDev = (enabledDevices.at(i) == '1');
-
-		newNode->setChecked(enabledDev);
+		newNode->setChecked(deviceSelection[i]);
 
-		if (isCPUDev)
+		if (IsCPUDevice(deviceDesc))
 			oclCPUDev->appendChild(newNode);
 		else
 			oclGPUDev->appendChild(newNode);
-
-		deviceDescs.push_back(deviceDesc);
-		deviceSelection.push_back(!isCPUDev);
-		isCPU.push_back(isCPUDev);
 	}
 }
 
@@ -313,55 +290,12 @@ bool HardwareTreeModel::setData(const QModelIndex &index, const QVariant &value,
 }
 
 string HardwareTreeModel::getDeviceSelectionString() const {
-	stringstream ss;
-
-	for (size_t i = 0; i < deviceSelection.size(); ++i)
-		ss << (deviceSelection[i] ? "1" : "0");
-
-	return ss.str();
+	return DeviceSelectionToString(deviceSelection);
 }
 
 vector<BenchmarkDeviceDescription> HardwareTreeModel::getSelectedDeviceDescs(
     const LuxMarkAppMode mode) const {
-    vector<BenchmarkDeviceDescription> descs;
-
-    switch (mode) {
-        case DEMO_LUXCOREUI:
-        case STRESSTEST_OCL_GPU:
-		case STRESSTEST_HYBRID:
-        case BENCHMARK_OCL_GPU:
-		case BENCHMARK_HYBRID:
-            for (size_t i = 0; i < deviceSelection.size(); ++i) {
-                if (!isCPU[i])
-                    descs.push_back(deviceDescs[i]);
-            }
-            break;
-        case STRESSTEST_OCL_CPUGPU:
-        case BENCHMARK_OCL_CPUGPU:
-            for (size_t i = 0; i < deviceSelection.size(); ++i)
-                descs.push_back(deviceDescs[i]);
-            break;
-        case STRESSTEST_OCL_CPU:
-        case BENCHMARK_OCL_CPU:
-            for (size_t i = 0; i < deviceSelection.size(); ++i) {
-                if (isCPU[i])
-                    descs.push_back(deviceDescs[i]);
-            }
-            break;
-		case BENCHMARK_HYBRID_CUSTOM:
-        case BENCHMARK_OCL_CUSTOM:
-            for (size_t i = 0; i < deviceSelection.size(); ++i) {
-                if (deviceSelection[i])
-                    descs.push_back(deviceDescs[i]);
-            }
-            break;
-        case PAUSE:
-		case STRESSTEST_NATIVE:
-        case BENCHMARK_NATIVE:
-            break;
-    }
-
-    return descs;
+	return GetSelectedDeviceDescs(deviceDescs, deviceSelection, mode);
 }
 
 //------------------------------------------------------------------------------
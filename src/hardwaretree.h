@@ -32,6 +32,7 @@
 #include <QAbstractItemModel>
 
 #include "luxmarkdefs.h"
+#include "core/benchmarkdevices.h"
 #endif
 
 using namespace std;
@@ -80,20 +81,6 @@ private:
 // HardwareTreeModel
 //------------------------------------------------------------------------------
 
-typedef struct {
-	string platformName;
-	string platformVersion;
-	string deviceName;
-	string deviceType;
-	int units;
-	int clock;
-    int nativeVectorWidthFloat;
-	unsigned long long globalMem;
-	unsigned long long localMem;
-	unsigned long long constantMem;
-} BenchmarkDeviceDescription;
-
-
 class HardwareTreeModel : public QAbstractItemModel {
 	Q_OBJECT
 
@@ -120,7 +107,6 @@ private:
 
     vector<BenchmarkDeviceDescription> deviceDescs;
 	vector<bool> deviceSelection;
-	vector<bool> isCPU;
 };
 
 //------------------------------------------------------------------------------
@@ -0,0 +1,214 @@
+/***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: https://www.luxcorerender.org                        *
+ ***************************************************************************/
+
+// LuxMark without GUI: it runs a benchmark with the core only, without
+// QApplication, and prints the result to the stdout. The log goes to the
+// stderr.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <clocale>
+
+#include <boost/filesystem.hpp>
+
+#include "luxmarkcfg.h"
+#include "luxmarkdefs.h"
+#include "core/luxmarklog.h"
+#include "core/benchmarkdevices.h"
+#include "core/benchmarkrunner.h"
+#include "core/benchmarkvalidation.h"
+
+// The share of the wall time spent polling the statistics
+#define HEADLESS_OVERHEAD 0.005
+
+static void StdErrLogHandler(const string &msg, const bool isError) {
+	// Remove the HTML tags used by the log window of the GUI
+	string text;
+	bool inTag = false;
+	for (size_t i = 0; i < msg.size(); ++i) {
+		if (msg[i] == '<')
+			inTag = true;
+		else if (msg[i] == '>')
+			inTag = false;
+		else if (!inTag)
+			text += msg[i];
+	}
+
+	if (isError)
+		cerr << "ERROR: ";
+	cerr << text << endl;
+}
+
+static void PrintProgress(const double renderingTime, const double sampleSec) {
+	// One line every 10secs
+	static int lastStep = -1;
+	const int step = int(renderingTime / 10.0);
+	if (step != lastStep) {
+		cerr << "[Time: " << int(renderingTime) << "secs][Samples/sec " << int(sampleSec / 1000.0) << "K]" << endl;
+		lastStep = step;
+	}
+}
+
+static void IgnoreProgress(const string &msg) {
+}
+
+static void PrintCmdLineHelp(const char *cmd) {
+	cerr << "Usage: " << cmd << " [options]" << endl <<
+			" --help (display this help and exit)" << endl <<
+			" --scene=FOOD|HALLBENCH|WALLPAPER (select the scene to use)" << endl <<
+			" --mode="
+                "BENCHMARK_OCL_GPU|BENCHMARK_OCL_CPUGPU|BENCHMARK_OCL_CPU|BENCHMARK_OCL_CUSTOM|"
+				"BENCHMARK_HYBRID|BENCHMARK_HYBRID_CUSTOM|BENCHMARK_NATIVE"
+				" (select the mode to use)" << endl <<
+			" --devices=<a string of 1 or 0 to enable/disable each OpenCL device in CUSTOM modes>" << endl <<
+			" --ext-info (print scene and image verification too)" << endl <<
+			" --image-validation=OPENCL|CPU (run the image validation on the first OpenCL device used by the benchmark or on the CPU, the default)" << endl;
+}
+
+static bool String2Mode(const string &name, LuxMarkAppMode &mode) {
+	static const LuxMarkAppMode modes[] = {
+		BENCHMARK_OCL_GPU, BENCHMARK_OCL_CPUGPU, BENCHMARK_OCL_CPU, BENCHMARK_OCL_CUSTOM,
+		BENCHMARK_HYBRID, BENCHMARK_HYBRID_CUSTOM, BENCHMARK_NATIVE
+	};
+	static const char *names[] = {
+		"BENCHMARK_OCL_GPU", "BENCHMARK_OCL_CPUGPU", "BENCHMARK_OCL_CPU", "BENCHMARK_OCL_CUSTOM",
+		"BENCHMARK_HYBRID", "BENCHMARK_HYBRID_CUSTOM", "BENCHMARK_NATIVE"
+	};
+
+	for (u_int i = 0; i < sizeof(modes) / sizeof(modes[0]); ++i) {
+		if (name == names[i]) {
+			mode = modes[i];
+			return true;
+		}
+	}
+
+	return false;
+}
+
+int main(int argc, char **argv) {
+	bool singleRunExtInfo = false;
+	bool oclImageValidation = false;
+	LuxMarkAppMode mode = BENCHMARK_OCL_GPU;
+	string devices = "";
+	const char *scnName = SCENE_FOOD;
+
+	for (int i = 1; i < argc; ++i) {
+		const string arg(argv[i]);
+
+		if (arg == "--help") {
+			PrintCmdLineHelp(argv[0]);
+			return EXIT_SUCCESS;
+		} else if (arg.compare(0, 8, "--scene=") == 0) {
+			const string scene = arg.substr(8);
+			if (scene == "FOOD")
+				scnName = SCENE_FOOD;
+			else if (scene == "HALLBENCH")
+				scnName = SCENE_HALLBENCH;
+			else if (scene == "WALLPAPER")
+				scnName = SCENE_WALLPAPER;
+			else {
+				cerr << "Unknown scene name: " << scene << endl;
+				PrintCmdLineHelp(argv[0]);
+				return EXIT_FAILURE;
+			}
+		} else if (arg.compare(0, 7, "--mode=") == 0) {
+			if (!String2Mode(arg.substr(7), mode)) {
+				cerr << "Unknown benchmark mode name: " << arg.substr(7) << endl;
+				PrintCmdLineHelp(argv[0]);
+				return EXIT_FAILURE;
+			}
+		} else if ((arg.compare(0, 10, "--devices=") == 0) &&
+				(arg.size() > 10) && (arg.find_first_not_of("01", 10) == string::npos)) {
+			if ((mode != BENCHMARK_OCL_CUSTOM) && (mode != BENCHMARK_HYBRID_CUSTOM)) {
+				cerr << "--devices can be used only after a --mode=BENCHMARK_OCL_CUSTOM or --mode=BENCHMARK_HYBRID_CUSTOM" << endl;
+				PrintCmdLineHelp(argv[0]);
+				return EXIT_FAILURE;
+			}
+
+			devices = arg.substr(10);
+		} else if (arg == "--ext-info") {
+			singleRunExtInfo = true;
+		} else if ((arg == "--image-validation=OPENCL") || (arg == "--image-validation=CPU")) {
+			oclImageValidation = (arg == "--image-validation=OPENCL");
+		} else {
+			cerr << "Unknown argument: " << arg << endl;
+			PrintCmdLineHelp(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	// If current directory doesn't have the "scenes" directory, move
+	// to where the executable is
+	if (!boost::filesystem::exists("./scenes")) {
+		boost::filesystem::path exePath = boost::filesystem::system_complete(boost::filesystem::path(argv[0])).parent_path();
+		boost::filesystem::current_path(exePath);
+	}
+
+	// Force C locale
+	setlocale(LC_NUMERIC, "C");
+
+	try {
+		// Initialize LuxRender API
+		SetLuxMarkLogHandler(StdErrLogHandler);
+		luxcore::Init(LuxCoreLogHandler);
+
+		LM_LOG("LuxMark v" << LUXMARK_VERSION_MAJOR << "." << LUXMARK_VERSION_MINOR);
+		LM_LOG("Based on LuxCore v" << LUXCORE_VERSION_MAJOR << "." << LUXCORE_VERSION_MINOR);
+
+		// Wall Paper scene can be rendered only with BiDir
+		mode = GetSceneMode(scnName, mode);
+		LM_LOG("Mode: " << LuxMarkAppMode2String(mode) << ", scene: " << scnName);
+
+		const vector<BenchmarkDeviceDescription> allDescs = GetBenchmarkDeviceDescs();
+		const vector<bool> deviceSelection = ParseDeviceSelection(allDescs, devices);
+
+		BenchmarkRunner runner(scnName, mode, DeviceSelectionToString(deviceSelection),
+				GetOpenCLCompilerOpts(true, true, false, true), HEADLESS_OVERHEAD);
+		runner.Run(PrintProgress);
+
+		cout << "Score: " << int(runner.GetSampleSec() / 1000.0) << endl;
+
+		if (singleRunExtInfo) {
+			bool sceneValidationOk = false;
+			bool imageValidationOk = false;
+			if (IsOfficialScene(scnName)) {
+				sceneValidationOk = ValidateSceneFiles(scnName, IgnoreProgress);
+
+				string description;
+				imageValidationOk = ValidateImage(scnName, mode,
+						GetSelectedDeviceDescs(allDescs, deviceSelection, mode), oclImageValidation,
+						runner.GetFrameBuffer(), runner.GetFrameBufferWidth(), runner.GetFrameBufferHeight(),
+						IgnoreProgress, description);
+				LM_LOG("Image validation: " << description);
+			}
+
+			cout << "Scene validation: " << (sceneValidationOk ? "Ok" : "Failed") << endl;
+			cout << "Image validation: " << (imageValidationOk ? "Ok" : "Failed") << endl;
+		}
+		cout << "Display overhead: " << runner.GetOverheadReport() << endl;
+	} catch (exception &err) {
+		cerr << "Error: " << err.what() << endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -19,10 +19,6 @@
  *   LuxMark website: https://www.luxcorerender.org                        *
  ***************************************************************************/
 
-#include <limits>
-#include <boost/algorithm/string.hpp>
-#include <boost/algorithm/string/predicate.hpp>
-
 #include <QFile>
 #include <QGraphicsSceneMouseEvent>
 
@@ -41,6 +37,7 @@
 #include "luxcoreuidialog.h"
 #include "resultdialog.h"
 #include "luxmarkdefs.h"
+#include "core/benchmarkrunner.h"
 
 #ifdef __APPLE__
 #include <mach-o/dyld.h>
@@ -48,18 +45,6 @@
 
 using namespace luxrays;
 
-static void LuxCoreErrorHandler(const char *msg) {
-	if (strncmp(msg, "[LuxRays]", 9) == 0) {
-		LM_LOG_LUXRAYS(&msg[9]);
-	} else if (strncmp(msg, "[SDL]", 5) == 0) {
-		LM_LOG_SDL(&msg[5]);
-	} else if (strncmp(msg, "[LuxCore]", 9) == 0) {
-		LM_LOG_LUXCORE(&msg[9]);
-	} else {
-		LM_LOG_LUXCORE(msg);
-	}
-}
-
 //------------------------------------------------------------------------------
 // LuxMark Qt application
 //------------------------------------------------------------------------------
@@ -68,8 +53,9 @@ LuxMarkApp::LuxMarkApp(int &argc, char **argv) : QApplication(argc, argv) {
 	// Initialize rand() number generator
 	srand(time(NULL));
 
-	// Initialize LuxRender API
-	luxcore::Init(LuxCoreErrorHandler);
+	// Initialize LuxRender API, its log is shown once the main window exists
+	SetLuxMarkLogHandler(MainWindowLogHandler);
+	luxcore::Init(LuxCoreLogHandler);
 
 	singleRun = false;
 	singleRunExtInfo = false;
@@ -78,13 +64,18 @@ LuxMarkApp::LuxMarkApp(int &argc, char **argv) : QApplication(argc, argv) {
 	oclOptMadEnabled = true;
 	oclOptStrictAliasing = false;
 	oclOptNoSignedZeros = true;
+	oclImageValidation = false;
+	noDisplay = false;
+	compareDisplay = false;
+	displayOverhead = 0.005;
+	useSceneCache = false;
 
 	mainWin = NULL;
 	engineInitThread = NULL;
 	engineInitDone = false;
 	renderingStartTime = 0.0;
 	luxSession = NULL;
-	renderRefreshTimer = NULL;
+	presenter = NULL;
 	hardwareTreeModel = NULL;
     
 #ifdef __APPLE__ // reliable reference for cwd, mandatory for bundles
@@ -110,6 +101,7 @@ LuxMarkApp::~LuxMarkApp() {
 		engineInitThread->join();
 		delete engineInitThread;
 	}
+	delete presenter;
 	delete luxSession;
 	delete mainWin;
 	delete hardwareTreeModel;
@@ -130,6 +122,7 @@ void LuxMarkApp::Init(LuxMarkAppMode mode, const string &enabledDevices, const c
 	// Initialize hardware information
 	hardwareTreeModel = new HardwareTreeModel(mainWin, enabledDevices);
 	mainWin->SetHardwareTreeModel(hardwareTreeModel);
+	mainWin->SetNoDisplayCheck(noDisplay);
 
 	InitRendering(mode, scnName);
 }
@@ -142,6 +135,12 @@ void LuxMarkApp::SetScene(const char *scnName) {
 	InitRendering(mode, scnName);
 }
 
+void LuxMarkApp::SetNoDisplay(const bool enable) {
+	noDisplay = enable;
+	if (mainWin)
+		mainWin->SetNoDisplayCheck(noDisplay);
+}
+
 void  LuxMarkApp::SetOpenCLCompilerOpts(const OCLCompilerOpts opt, const bool enable) {
 	switch (opt) {
 		case FAST_RELAXED_MATH:
@@ -163,9 +162,6 @@ void  LuxMarkApp::SetOpenCLCompilerOpts(const OCLCompilerOpts opt, const bool en
 }
 
 void LuxMarkApp::Stop() {
-	delete renderRefreshTimer;
-	renderRefreshTimer = NULL;
-
 	if (engineInitThread) {
 		// Wait for the init rendering thread
 		engineInitThread->join();
@@ -174,6 +170,14 @@ void LuxMarkApp::Stop() {
 	}
 	engineInitDone = false;
 
+	if (presenter) {
+		// The shown image belongs to the presenter
+		mainWin->ShowLogo();
+
+		delete presenter;
+		presenter = NULL;
+	}
+
 	// Free the scene if required
 	delete luxSession;
 	luxSession = NULL;
@@ -185,34 +189,12 @@ void LuxMarkApp::InitRendering(LuxMarkAppMode m, const char *scnName) {
 
 	Stop();
 
-	if (!strcmp(scnName, SCENE_WALLPAPER)) {
-		mainWin->SetSceneCheck(0);
+	// Wall Paper scene can be rendered only with BiDir
+	mode = GetSceneMode(scnName, mode);
 
-		// Wall Paper scene can be rendered only with BiDir
-		switch (mode) {
-			case BENCHMARK_OCL_GPU:
-			case BENCHMARK_OCL_CPUGPU:
-			case BENCHMARK_OCL_CPU:
-			case BENCHMARK_OCL_CUSTOM:
-			case BENCHMARK_HYBRID:
-			case BENCHMARK_HYBRID_CUSTOM:
-				mode = BENCHMARK_NATIVE;
-				break;
-			case STRESSTEST_OCL_GPU:
-			case STRESSTEST_OCL_CPUGPU:
-			case STRESSTEST_OCL_CPU:
-			case STRESSTEST_HYBRID:
-			case STRESSTEST_NATIVE:
-				mode = STRESSTEST_NATIVE;
-				break;
-			case DEMO_LUXCOREUI:
-				// Nothing to do
-				break;
-			case PAUSE:
-			default:
-				break;
-		}
-	} else if (!strcmp(scnName, SCENE_HALLBENCH))
+	if (!strcmp(scnName, SCENE_WALLPAPER))
+		mainWin->SetSceneCheck(0);
+	else if (!strcmp(scnName, SCENE_HALLBENCH))
 		mainWin->SetSceneCheck(1);
 	else if (!strcmp(scnName, SCENE_FOOD))
 		mainWin->SetSceneCheck(2);
@@ -222,12 +204,11 @@ void LuxMarkApp::InitRendering(LuxMarkAppMode m, const char *scnName) {
 	if ((mode == PAUSE) || (mode == DEMO_LUXCOREUI)) {
 		// Nothing to do
 	} else {
-		// Update timer
-		renderRefreshTimer = new QTimer();
-		connect(renderRefreshTimer, SIGNAL(timeout()), SLOT(RenderRefreshTimeout()));
-
-		// Refresh the screen every 4 secs in benchmark or stress mode
-		renderRefreshTimer->start(4 * 1000);
+		// The screen is refreshed in benchmark or stress mode. The presenter
+		// is started by the engine init thread.
+		presenter = new RenderPresenter(mode, displayOverhead, !noDisplay);
+		connect(presenter, SIGNAL(frameReady()), SLOT(PresenterFrameReady()), Qt::QueuedConnection);
+		UpdatePreviewSize();
 	}
 
 	mainWin->ShowLogo();
@@ -235,6 +216,9 @@ void LuxMarkApp::InitRendering(LuxMarkAppMode m, const char *scnName) {
 	if (mode == PAUSE) {
 		// Nothing to do
 	} else if (mode == DEMO_LUXCOREUI) {
+		// LuxCoreUI loads the scene on its own
+		sceneCache.Clear();
+
 		// Show LuxCoreUI dialog
 		LuxCoreUIDialog *dialog = new LuxCoreUIDialog(sceneName, exePath);
 
@@ -260,37 +244,20 @@ void LuxMarkApp::EngineInitThreadImpl(LuxMarkApp *app) {
 			(app->hardwareTreeModel->getDeviceSelectionString()) : "";
 
 		// Set OpenCL compiler options
-		string oclCompilerOpts = "";
-		if (app->oclOptFastRelaxedMath) {
-			if (oclCompilerOpts != "")
-				oclCompilerOpts += " ";
-			oclCompilerOpts += "-cl-fast-relaxed-math";
-		}
-		if (app->oclOptMadEnabled) {
-			if (oclCompilerOpts != "")
-				oclCompilerOpts += " ";
-			oclCompilerOpts += "-cl-mad-enable";
-		}
-		if (app->oclOptStrictAliasing) {
-			if (oclCompilerOpts != "")
-				oclCompilerOpts += " ";
-			oclCompilerOpts += "-cl-strict-aliasing";
-		}
-		if (app->oclOptNoSignedZeros) {
-			if (oclCompilerOpts != "")
-				oclCompilerOpts += " ";
-			oclCompilerOpts += "-cl-no-signed-zeros";
-		}
+		const string oclCompilerOpts = GetOpenCLCompilerOpts(app->oclOptFastRelaxedMath,
+				app->oclOptMadEnabled, app->oclOptStrictAliasing, app->oclOptNoSignedZeros);
 
-		app->luxSession = new LuxCoreRenderSession(sname, app->mode, deviceSelection, oclCompilerOpts);
+		app->luxSession = new LuxCoreRenderSession(sname, app->mode, deviceSelection, oclCompilerOpts,
+				app->useSceneCache ? &app->sceneCache : NULL);
 
 		// Start the rendering
 		app->luxSession->Start();
 
 		// Done
 		app->renderingStartTime = luxrays::WallClockTime();
-		app->lastFrameBufferDenoisedUpdate = app->renderingStartTime;
 		app->engineInitDone = true;
+
+		app->presenter->Start(app->luxSession);
 	} catch (cl::Error err) {
 		LM_ERROR("OpenCL ERROR: " << err.what() << "(" << err.err() << ")");
 	} catch (runtime_error err) {
@@ -300,184 +267,102 @@ void LuxMarkApp::EngineInitThreadImpl(LuxMarkApp *app) {
 	}
 }
 
-void LuxMarkApp::RenderRefreshTimeout() {
-	if (!engineInitDone)
+void LuxMarkApp::UpdatePreviewSize() {
+	if (presenter) {
+		u_int width, height;
+		mainWin->GetPreviewSize(&width, &height);
+		presenter->SetPreviewSize(width, height);
+	}
+}
+
+void LuxMarkApp::PresenterFrameReady() {
+	// The signal can come from the presenter of a previous mode
+	PresenterFrame frame;
+	if (!presenter || !presenter->AcquireFrame(frame))
 		return;
 
-	const bool isStressTest = (mode == STRESSTEST_OCL_GPU) ||
-		(mode == STRESSTEST_OCL_CPUGPU) ||
-		(mode == STRESSTEST_OCL_GPU) ||
-		(mode == STRESSTEST_HYBRID) ||
-		(mode == STRESSTEST_NATIVE);
-
-	const Properties &stats = luxSession->GetStats();
-	const double renderingTime = stats.Get("stats.renderengine.time").Get<double>();
-
-	// Update shown image
-	const int width = luxSession->GetFrameBufferWidth();
-	const int height = luxSession->GetFrameBufferHeight();
-	
-	const float *frameBuffer = luxSession->UpdateFrameBuffer(0);
-	const float *frameBufferDenoised = NULL;
-	if (isStressTest) {
-		// Check it is time to refresh the denoised frame buffer
-		const double deltaTime = luxrays::WallClockTime() - lastFrameBufferDenoisedUpdate;
-		if (((renderingTime < 30.0) && (deltaTime > 10.0)) ||
-				((renderingTime < 30.0 + 60.0) && (deltaTime > 20.0)) ||
-				((renderingTime < 30.0 + 60.0 + 90.0) && (deltaTime > 30.0)) ||
-				(deltaTime > 300.0)) {
-			frameBufferDenoised = luxSession->UpdateFrameBuffer(1);
-			lastFrameBufferDenoisedUpdate = luxrays::WallClockTime();
-		} else
-			frameBufferDenoised = luxSession->GetFrameBufferPtr(1);
+	if (!frame.image)
+		mainWin->ShowStats();
+	else if (frame.imageUpdated) {
+		mainWin->ShowFrameImage(frame.image, frame.hasDenoised);
+		// The view can have been resized since the last frame
+		UpdatePreviewSize();
 	}
 
-	mainWin->ShowFrameBuffer(frameBuffer, frameBufferDenoised, width, height);
-
 	// To save reference image
 	/*
 	{
+		const int width = frame.image->width();
+		const int height = frame.image->height();
+
+		const Properties &stats = luxSession->GetStats();
 		const double sampleCount = stats.Get("stats.renderengine.total.samplecount").Get<double>();
-		const unsigned char *pixels = mainWin->GetFrameBuffer();
 
 		const u_int samlePerPixel = (u_int)(sampleCount / (width * height));
 		LM_LOG("Samples per pixel: " << samlePerPixel);
 		static u_int savedSpp = 0;
 		if (samlePerPixel / 100 > savedSpp) {
 			LM_LOG("Saving reference...");
-			const QByteArray data = QByteArray::fromRawData((char *)pixels, width * height * 3);
 			QFile refImage("reference.raw");
 			refImage.open(QIODevice::WriteOnly);
-			refImage.write(data);
+			// The QImage rows are padded
+			for (int y = 0; y < height; ++y)
+				refImage.write((const char *)frame.image->constScanLine(y), width * 3);
 			refImage.close();
 			++savedSpp;
 		}
 	}
 	*/
 
-	//--------------------------------------------------------------------------
-	// Update the statistics
-	//--------------------------------------------------------------------------
-
-	const double sampleCount = stats.Get("stats.renderengine.total.samplecount").Get<double>();
-	const double sampleSec = (renderingTime > 0.0) ? (sampleCount / renderingTime) : 0.0;
-
-	vector<string> deviceNames;
-	vector<double> deviceRaysSecs;
-	vector<double> deviceMem, deviceMaxMem;
-	vector<bool> deviceIsOpenCL;
-	bool hasOpenCLDevices = false;
-	bool hasNativeDevices = false;
-	double triangleCount = 0.0;
-	double minPerf = 0.0;
-	double totalPerf = 0.0;
-
-	triangleCount = stats.Get("stats.dataset.trianglecount").Get<double>();
-
-	// Get each device statistics
-	minPerf = numeric_limits<double>::infinity();
-	const Property &devNames = stats.Get("stats.renderengine.devices");
-	for (u_int i = 0; i < devNames.GetSize(); ++i) {
-		const string deviceName = devNames.Get<string>(i);
-		deviceNames.push_back(deviceName);
-
-		const double raySecs = stats.Get("stats.renderengine.devices." + deviceName + ".performance.total").Get<double>();
-		deviceRaysSecs.push_back(raySecs);
-		deviceMaxMem.push_back(stats.Get("stats.renderengine.devices." + deviceName + ".memory.total").Get<double>());
-		deviceMem.push_back(stats.Get("stats.renderengine.devices." + deviceName + ".memory.used").Get<double>());
-
-		minPerf = Min(raySecs, minPerf);
-		totalPerf += raySecs;
-		
-		const bool isOpenCLDevice = boost::starts_with(deviceName, "NativeIntersect") ? false : true;
-		deviceIsOpenCL.push_back(isOpenCLDevice);
-		hasOpenCLDevices = (hasOpenCLDevices || isOpenCLDevice);
-		hasNativeDevices = (hasNativeDevices || !isOpenCLDevice);
-	}
-
-	// Get the list of device names
-	// After 120secs of benchmark, show the result dialog
-	const bool benchmarkDone = (renderingTime > 120.0) && (!isStressTest);
-
-	char buf[512];
-	stringstream ss("");
-
-	char validBuf[128];
-	if (benchmarkDone)
-		strcpy(validBuf, " (OK)");
-	else {
-		if (!isStressTest)
-			sprintf(validBuf, " (%dsecs remaining)", Max<int>(120 - renderingTime, 0));
-		else
-			strcpy(validBuf, "");
-	}
-
-	char triCountBuf[128];
-	if (triangleCount > 0.0)
-		sprintf(triCountBuf, "[Rays/sec % 6dK on %.1fK tris]",
-			int(totalPerf / 1000.0), triangleCount / 1000.0);
-	else
-		strcpy(triCountBuf, "");
-
-	sprintf(buf, "[Mode: %s][Time: %dsecs%s][Samples/sec % 6dK][Samples/pixel %.1f]%s",
-			LuxMarkAppMode2String(mode).c_str(),
-			int(renderingTime), validBuf, int(sampleSec / 1000.0),
-			sampleCount / (width * height),
-			triCountBuf);
-	ss << buf;
-
-	if (hasOpenCLDevices) {
-		ss << "\n\nOpenCL rendering devices:";
-		for (size_t i = 0; i < deviceNames.size(); ++i) {
-			if (deviceIsOpenCL[i]) {
-				sprintf(buf, "\n    [%s][Rays/sec % 3dK][Prf Idx %.2f][Wrkld %.1f%%][Mem %.1fM/%dM]",
-						deviceNames[i].c_str(),
-						int(deviceRaysSecs[i] / 1000.0),
-						(minPerf > 0.0) ? (deviceRaysSecs[i] / minPerf) : 0.f,
-						(totalPerf > 0.0) ? (100.0 * deviceRaysSecs[i] / totalPerf) : 0.f,
-						deviceMem[i] / (1024 * 1024), int(deviceMaxMem[i] / (1024 * 1024)));
-				ss << buf;
-			}
-		}
-	}
-	
-	if (hasNativeDevices) {
-		ss << "\n\nNative C++ rendering devices:";
-		for (size_t i = 0; i < deviceNames.size(); ++i) {
-			if (!deviceIsOpenCL[i]) {
-				sprintf(buf, "\n    [%s][Rays/sec % 3dK][Prf Idx %.2f][Wrkld %.1f%%][Mem %.1fM/%dM]",
-						deviceNames[i].c_str(),
-						int(deviceRaysSecs[i] / 1000.0),
-						(minPerf > 0.0) ? (deviceRaysSecs[i] / minPerf) : 0.f,
-						(totalPerf > 0.0) ? (100.0 * deviceRaysSecs[i] / totalPerf) : 0.f,
-						deviceMem[i] / (1024 * 1024), int(deviceMaxMem[i] / (1024 * 1024)));
-				ss << buf;
-			}
-		}
-	}
-
-	mainWin->UpdateScreenLabel(ss.str().c_str());
+	mainWin->UpdateScreenLabel(frame.screenLabel.c_str());
 
 	//--------------------------------------------------------------------------
 	// End the benchmark if it is time
 	//--------------------------------------------------------------------------
 
-	if (benchmarkDone) {
+	if (frame.benchmarkDone) {
+		// The presenter thread has ended after the last frame, the session
+		// can be used here
+		presenter->Stop();
+		const double sampleSec = frame.sampleSec;
+		const string scoreComparison = RecordScore(sampleSec);
+		LM_LOG("Display overhead: " << frame.overheadReport);
+
 		// Check if I'm in single run mode
 		if (singleRun && !singleRunExtInfo) {
+			if (compareDisplay && !noDisplay) {
+				// Run the same benchmark again, without display
+				SetNoDisplay(true);
+				InitRendering(mode, sceneName);
+				return;
+			}
+
 			// The case (singleRun && singleRunExtInfo) is handled inside ResultDialog()
 			cout << "Score: " << int(sampleSec / 1000.0) << endl;
+			cout << "Display overhead: " << frame.overheadReport << endl;
+			if (scoreComparison != "")
+				cout << scoreComparison << endl;
 
 			exit(EXIT_SUCCESS);
 		} else {
-			mainWin->ShowFrameBuffer(luxSession->UpdateFrameBuffer(0), luxSession->UpdateFrameBuffer(1), width, height);
+			if (scoreComparison != "")
+				LM_LOG(scoreComparison);
+
+			// Stop the rendering but keep the session: the image validation
+			// reads the float output of the film directly. It is freed by
+			// InitRendering(). The film is read only once the rendering is
+			// stopped.
+			luxSession->Halt();
 
-			Stop();
+			const int width = luxSession->GetFrameBufferWidth();
+			const int height = luxSession->GetFrameBufferHeight();
+
+			const float *pixels = luxSession->UpdateFrameBuffer(0);
+			mainWin->ShowFrameBuffer(pixels, luxSession->UpdateFrameBuffer(1), width, height);
 
             vector<BenchmarkDeviceDescription> descs = hardwareTreeModel->getSelectedDeviceDescs(mode);
-			const unsigned char *pixels = mainWin->GetFrameBuffer();
 			ResultDialog *dialog = new ResultDialog(mode, sceneName, sampleSec,
-                    descs, pixels, width, height,
+                    descs, pixels, width, height, frame.overheadReport, oclImageValidation,
 					singleRun && singleRunExtInfo);
 			dialog->exec();
 			delete dialog;
@@ -487,3 +372,23 @@ void LuxMarkApp::RenderRefreshTimeout() {
 		}
 	}
 }
+
+string LuxMarkApp::RecordScore(const double sampleSec) {
+	const string key = string(sceneName) + " " + LuxMarkAppMode2String(mode);
+	(noDisplay ? noDisplayScores : displayScores)[key] = sampleSec;
+
+	// Compare with the last run of the same benchmark with the other display
+	// setting, if there is one
+	std::map<string, double>::const_iterator withDisplay = displayScores.find(key);
+	std::map<string, double>::const_iterator withoutDisplay = noDisplayScores.find(key);
+	if ((withDisplay == displayScores.end()) || (withoutDisplay == noDisplayScores.end()) ||
+			(withDisplay->second <= 0.0))
+		return "";
+
+	char buf[256];
+	sprintf(buf, "Score with display: %d, without display: %d (%+.2f%%)",
+			int(withDisplay->second / 1000.0), int(withoutDisplay->second / 1000.0),
+			100.0 * (withoutDisplay->second - withDisplay->second) / withDisplay->second);
+
+	return string(buf);
+}
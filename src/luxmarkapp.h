@@ -24,7 +24,8 @@
 
 #ifndef Q_MOC_RUN
 #include <QtWidgets/QApplication>
-#include <QTimer>
+
+#include <map>
 
 #include <boost/thread.hpp>
 #include <boost/filesystem.hpp>
@@ -32,18 +33,14 @@
 #include "luxmarkdefs.h"
 #include "mainwindow.h"
 #include "hardwaretree.h"
-#include "luxcorerendersession.h"
+#include "core/luxcorerendersession.h"
+#include "renderpresenter.h"
 #endif
 
 //------------------------------------------------------------------------------
 // LuxMark Qt application
 //------------------------------------------------------------------------------
 
-// List of supported scenes
-#define SCENE_WALLPAPER "scenes/wallpaper/render.cfg"
-#define SCENE_HALLBENCH "scenes/hallbench/render.cfg"
-#define SCENE_FOOD "scenes/food/render.cfg"
-
 class LuxMarkApp : public QApplication {
 	Q_OBJECT
 
@@ -61,8 +58,24 @@ public:
 	void SetScene(const char *scnName);
 
 	void SetOpenCLCompilerOpts(const OCLCompilerOpts opt, const bool enable);
+	// Runs the image validation on an OpenCL device used by the benchmark,
+	// if there is one
+	void SetOpenCLImageValidation(const bool enable) { oclImageValidation = enable; }
+	// Doesn't read the film until the end of the benchmark, so the image
+	// pipeline doesn't run while the score is measured
+	void SetNoDisplay(const bool enable);
+	// In single run mode, runs the benchmark with and then without display
+	// and prints the score difference
+	void SetCompareDisplay(const bool enable) { compareDisplay = enable; }
+	// The share of the wall time the display can take, e.g. 0.005 for 0.5%
+	void SetDisplayOverhead(const double share) { displayOverhead = share; }
+	// Reuses the scene of the last session when the next one renders the
+	// same scene, instead of loading it again (off by default)
+	void SetSceneCache(const bool enable) { useSceneCache = enable; }
 
 	bool IsSingleRun() const { return singleRun; }
+	// Tells the presenter the size of the preview shown by the main window
+	void UpdatePreviewSize();
 
 	const boost::filesystem::path &GetExePath() const { return exePath; }
 
@@ -70,6 +83,7 @@ private:
 	static void EngineInitThreadImpl(LuxMarkApp *app);
 
 	void InitRendering(LuxMarkAppMode mode, const char *scnName);
+	string RecordScore(const double sampleSec);
 
 	boost::filesystem::path exePath;
 
@@ -78,15 +92,25 @@ private:
 	bool singleRun, singleRunExtInfo;
 	
 	bool oclOptFastRelaxedMath, oclOptMadEnabled, oclOptStrictAliasing, oclOptNoSignedZeros;
+	bool oclImageValidation;
+	bool noDisplay, compareDisplay;
+	double displayOverhead;
+	bool useSceneCache;
+	// The last score of each scene and mode, with and without display
+	std::map<string, double> displayScores, noDisplayScores;
 
 	HardwareTreeModel *hardwareTreeModel;
 
 	boost::thread *engineInitThread;
-	double renderingStartTime, lastFrameBufferDenoisedUpdate;
+	double renderingStartTime;
 	bool engineInitDone;
 	LuxCoreRenderSession *luxSession;
+	// The scene of the last session, reused by the next one if it renders
+	// the same scene and useSceneCache is set
+	SceneCache sceneCache;
 
-	QTimer *renderRefreshTimer;
+	// Produces the shown frames once the engine is initialized
+	RenderPresenter *presenter;
 
 	bool mouseButton0;
 	bool mouseButton2;
@@ -95,7 +119,7 @@ private:
 	double lastMouseUpdate;
 
 private slots:
-	void RenderRefreshTimeout();
+	void PresenterFrameReady();
 };
 
 #endif // _LUXMARKAPP_H
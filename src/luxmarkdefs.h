@@ -43,6 +43,11 @@
 			
 using namespace std;
 
+// List of supported scenes
+#define SCENE_WALLPAPER "scenes/wallpaper/render.cfg"
+#define SCENE_HALLBENCH "scenes/hallbench/render.cfg"
+#define SCENE_FOOD "scenes/food/render.cfg"
+
 enum LuxMarkAppMode {
 	BENCHMARK_OCL_GPU,
 	BENCHMARK_OCL_CPUGPU,
@@ -106,4 +111,22 @@ inline string LuxMarkAppMode2String(const LuxMarkAppMode mode) {
 	}
 }
 
+inline bool IsBenchmarkMode(const LuxMarkAppMode mode) {
+	return (mode == BENCHMARK_OCL_GPU) ||
+			(mode == BENCHMARK_OCL_CPUGPU) ||
+			(mode == BENCHMARK_OCL_CPU) ||
+			(mode == BENCHMARK_OCL_CUSTOM) ||
+			(mode == BENCHMARK_HYBRID) ||
+			(mode == BENCHMARK_HYBRID_CUSTOM) ||
+			(mode == BENCHMARK_NATIVE);
+}
+
+inline bool IsStressTestMode(const LuxMarkAppMode mode) {
+	return (mode == STRESSTEST_OCL_GPU) ||
+			(mode == STRESSTEST_OCL_CPUGPU) ||
+			(mode == STRESSTEST_OCL_CPU) ||
+			(mode == STRESSTEST_HYBRID) ||
+			(mode == STRESSTEST_NATIVE);
+}
+
 #endif	/* _LUXMARKDEFS_H */
@@ -39,7 +39,12 @@ static void PrintCmdLineHelp(const QString &cmd) {
 				" (select the mode to use)" << endl <<
 			" --devices=<a string of 1 or 0 to enable/disable each OpenCL device in CUSTOM modes>" << endl <<
 			" --single-run (run the benchmark, print the result to the stdout and exit)" << endl <<
-			" --ext-info (print scene and image verification too with --single-run)" <<endl;
+			" --ext-info (print scene and image verification too with --single-run)" << endl <<
+			" --no-display (don't read the rendering until the end of the benchmark, so the score is measured without the display)" << endl <<
+			" --compare-display (with --single-run, run the benchmark with and then without display and print the score difference)" << endl <<
+			" --display-overhead=<percent> (the share of the time the display can take, the default is 0.5)" << endl <<
+			" --image-validation=OPENCL|CPU (run the image validation on the first OpenCL device used by the benchmark or on the CPU, the default)" << endl <<
+			" --scene-cache (keep the loaded scene across mode switches instead of loading it again)" << endl;
 }
 
 int main(int argc, char **argv) {
@@ -55,6 +60,11 @@ int main(int argc, char **argv) {
 	bool exit = false;
 	bool singleRun = false;
 	bool singleRunExtInfo = false;
+	bool oclImageValidation = false;
+	bool noDisplay = false;
+	bool compareDisplay = false;
+	double displayOverhead = 0.5;
+	bool sceneCache = false;
 
 	QStringList argsList = app.arguments();
 	QRegExp argHelp("--help");
@@ -69,6 +79,11 @@ int main(int argc, char **argv) {
 	QRegExp argDevices("--devices=([01]+)");
 	QRegExp argSingleRun("--single-run");
 	QRegExp argSingleRunExtInfo("--ext-info");
+	QRegExp argImageValidation("--image-validation=(OPENCL|CPU)");
+	QRegExp argNoDisplay("--no-display");
+	QRegExp argCompareDisplay("--compare-display");
+	QRegExp argDisplayOverhead("--display-overhead=([0-9]*\\.?[0-9]+)");
+	QRegExp argSceneCache("--scene-cache");
 
 	LuxMarkAppMode mode = BENCHMARK_OCL_GPU;
 	string devices="";
@@ -142,6 +157,22 @@ int main(int argc, char **argv) {
 			singleRun = true;
 		} else if (argSingleRunExtInfo.indexIn(argsList.at(i)) != -1 ) {   
 			singleRunExtInfo = true;
+		} else if (argImageValidation.indexIn(argsList.at(i)) != -1 ) {   
+			oclImageValidation = (argImageValidation.cap(1).compare("OPENCL", Qt::CaseInsensitive) == 0);
+		} else if (argNoDisplay.indexIn(argsList.at(i)) != -1 ) {   
+			noDisplay = true;
+		} else if (argCompareDisplay.indexIn(argsList.at(i)) != -1 ) {   
+			compareDisplay = true;
+		} else if (argDisplayOverhead.indexIn(argsList.at(i)) != -1 ) {   
+			displayOverhead = argDisplayOverhead.cap(1).toDouble();
+			if (displayOverhead <= 0.0) {
+				cerr << "The display overhead must be greater than 0: " << argDisplayOverhead.cap(1).toLatin1().data() << endl;
+				PrintCmdLineHelp(argsList.at(0));
+				exit = true;
+				break;
+			}
+		} else if (argSceneCache.indexIn(argsList.at(i)) != -1 ) {   
+			sceneCache = true;
         } else {
             cerr << "Unknown argument: " << argsList.at(i).toLatin1().data() << endl;
 			PrintCmdLineHelp(argsList.at(0));
@@ -155,9 +186,19 @@ int main(int argc, char **argv) {
 		exit = true;
 	}
 
+	if (compareDisplay && (!singleRun || singleRunExtInfo || noDisplay)) {
+		cerr << "Option --compare-display must be used with --single-run, without --ext-info and --no-display" << endl;
+		exit = true;
+	}
+
 	if (exit)
 		return EXIT_SUCCESS;
 	else {
+		app.SetOpenCLImageValidation(oclImageValidation);
+		app.SetNoDisplay(noDisplay);
+		app.SetCompareDisplay(compareDisplay);
+		app.SetDisplayOverhead(displayOverhead / 100.0);
+		app.SetSceneCache(sceneCache);
 		app.Init(mode, devices, scnName, singleRun, singleRunExtInfo);
 
 		// If current directory doesn't have the "scenes" directory, move
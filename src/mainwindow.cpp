@@ -43,6 +43,8 @@
 #include <QDateTime>
 #include <QTextStream>
 #include <QGraphicsItem>
+#include <QGraphicsSceneMouseEvent>
+#include <QPainter>
 
 #include "mainwindow.h"
 #include "aboutdialog.h"
@@ -65,13 +67,47 @@ LuxErrorEvent::LuxErrorEvent(QString msg) : QEvent((QEvent::Type)EVT_LUX_ERR_MES
 	setAccepted(false);
 }
 
+void MainWindowLogHandler(const std::string &msg, const bool isError) {
+	if (LogWindow) {
+		if (isError)
+			qApp->postEvent(LogWindow, new LuxErrorEvent(QString(msg.c_str())));
+		else
+			qApp->postEvent(LogWindow, new LuxLogEvent(QString(msg.c_str())));
+	}
+}
+
 //------------------------------------------------------------------------------
 
-LuxFrameBuffer::LuxFrameBuffer(const QPixmap &pixmap) : QGraphicsPixmapItem(pixmap) {
+LuxFrameBuffer::LuxFrameBuffer(MainWindow *win) : mainWin(win), image(NULL) {
 	setAcceptHoverEvents(true);
 	setFlag(QGraphicsItem::ItemIsSelectable, true);
 }
 
+void LuxFrameBuffer::SetImage(const QImage *img) {
+	if (!image || !img || (img->size() != image->size()))
+		prepareGeometryChange();
+
+	image = img;
+	update();
+}
+
+QRectF LuxFrameBuffer::boundingRect() const {
+	return image ? QRectF(QPointF(0.f, 0.f), image->size()) : QRectF();
+}
+
+void LuxFrameBuffer::paint(QPainter *painter, const QStyleOptionGraphicsItem *option,
+		QWidget *widget) {
+	if (image)
+		painter->drawImage(QPointF(0.f, 0.f), *image);
+}
+
+void LuxFrameBuffer::mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event) {
+	if (event->button() == Qt::LeftButton)
+		mainWin->ToggleFullResolution();
+	else
+		QGraphicsItem::mouseDoubleClickEvent(event);
+}
+
 //------------------------------------------------------------------------------
 
 MainWindow::MainWindow(QWidget *parent, Qt::WindowFlags flags) : QMainWindow(parent, flags),
@@ -82,7 +118,7 @@ MainWindow::MainWindow(QWidget *parent, Qt::WindowFlags flags) : QMainWindow(par
 	renderScene = new QGraphicsScene();
 	renderScene->setBackgroundBrush(QColor(127,127,127));
 	luxLogo = renderScene->addPixmap(QPixmap(":/images/resources/luxlogo_bg.png"));
-	luxFrameBuffer = new LuxFrameBuffer(QPixmap(":/images/resources/luxlogo_bg.png"));
+	luxFrameBuffer = new LuxFrameBuffer(this);
 	renderScene->addItem(luxFrameBuffer);
 
 	authorLabelBack = new QGraphicsSimpleTextItem(QString("Scene designed by LuxCoreRender project"));
@@ -104,9 +140,8 @@ MainWindow::MainWindow(QWidget *parent, Qt::WindowFlags flags) : QMainWindow(par
 
 	ui->RenderView->setScene(renderScene);
 
-	frameBuffer = NULL;
-	fbWidth = 0;
-	fbHeight = 0;
+	frontImage = 0;
+	fullResolution = false;
 
 	// Setup status bar
 	statusBarLabel = new QLabel(ui->statusbar);
@@ -135,7 +170,6 @@ MainWindow::~MainWindow() {
 	delete luxFrameBuffer;
 	delete luxLogo;
 	delete renderScene;
-	delete frameBuffer;
 
 }
 
@@ -287,6 +321,12 @@ void MainWindow::setOCLOpts_cl_no_signed_zeros(bool enable) {
 	((LuxMarkApp *)qApp)->SetOpenCLCompilerOpts(NO_SIGNED_ZEROS, enable);	
 }
 
+void MainWindow::setNoDisplay(bool enable) {
+	LM_LOG("Toggle benchmark without display");
+	((LuxMarkApp *)qApp)->SetMode(PAUSE);
+	((LuxMarkApp *)qApp)->SetNoDisplay(enable);
+}
+
 //------------------------------------------------------------------------------
 
 void MainWindow::Pause() {
@@ -295,7 +335,11 @@ void MainWindow::Pause() {
 }
 
 void MainWindow::ShowLogo() {
-	if (luxFrameBuffer->isVisible()) {
+	// The shown image can be freed after this call
+	luxFrameBuffer->SetImage(NULL);
+
+	// Only the statistics are visible without display
+	if (luxFrameBuffer->isVisible() || screenLabel->isVisible()) {
 		luxFrameBuffer->hide();
 		authorLabel->hide();
 		authorLabelBack->hide();
@@ -334,6 +378,10 @@ void MainWindow::SetModeCheck(const LuxMarkAppMode mode) {
 	ui->action_Pause->setChecked(mode == PAUSE);
 }
 
+void MainWindow::SetNoDisplayCheck(const bool noDisplay) {
+	ui->action_No_Display->setChecked(noDisplay);
+}
+
 void MainWindow::SetSceneCheck(const int index) {
 	if (index == 0) {
 		ui->action_WallPaper->setChecked(true);
@@ -382,52 +430,33 @@ bool MainWindow::IsShowingLogo() const {
 void MainWindow::ShowFrameBuffer(const float *frameBufferSrc,
 		const float *frameBufferDenoisedSrc,
 		const unsigned  int width, const unsigned  int height) {
-	if (luxLogo->isVisible())
-		luxLogo->hide();
+	// In stress tests the raw and the denoised renderings are shown side by
+	// side
+	const u_int shownWidth = frameBufferDenoisedSrc ? (2 * width) : width;
+
+	// The shown image is left untouched while the other one is written
+	const u_int backImage = 1 - frontImage;
+	QImage &image = frameImages[backImage];
 
 	// Check if I have to allocate a new frame buffer
-	if (!frameBuffer || (width != fbWidth) || (height != fbHeight)) {
-		delete frameBuffer;
-		fbWidth = width;
-		fbHeight = height;
-		frameBuffer = new unsigned char[fbWidth * fbHeight * 3];
-	}
+	if ((image.width() != (int)shownWidth) || (image.height() != (int)height))
+		image = QImage(shownWidth, height, QImage::Format_RGB32);
 
-	for (u_int y = 0; y < fbHeight; ++y) {
-		for (u_int x = 0; x < fbWidth; ++x) {
-			const u_int srcIndex = (x + y * fbWidth) * 3;
-			const u_int dstIndex = (x + (fbHeight - y - 1) * fbWidth) * 3;
-			frameBuffer[dstIndex] = (unsigned char)(Clamp(frameBufferSrc[srcIndex] * 255.f + .5f, 0.f, 255.f));
-			frameBuffer[dstIndex + 1] = (unsigned char)(Clamp(frameBufferSrc[srcIndex + 1] * 255.f + .5f, 0.f, 255.f));
-			frameBuffer[dstIndex + 2] = (unsigned char)(Clamp(frameBufferSrc[srcIndex + 2] * 255.f + .5f, 0.f, 255.f));
-		}
-	}
+	// Both images are converted in a single pass, directly in the rows of
+	// the QImage. RGB32 is drawn as it is, RGB888 would be converted on
+	// every paint.
+	displayConverter.ConvertFrameBuffer(frameBufferSrc, frameBufferDenoisedSrc,
+			width, height, image.bits(), image.bytesPerLine());
 
-	if (!frameBufferDenoisedSrc) {
-		luxFrameBuffer->setPixmap(QPixmap::fromImage(QImage(
-			frameBuffer, fbWidth, fbHeight, fbWidth * 3, QImage::Format_RGB888)));
-	} else {
-		vector<unsigned char> frameBufferTmp(2 * fbWidth * fbHeight * 3);
-		
-		for (u_int y = 0; y < fbHeight; ++y) {
-			for (u_int x = 0; x < fbWidth; ++x) {
-				const u_int srcIndex = (x + y * fbWidth) * 3;
-
-				const u_int dstIndexRaw = (x + y * fbWidth * 2) * 3;
-				frameBufferTmp[dstIndexRaw] = frameBuffer[srcIndex];
-				frameBufferTmp[dstIndexRaw + 1] = frameBuffer[srcIndex + 1];
-				frameBufferTmp[dstIndexRaw + 2] = frameBuffer[srcIndex + 2];
-
-				const u_int dstIndexDenoised = (fbWidth + x + (fbHeight - y - 1) * fbWidth * 2) * 3;
-				frameBufferTmp[dstIndexDenoised] = (unsigned char)(Clamp(frameBufferDenoisedSrc[srcIndex] * 255.f + .5f, 0.f, 255.f));
-				frameBufferTmp[dstIndexDenoised + 1] = (unsigned char)(Clamp(frameBufferDenoisedSrc[srcIndex + 1] * 255.f + .5f, 0.f, 255.f));
-				frameBufferTmp[dstIndexDenoised + 2] = (unsigned char)(Clamp(frameBufferDenoisedSrc[srcIndex + 2] * 255.f + .5f, 0.f, 255.f));
-			}
-		}	
-
-		luxFrameBuffer->setPixmap(QPixmap::fromImage(QImage(
-			&frameBufferTmp[0], 2 * fbWidth, fbHeight, 2 * fbWidth * 3, QImage::Format_RGB888)));
-	}
+	frontImage = backImage;
+	ShowFrameImage(&image, frameBufferDenoisedSrc != NULL);
+}
+
+void MainWindow::ShowFrameImage(const QImage *image, const bool hasDenoised) {
+	if (luxLogo->isVisible())
+		luxLogo->hide();
+
+	luxFrameBuffer->SetImage(image);
 
 	if (!luxFrameBuffer->isVisible()) {
 		luxFrameBuffer->show();
@@ -438,7 +467,7 @@ void MainWindow::ShowFrameBuffer(const float *frameBufferSrc,
 		screenLabel->show();
 	}
 
-	raw2denoisedLabel->setVisible(frameBufferDenoisedSrc != NULL);
+	raw2denoisedLabel->setVisible(hasDenoised);
 
 	UpdateScreenLabelPosition();
 
@@ -448,6 +477,20 @@ void MainWindow::ShowFrameBuffer(const float *frameBufferSrc,
 	//LM_LOG("Screen updated");
 }
 
+void MainWindow::ShowStats() {
+	if (luxLogo->isVisible())
+		luxLogo->hide();
+
+	luxFrameBuffer->SetImage(NULL);
+
+	if (!screenLabel->isVisible()) {
+		screenLabelBack->show();
+		screenLabel->show();
+	}
+
+	UpdateScreenLabelPosition();
+}
+
 void MainWindow::SetHardwareTreeModel(HardwareTreeModel *treeModel) {
 	if (!ui->HardwareView->model()) {
 		ui->HardwareView->setModel(treeModel);
@@ -455,6 +498,26 @@ void MainWindow::SetHardwareTreeModel(HardwareTreeModel *treeModel) {
 	}
 }
 
+void MainWindow::GetPreviewSize(u_int *width, u_int *height) const {
+	if (fullResolution) {
+		*width = 0;
+		*height = 0;
+	} else {
+		// Leave room for the statistics under the image
+		const QSize viewSize = ui->RenderView->viewport()->size();
+		*width = Max(viewSize.width(), 1);
+		*height = Max(viewSize.height() - (int)screenLabel->boundingRect().height(), 1);
+	}
+}
+
+void MainWindow::ToggleFullResolution() {
+	fullResolution = !fullResolution;
+	LM_LOG("Rendering shown at " << (fullResolution ? "full resolution" : "preview resolution") <<
+			" from the next refresh");
+
+	((LuxMarkApp *)qApp)->UpdatePreviewSize();
+}
+
 bool MainWindow::event(QEvent *event) {
 	bool retval = false;
 	int eventtype = event->type();
@@ -503,8 +566,8 @@ void MainWindow::UpdateScreenLabel(const char *msg) {
 }
 
 void MainWindow::UpdateScreenLabelPosition() {
-	const int pixmapWidth = luxFrameBuffer->pixmap().width();
-	const int pixmapHeight = luxFrameBuffer->pixmap().height();
+	const int pixmapWidth = luxFrameBuffer->boundingRect().width();
+	const int pixmapHeight = luxFrameBuffer->boundingRect().height();
 
 	screenLabel->setBrush(Qt::blue);
 	screenLabel->setPos(0.f, pixmapHeight);
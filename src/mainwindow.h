@@ -31,15 +31,37 @@
 #include "ui_mainwindow.h"
 #include "hardwaretree.h"
 #include "luxmarkdefs.h"
+#include "core/luxmarklog.h"
+#include "display/rgbconverter.h"
 
 #include <QGraphicsPixmapItem>
+#include <QImage>
 #endif
 
 class LuxMarkApp;
+class MainWindow;
 
-class LuxFrameBuffer : public QGraphicsPixmapItem {
+// Draws the image updated in place by MainWindow::ShowFrameBuffer(), so no
+// QPixmap is created at each refresh. A double click switches between the
+// preview and the full resolution.
+class LuxFrameBuffer : public QGraphicsItem {
 public:
-	LuxFrameBuffer(const QPixmap &pixmap);
+	LuxFrameBuffer(MainWindow *mainWin);
+
+	// The image must stay valid until the next call
+	void SetImage(const QImage *image);
+	const QImage *GetImage() const { return image; }
+
+	QRectF boundingRect() const;
+	void paint(QPainter *painter, const QStyleOptionGraphicsItem *option,
+			QWidget *widget);
+
+protected:
+	void mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event);
+
+private:
+	MainWindow *mainWin;
+	const QImage *image;
 };
 
 class MainWindow : public QMainWindow {
@@ -54,15 +76,28 @@ public:
 	void ShowFrameBuffer(const float *frameBuffer,
 		const float *frameBufferDenoisedSrc,
 		const unsigned int width, const unsigned int height);
-	const unsigned char *GetFrameBuffer() const { return frameBuffer; }
+	// Shows an image already converted (e.g. by RenderPresenter), it must
+	// stay valid until the next call. hasDenoised tells if it holds the raw
+	// and the denoised renderings side by side.
+	void ShowFrameImage(const QImage *image, const bool hasDenoised);
+	// Shows only the statistics label, when the rendering isn't displayed
+	void ShowStats();
+	// The shown image, NULL if none has been shown yet
+	const QImage *GetFrameImage() const { return luxFrameBuffer->GetImage(); }
 
 	void SetModeCheck(const LuxMarkAppMode mode);
+	void SetNoDisplayCheck(const bool noDisplay);
 	void SetSceneCheck(const int index);
 	void UpdateSceneLabel(const char *name);
 	void UpdateScreenLabel(const char *msg);
 	void UpdateScreenLabelPosition();
 	void SetHardwareTreeModel(HardwareTreeModel *treeModel);
 
+	// The area where the rendering preview has to fit, 0 x 0 when the full
+	// resolution is shown
+	void GetPreviewSize(u_int *width, u_int *height) const;
+	void ToggleFullResolution();
+
 	void Pause();
 
 private:
@@ -70,9 +105,16 @@ private:
 
 	Ui::MainWindow *ui;
 	QGraphicsPixmapItem *luxLogo;
-	QGraphicsPixmapItem *luxFrameBuffer;
-	unsigned char *frameBuffer;
-	unsigned int fbWidth, fbHeight;
+	LuxFrameBuffer *luxFrameBuffer;
+	// The shown image and the one written by the next refresh. They are
+	// allocated only when the size changes and written in place, so a
+	// refresh allocates nothing.
+	QImage frameImages[2];
+	u_int frontImage;
+	// The film output is already gamma corrected by the image pipeline
+	lux::RGB888Converter displayConverter;
+	// Set by a double click on the rendering, the preview is shown otherwise
+	bool fullResolution;
 	QGraphicsSimpleTextItem *authorLabel;
 	QGraphicsSimpleTextItem *authorLabelBack;
 	QGraphicsSimpleTextItem *raw2denoisedLabel;
@@ -109,6 +151,8 @@ private slots:
 	void setOCLOpts_cl_mad_enable(bool enable);
 	void setOCLOpts_cl_strict_aliasing(bool enable);
 	void setOCLOpts_cl_no_signed_zeros(bool enable);
+
+	void setNoDisplay(bool enable);
 };
 
 //------------------------------------------------------------------------------
@@ -117,6 +161,9 @@ private slots:
 
 extern MainWindow *LogWindow;
 
+// The log handler of the GUI, it posts the messages to LogWindow
+extern void MainWindowLogHandler(const std::string &msg, const bool isError);
+
 class LuxLogEvent: public QEvent {
 public:
 	LuxLogEvent(QString mesg);
@@ -137,11 +184,4 @@ private:
 	QString message;
 };
 
-#define LM_LOG(a) { if (LogWindow) { std::stringstream _LM_LOG_LOCAL_SS; _LM_LOG_LOCAL_SS << a; qApp->postEvent(LogWindow, new LuxLogEvent(QString(_LM_LOG_LOCAL_SS.str().c_str()))); }}
-#define LM_LOG_LUXRAYS(a) { LM_LOG("<FONT COLOR=\"#002200\"><B>[LuxRays]</B></FONT> " << a); }
-#define LM_LOG_SDL(a) { LM_LOG("<FONT COLOR=\"#005500\"><B>[SDL]</B></FONT> " << a); }
-#define LM_LOG_LUXCORE(a) { LM_LOG("<FONT COLOR=\"#009900\"><B>[LuxCore]</B></FONT> " << a); }
-
-#define LM_ERROR(a) { if (LogWindow) { std::stringstream _LM_ERR_LOCAL_SS; _LM_ERR_LOCAL_SS << a; qApp->postEvent(LogWindow, new LuxErrorEvent(QString(_LM_ERR_LOCAL_SS.str().c_str()))); }}
-
 #endif	/* _MAINWINDOW_H */
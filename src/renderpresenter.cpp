@@ -0,0 +1,367 @@
+/***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: https://www.luxcorerender.org                        *
+ ***************************************************************************/
+
+#include <cstdio>
+#include <cstring>
+#include <limits>
+
+#include <boost/bind.hpp>
+#include <boost/algorithm/string/predicate.hpp>
+
+#if defined(__linux__)
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#elif defined(__APPLE__)
+#include <pthread.h>
+#endif
+
+#include "renderpresenter.h"
+#include "core/benchmarkrunner.h"
+#include "core/luxmarklog.h"
+
+using namespace luxrays;
+
+//------------------------------------------------------------------------------
+// RenderPresenter
+//------------------------------------------------------------------------------
+
+RenderPresenter::RenderPresenter(const LuxMarkAppMode m, const double overheadShare,
+		const bool disp) :
+		mode(m), isStressTest(IsStressTestMode(m)),
+		display(disp), session(NULL), scheduler(overheadShare),
+		converter(false), shownImage(-1), readyImage(-1), hasReadyFrame(false), previewWidth(0),
+		previewHeight(0), presenterThread(NULL), stopRequested(false) {
+}
+
+RenderPresenter::~RenderPresenter() {
+	Stop();
+}
+
+void RenderPresenter::Start(LuxCoreRenderSession *s) {
+	Stop();
+
+	session = s;
+	scheduler.EnableTask(REFRESH_FRAME, display);
+	scheduler.EnableTask(REFRESH_DENOISER, display && isStressTest);
+	scheduler.Start(WallClockTime());
+	lastImageFrame = PresenterFrame();
+	stopRequested = false;
+	presenterThread = new boost::thread(boost::bind(RenderPresenter::PresenterThreadImpl, this));
+}
+
+void RenderPresenter::Stop() {
+	if (presenterThread) {
+		{
+			boost::unique_lock<boost::mutex> lock(presenterMutex);
+			stopRequested = true;
+		}
+		stopCondition.notify_all();
+
+		presenterThread->join();
+		delete presenterThread;
+		presenterThread = NULL;
+	}
+}
+
+void RenderPresenter::SetPreviewSize(const u_int width, const u_int height) {
+	boost::unique_lock<boost::mutex> lock(presenterMutex);
+	previewWidth = width;
+	previewHeight = height;
+}
+
+u_int RenderPresenter::GetPreviewScale(const u_int shownWidth, const u_int height) {
+	boost::unique_lock<boost::mutex> lock(presenterMutex);
+	if ((previewWidth == 0) || (previewHeight == 0))
+		return 1;
+
+	// The smallest integer factor fitting the preview area
+	const u_int scaleX = (shownWidth + previewWidth - 1) / previewWidth;
+	const u_int scaleY = (height + previewHeight - 1) / previewHeight;
+
+	return Max<u_int>(1, Max(scaleX, scaleY));
+}
+
+bool RenderPresenter::AcquireFrame(PresenterFrame &frame) {
+	boost::unique_lock<boost::mutex> lock(presenterMutex);
+	if (!hasReadyFrame)
+		return false;
+
+	// The previously shown image can now be written again
+	if (readyImage >= 0)
+		shownImage = readyImage;
+	readyImage = -1;
+	frame = readyFrame;
+	hasReadyFrame = false;
+
+	return true;
+}
+
+void RenderPresenter::SetLowPriority() {
+	// The presenter must not slow down the rendering threads
+#if defined(WIN32)
+	SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_BELOW_NORMAL);
+#elif defined(__linux__)
+	// Each Linux thread has its own nice value
+	setpriority(PRIO_PROCESS, syscall(SYS_gettid), 10);
+#elif defined(__APPLE__)
+	pthread_set_qos_class_self_np(QOS_CLASS_UTILITY, 0);
+#endif
+}
+
+void RenderPresenter::PresenterThreadImpl(RenderPresenter *presenter) {
+	SetLowPriority();
+
+	try {
+		boost::unique_lock<boost::mutex> lock(presenter->presenterMutex);
+		for (;;) {
+			const double waitTime = Max(presenter->scheduler.GetNextTime() - WallClockTime(), 0.0);
+			const boost::system_time timeout = boost::get_system_time() +
+					boost::posix_time::milliseconds((long)(waitTime * 1000.0));
+			while (!presenter->stopRequested) {
+				if (!presenter->stopCondition.timed_wait(lock, timeout))
+					break;
+			}
+			if (presenter->stopRequested)
+				break;
+
+			lock.unlock();
+			const bool done = presenter->Refresh();
+			emit presenter->frameReady();
+			lock.lock();
+
+			if (done)
+				break;
+		}
+	} catch (runtime_error err) {
+		LM_ERROR("RUNTIME ERROR: " << err.what());
+	} catch (exception err) {
+		LM_ERROR("ERROR: " << err.what());
+	}
+}
+
+bool RenderPresenter::Refresh() {
+	const double startTime = WallClockTime();
+	const bool denoiserDue = scheduler.IsDue(REFRESH_DENOISER, startTime);
+	// A new denoised image is shown at once
+	const bool frameDue = denoiserDue || scheduler.IsDue(REFRESH_FRAME, startTime);
+
+	// The statistics are read at each refresh
+	const Properties &stats = session->GetStats();
+	const u_int width = session->GetFrameBufferWidth();
+	const u_int height = session->GetFrameBufferHeight();
+
+	PresenterFrame frame;
+	frame.renderingTime = stats.Get("stats.renderengine.time").Get<double>();
+	frame.screenLabel = FormatStats(stats, width, height, frame);
+	if (!display)
+		frame.screenLabel += "\n\n[No display, the rendering is shown at the end of the benchmark]";
+	scheduler.Done(REFRESH_STATS, startTime, WallClockTime());
+
+	const int target = frameDue ? RefreshImage(width, height, denoiserDue, frame) : -1;
+	if (target < 0) {
+		// Keep showing the last image
+		frame.image = lastImageFrame.image;
+		frame.hasDenoised = lastImageFrame.hasDenoised;
+		frame.scale = lastImageFrame.scale;
+	}
+
+	if (frame.image && (frame.scale > 1)) {
+		char buf[128];
+		sprintf(buf, "\n\n[Preview at 1:%d, double click the image for the full resolution]", frame.scale);
+		frame.screenLabel += buf;
+	}
+	frame.overheadReport = scheduler.GetReport(WallClockTime());
+
+	boost::unique_lock<boost::mutex> lock(presenterMutex);
+	if (target >= 0)
+		readyImage = target;
+	else if (hasReadyFrame && readyFrame.imageUpdated) {
+		// The GUI hasn't taken the last image yet
+		frame.imageUpdated = true;
+	}
+	readyFrame = frame;
+	hasReadyFrame = true;
+
+	return frame.benchmarkDone;
+}
+
+int RenderPresenter::RefreshImage(const u_int width, const u_int height,
+		const bool updateDenoised, PresenterFrame &frame) {
+	double startTime = WallClockTime();
+	const float *frameBufferDenoised = NULL;
+	if (isStressTest) {
+		if (updateDenoised) {
+			frameBufferDenoised = session->UpdateFrameBuffer(1);
+
+			const double endTime = WallClockTime();
+			scheduler.Done(REFRESH_DENOISER, startTime, endTime);
+			startTime = endTime;
+		} else
+			frameBufferDenoised = session->GetFrameBufferPtr(1);
+	}
+
+	const float *frameBuffer = session->UpdateFrameBuffer(0);
+	if (!frameBuffer) {
+		// The attempt is recorded too, otherwise the refresh stays due and
+		// it is retried in a busy loop until the film is available
+		scheduler.Done(REFRESH_FRAME, startTime, WallClockTime());
+		return -1;
+	}
+
+	// Look for an image neither shown nor ready
+	int target = 0;
+	{
+		boost::unique_lock<boost::mutex> lock(presenterMutex);
+		while ((target == shownImage) || (target == readyImage))
+			++target;
+	}
+
+	// In stress tests the raw and the denoised renderings are shown side by
+	// side. A film larger than the view is box filtered down to the view
+	// size while it is converted, instead of converting (and drawing) all
+	// its pixels.
+	const u_int scale = GetPreviewScale(frameBufferDenoised ? (2 * width) : width, height);
+	const u_int scaledWidth = RGB888Converter::GetScaledSize(width, scale);
+	const u_int scaledHeight = RGB888Converter::GetScaledSize(height, scale);
+	const u_int shownWidth = frameBufferDenoised ? (2 * scaledWidth) : scaledWidth;
+	QImage &image = images[target];
+	if ((image.width() != (int)shownWidth) || (image.height() != (int)scaledHeight))
+		image = QImage(shownWidth, scaledHeight, QImage::Format_RGB32);
+	converter.ConvertFrameBufferScaled(frameBuffer, frameBufferDenoised,
+			width, height, scale, image.bits(), image.bytesPerLine());
+
+	frame.image = &image;
+	frame.imageUpdated = true;
+	frame.hasDenoised = (frameBufferDenoised != NULL);
+	frame.scale = scale;
+	lastImageFrame = frame;
+
+	scheduler.Done(REFRESH_FRAME, startTime, WallClockTime());
+
+	return target;
+}
+
+string RenderPresenter::FormatStats(const Properties &stats, const u_int width,
+		const u_int height, PresenterFrame &frame) const {
+	const double renderingTime = frame.renderingTime;
+	const double sampleCount = stats.Get("stats.renderengine.total.samplecount").Get<double>();
+	const double sampleSec = GetSampleSec(stats);
+
+	vector<string> deviceNames;
+	vector<double> deviceRaysSecs;
+	vector<double> deviceMem, deviceMaxMem;
+	vector<bool> deviceIsOpenCL;
+	bool hasOpenCLDevices = false;
+	bool hasNativeDevices = false;
+	double triangleCount = 0.0;
+	double minPerf = 0.0;
+	double totalPerf = 0.0;
+
+	triangleCount = stats.Get("stats.dataset.trianglecount").Get<double>();
+
+	// Get each device statistics
+	minPerf = numeric_limits<double>::infinity();
+	const Property &devNames = stats.Get("stats.renderengine.devices");
+	for (u_int i = 0; i < devNames.GetSize(); ++i) {
+		const string deviceName = devNames.Get<string>(i);
+		deviceNames.push_back(deviceName);
+
+		const double raySecs = stats.Get("stats.renderengine.devices." + deviceName + ".performance.total").Get<double>();
+		deviceRaysSecs.push_back(raySecs);
+		deviceMaxMem.push_back(stats.Get("stats.renderengine.devices." + deviceName + ".memory.total").Get<double>());
+		deviceMem.push_back(stats.Get("stats.renderengine.devices." + deviceName + ".memory.used").Get<double>());
+
+		minPerf = Min(raySecs, minPerf);
+		totalPerf += raySecs;
+		
+		const bool isOpenCLDevice = boost::starts_with(deviceName, "NativeIntersect") ? false : true;
+		deviceIsOpenCL.push_back(isOpenCLDevice);
+		hasOpenCLDevices = (hasOpenCLDevices || isOpenCLDevice);
+		hasNativeDevices = (hasNativeDevices || !isOpenCLDevice);
+	}
+
+	// Get the list of device names
+	// After 120secs of benchmark, show the result dialog
+	const bool benchmarkDone = IsBenchmarkDone(mode, renderingTime);
+
+	char buf[512];
+	stringstream ss("");
+
+	char validBuf[128];
+	if (benchmarkDone)
+		strcpy(validBuf, " (OK)");
+	else {
+		if (!isStressTest)
+			sprintf(validBuf, " (%dsecs remaining)", Max<int>(BENCHMARK_TIME - renderingTime, 0));
+		else
+			strcpy(validBuf, "");
+	}
+
+	char triCountBuf[128];
+	if (triangleCount > 0.0)
+		sprintf(triCountBuf, "[Rays/sec % 6dK on %.1fK tris]",
+			int(totalPerf / 1000.0), triangleCount / 1000.0);
+	else
+		strcpy(triCountBuf, "");
+
+	sprintf(buf, "[Mode: %s][Time: %dsecs%s][Samples/sec % 6dK][Samples/pixel %.1f]%s",
+			LuxMarkAppMode2String(mode).c_str(),
+			int(renderingTime), validBuf, int(sampleSec / 1000.0),
+			sampleCount / (width * height),
+			triCountBuf);
+	ss << buf;
+
+	if (hasOpenCLDevices) {
+		ss << "\n\nOpenCL rendering devices:";
+		for (size_t i = 0; i < deviceNames.size(); ++i) {
+			if (deviceIsOpenCL[i]) {
+				sprintf(buf, "\n    [%s][Rays/sec % 3dK][Prf Idx %.2f][Wrkld %.1f%%][Mem %.1fM/%dM]",
+						deviceNames[i].c_str(),
+						int(deviceRaysSecs[i] / 1000.0),
+						(minPerf > 0.0) ? (deviceRaysSecs[i] / minPerf) : 0.f,
+						(totalPerf > 0.0) ? (100.0 * deviceRaysSecs[i] / totalPerf) : 0.f,
+						deviceMem[i] / (1024 * 1024), int(deviceMaxMem[i] / (1024 * 1024)));
+				ss << buf;
+			}
+		}
+	}
+	
+	if (hasNativeDevices) {
+		ss << "\n\nNative C++ rendering devices:";
+		for (size_t i = 0; i < deviceNames.size(); ++i) {
+			if (!deviceIsOpenCL[i]) {
+				sprintf(buf, "\n    [%s][Rays/sec % 3dK][Prf Idx %.2f][Wrkld %.1f%%][Mem %.1fM/%dM]",
+						deviceNames[i].c_str(),
+						int(deviceRaysSecs[i] / 1000.0),
+						(minPerf > 0.0) ? (deviceRaysSecs[i] / minPerf) : 0.f,
+						(totalPerf > 0.0) ? (100.0 * deviceRaysSecs[i] / totalPerf) : 0.f,
+						deviceMem[i] / (1024 * 1024), int(deviceMaxMem[i] / (1024 * 1024)));
+				ss << buf;
+			}
+		}
+	}
+
+	frame.sampleSec = sampleSec;
+	frame.benchmarkDone = benchmarkDone;
+
+	return ss.str();
+}
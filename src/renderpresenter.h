@@ -0,0 +1,147 @@
+/***************************************************************************
+ *   Copyright (C) 1998-2019 by authors (see AUTHORS.txt)                  *
+ *                                                                         *
+ *   This file is part of LuxMark.                                         *
+ *                                                                         *
+ *   LuxMark is free software; you can redistribute it and/or modify       *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 3 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   LuxMark is distributed in the hope that it will be useful,            *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>. *
+ *                                                                         *
+ *   LuxMark website: https://www.luxcorerender.org                        *
+ ***************************************************************************/
+
+#ifndef _RENDERPRESENTER_H
+#define	_RENDERPRESENTER_H
+
+#ifndef Q_MOC_RUN
+#include <string>
+
+#include <boost/thread.hpp>
+
+#include <QObject>
+#include <QImage>
+
+#include "luxmarkdefs.h"
+#include "core/luxcorerendersession.h"
+#include "core/refreshscheduler.h"
+#include "display/rgbconverter.h"
+#endif
+
+// A snapshot of the rendering, ready to be shown
+class PresenterFrame {
+public:
+	PresenterFrame() : image(NULL), imageUpdated(false), hasDenoised(false), scale(1),
+		renderingTime(0.0), sampleSec(0.0), benchmarkDone(false) { }
+
+	// The raw rendering, with the denoised one side by side if hasDenoised.
+	// It is NULL when the presenter doesn't display the rendering.
+	const QImage *image;
+	// False if the frame has only new statistics, with the previous image
+	bool imageUpdated;
+	bool hasDenoised;
+	// The image is box filtered down by this factor when it is a preview
+	u_int scale;
+	// The statistics shown under the image
+	string screenLabel;
+	double renderingTime, sampleSec;
+	// True after 120secs of benchmark, it is the last frame produced
+	bool benchmarkDone;
+	// The time spent producing the frames, see RefreshScheduler::GetReport()
+	string overheadReport;
+};
+
+//------------------------------------------------------------------------------
+// RenderPresenter
+//
+// Fetches the film output and the statistics of a rendering session in a low
+// priority thread and turns them into the shown image and text, so the GUI
+// thread never runs the image pipeline, the denoiser or the conversion. Each
+// new frame is signaled with frameReady(), to be connected with a queued
+// connection: the GUI thread then only has to show it.
+//
+// The statistics, the image and the denoised image are refreshed by a
+// RefreshScheduler, keeping their cost under overheadShare of the wall
+// time.
+//
+// Without display, the film is never read: the frames have only the
+// statistics, so LuxCore doesn't run the image pipeline while the benchmark
+// is measured.
+//------------------------------------------------------------------------------
+
+class RenderPresenter : public QObject {
+	Q_OBJECT
+
+public:
+	RenderPresenter(const LuxMarkAppMode mode, const double overheadShare,
+			const bool display = true);
+	~RenderPresenter();
+
+	// Starts producing the frames of the session, it can be called from any
+	// thread
+	void Start(LuxCoreRenderSession *session);
+	// Waits for the end of the presenter thread, the session can then be
+	// used again by the caller
+	void Stop();
+
+	// The next frames are scaled down to fit the width x height area, 0 x 0
+	// means at full resolution. It can be called from any thread.
+	void SetPreviewSize(const u_int width, const u_int height);
+
+	// Takes the last frame produced, returns false if there is no new one.
+	// The image of the frame stays valid until the next call.
+	bool AcquireFrame(PresenterFrame &frame);
+
+signals:
+	void frameReady();
+
+private:
+	static void PresenterThreadImpl(RenderPresenter *presenter);
+	static void SetLowPriority();
+
+	// Produces a frame with the tasks due, returns true if it is the last
+	// one
+	bool Refresh();
+	// Writes the image to show, returns its index or -1 if there isn't a
+	// film output to show yet
+	int RefreshImage(const u_int width, const u_int height, const bool updateDenoised,
+			PresenterFrame &frame);
+	u_int GetPreviewScale(const u_int shownWidth, const u_int height);
+	string FormatStats(const luxrays::Properties &stats, const u_int width,
+			const u_int height, PresenterFrame &frame) const;
+
+	const LuxMarkAppMode mode;
+	const bool isStressTest;
+	const bool display;
+	LuxCoreRenderSession *session;
+	// Only used by the presenter thread
+	RefreshScheduler scheduler;
+	PresenterFrame lastImageFrame;
+
+	RGB888Converter converter;
+	// The image shown by the GUI, the ready one and the one being written.
+	// An image is written only if it is neither shown nor ready, so it is
+	// allocated only when the film size changes.
+	QImage images[3];
+	int shownImage, readyImage;
+	bool hasReadyFrame;
+	PresenterFrame readyFrame;
+	u_int previewWidth, previewHeight;
+
+	boost::thread *presenterThread;
+	// Protects the images indices, readyFrame, the preview size and
+	// stopRequested
+	boost::mutex presenterMutex;
+	boost::condition_variable stopCondition;
+	bool stopRequested;
+};
+
+#endif	/* _RENDERPRESENTER_H */
@@ -19,26 +19,19 @@
  *   LuxMark website: https://www.luxcorerender.org                        *
  ***************************************************************************/
 
-#include <QFile>
-#include <QCryptographicHash>
-
-#include <boost/foreach.hpp>
-
-#include "convtest/convtest.h"
+#include "core/benchmarkvalidation.h"
 #include "luxmarkcfg.h"
 #include "resultdialog.h"
 #include "submitdialog.h"
 #include "luxmarkapp.h"
 
-static QString Path2QString(const boost::filesystem::path &fileName) {
-	return QString::fromStdWString(fileName.generic_wstring());
-}
-
 ResultDialog::ResultDialog(const LuxMarkAppMode m,
 		const char *scnName, const double sampSec,
 		const vector<BenchmarkDeviceDescription> ds,
-		const unsigned char *fb,
+		const float *fb,
 		const u_int width, const u_int height,
+		const string &overhead,
+		const bool oclValidation,
 		const bool singleRun,
 		QWidget *parent) : QDialog(parent),
 		ui(new Ui::ResultDialog), mode(m), descs(ds) {
@@ -47,6 +40,8 @@ ResultDialog::ResultDialog(const LuxMarkAppMode m,
 	frameBuffer = fb;
 	frameBufferWidth = width;
 	frameBufferHeight = height;
+	overheadReport = overhead;
+	oclImageValidation = oclValidation;
 	sceneValidationDone = false;
 	sceneValidationOk = false;
 	imageValidationDone = false;
@@ -72,6 +67,7 @@ ResultDialog::ResultDialog(const LuxMarkAppMode m,
     }
 
 	ui->resultLCD->display(int(sampleSec / 1000.0));
+	ui->displayOverhead->setText(overheadReport.c_str());
 
 	// Results submit is disabled for the moment
 	ui->submitButton->setVisible(false);
@@ -85,9 +81,7 @@ ResultDialog::ResultDialog(const LuxMarkAppMode m,
 			this, SLOT(setImageValidationLabel(const QString &, const bool, const bool)));
 
 	// Check if it is one of the official benchmarks
-	if ((strcmp(sceneName, SCENE_FOOD) == 0) ||
-			(strcmp(sceneName, SCENE_HALLBENCH) == 0) ||
-			(strcmp(sceneName, SCENE_WALLPAPER) == 0)) {
+	if (IsOfficialScene(sceneName)) {
 		// Start the md5 validation thread
 		md5Thread = new boost::thread(boost::bind(ResultDialog::MD5ThreadImpl, this));
 
@@ -122,6 +116,7 @@ void ResultDialog::PrintExtInfoAndExit() {
 	cout << "Score: " << int(sampleSec / 1000.0) << endl;
 	cout << "Scene validation: " << (sceneValidationOk ? "Ok" : "Failed") << endl;
 	cout << "Image validation: " << (imageValidationOk ? "Ok" : "Failed") << endl;
+	cout << "Display overhead: " << overheadReport << endl;
 
 	exit(EXIT_SUCCESS);
 }
@@ -139,9 +134,7 @@ void ResultDialog::setSceneValidationLabel(const QString &text,
 		ui->sceneValidation->setStyleSheet("QLabel { color : green; }");
 
 		// Check if I can enable submit button
-		if (imageValidationOk && ((strcmp(sceneName, SCENE_WALLPAPER) == 0) ||
-				(strcmp(sceneName, SCENE_HALLBENCH) == 0) ||
-				(strcmp(sceneName, SCENE_FOOD) == 0)))
+		if (imageValidationOk && IsOfficialScene(sceneName))
 			ui->submitButton->setEnabled(true);
 	} else
 		ui->sceneValidation->setStyleSheet("QLabel { color : red; }");
@@ -161,10 +154,7 @@ void ResultDialog::setImageValidationLabel(const QString &text,
 		ui->imageValidation->setStyleSheet("QLabel { color : green; }");
 
 		// Check if I can enable submit button
-        if (sceneValidationOk &&
-                ((strcmp(sceneName, SCENE_WALLPAPER) == 0) ||
-				(strcmp(sceneName, SCENE_HALLBENCH) == 0) ||
-				(strcmp(sceneName, SCENE_FOOD) == 0)))
+        if (sceneValidationOk && IsOfficialScene(sceneName))
 			ui->submitButton->setEnabled(true);
 	} else
 		ui->imageValidation->setStyleSheet("QLabel { color : red; }");
@@ -177,23 +167,12 @@ void ResultDialog::setImageValidationLabel(const QString &text,
 		PrintExtInfoAndExit();
 }
 
-void ResultDialog::AddSceneFiles(ResultDialog *resultDialog,
-		vector<boost::filesystem::path> &files, const boost::filesystem::path &path) {
-    for (boost::filesystem::directory_iterator it(path); it != boost::filesystem::directory_iterator(); ++it) {
-		const boost::filesystem::path &fileName = it->path();
-
-		if (boost::filesystem::is_regular_file(fileName)) {
-			// Check if it is one of the scene file extensions or reference images
-			const string ext = fileName.extension().generic_string();
-			if ((ext == ".cfg") || (ext == ".scn") || (ext == ".ply") ||
-					(ext == ".pgi") || (ext == ".exr") || (ext == ".png") ||
-					(ext == ".raw")) {
-				const QString label(("Selecting file [" + fileName.filename().generic_string() + "]").c_str());
-				emit resultDialog->sceneValidationLabelChanged(label, false, false);
-				files.push_back(fileName);
-			}
-		}
-	}
+void ResultDialog::SceneValidationProgress(const string &msg) {
+	emit sceneValidationLabelChanged(msg.c_str(), false, false);
+}
+
+void ResultDialog::ImageValidationProgress(const string &msg) {
+	emit imageValidationLabelChanged(msg.c_str(), false, false);
 }
 
 void ResultDialog::MD5ThreadImpl(ResultDialog *resultDialog) {
@@ -201,63 +180,10 @@ void ResultDialog::MD5ThreadImpl(ResultDialog *resultDialog) {
 	emit resultDialog->sceneValidationLabelChanged("Starting...", false, false);
 
 	try {
-		// Extract the scene directory name
-		boost::filesystem::path scenePath = boost::filesystem::path(resultDialog->sceneName).parent_path();
-		LM_LOG("MD5 validation scene path: [" << scenePath << "]");
-
-		// Build the list of files to validate
-		vector<boost::filesystem::path> files;
-		AddSceneFiles(resultDialog, files, scenePath);
-        sort(files.begin(), files.end());
-		LM_LOG("MD5 validation selected files: [" << scenePath << "]");
-		BOOST_FOREACH(boost::filesystem::path fileName, files) {
-			LM_LOG("  [" << fileName << "]");
-		}
-
-		// Validate each file
-		QCryptographicHash hash(QCryptographicHash::Md5);
-		LM_LOG("MD5 validated files: [" << scenePath << "]");
-		BOOST_FOREACH(boost::filesystem::path fileName, files) {
-			LM_LOG("  [" << fileName << "]");
-
-			const QString label(("Validating file [" + fileName.filename().generic_string() + "]").c_str());
-			emit resultDialog->sceneValidationLabelChanged(label, false, false);
-
-			// Read all file
-            const QString fname = Path2QString(fileName);
-			QFile file(fname);
-            if (!file.open(QIODevice::ReadOnly))
-                throw runtime_error("Internal error in ResultDialog::MD5ThreadImpl(): error while reading file: " + fname.toStdString());
-            QByteArray data = file.readAll();
-            //LM_LOG("Size: " << data.size());
-			hash.addData(data);
-			file.close();
-		}
-
-		// Check the result
-		const string md5 = QString(hash.result().toHex()).toStdString();
-		LM_LOG("Scene files MD5: [" << md5 << "]");
-
-		if (!strcmp(resultDialog->sceneName, SCENE_FOOD)) {
-			if (md5 == "2d70f0078c15709f99d28e05b2617735")
-				emit resultDialog->sceneValidationLabelChanged("OK", true, true);
-			else
-				emit resultDialog->sceneValidationLabelChanged("Failed", true, false);
-		} else if (!strcmp(resultDialog->sceneName, SCENE_HALLBENCH)) {
-			if (md5 == "12dfdd54a35d3aca3538bbb15ce15bc7")
-				emit resultDialog->sceneValidationLabelChanged("OK", true, true);
-			else
-				emit resultDialog->sceneValidationLabelChanged("Failed", true, false);
-		} else if (!strcmp(resultDialog->sceneName, SCENE_WALLPAPER)) {
-			if (md5 == "3b5d82294d227245ddd16d3723a2593f")
-				emit resultDialog->sceneValidationLabelChanged("OK", true, true);
-			else
-				emit resultDialog->sceneValidationLabelChanged("Failed", true, false);
-		} else {
-			// This should never happen, the thread should have not been started at all
-			LM_LOG("Internal error in ResultDialog::MD5ThreadImpl()");
-			emit resultDialog->sceneValidationLabelChanged("Failed", true, false);
-		}
+		const bool isOk = ValidateSceneFiles(resultDialog->sceneName,
+				boost::bind(&ResultDialog::SceneValidationProgress, resultDialog, _1));
+
+		emit resultDialog->sceneValidationLabelChanged(isOk ? "OK" : "Failed", true, isOk);
 	} catch (exception &err) {
 		LM_ERROR("SCENE VALIDATION ERROR: " << err.what());
 
@@ -269,74 +195,17 @@ void ResultDialog::ImageThreadImpl(ResultDialog *resultDialog) {
 	// Begin the image validation process
 	emit resultDialog->imageValidationLabelChanged("Starting...", false, false);
 
-	float *referenceImage = NULL;
-	float *testImage = NULL;
 	try {
-		// Extract the scene directory name
-		boost::filesystem::path scenePath = boost::filesystem::path(resultDialog->sceneName).parent_path();
-		LM_LOG("Image validation scene path: [" << scenePath << "]");
-
-		const u_int dataCount = resultDialog->frameBufferWidth * resultDialog->frameBufferHeight * 3;
-
-		// Read the reference file
-		if (!strcmp(resultDialog->sceneName, SCENE_FOOD) ||
-				!strcmp(resultDialog->sceneName, SCENE_HALLBENCH) ||
-				!strcmp(resultDialog->sceneName, SCENE_WALLPAPER)) {
-			boost::filesystem::path fileName;
-			if ((resultDialog->mode == BENCHMARK_OCL_GPU) ||
-					(resultDialog->mode == BENCHMARK_OCL_CPUGPU) ||
-					(resultDialog->mode == BENCHMARK_OCL_CPU) ||
-					(resultDialog->mode == BENCHMARK_HYBRID) ||
-					(resultDialog->mode == BENCHMARK_HYBRID_CUSTOM) ||
-					(resultDialog->mode == BENCHMARK_OCL_CUSTOM)) {
-                fileName = scenePath / "reference.raw";
-            } else if (resultDialog->mode == BENCHMARK_NATIVE) {
-				fileName = scenePath / "reference.raw";
-			} else
-				throw std::runtime_error("Internal error in ResultDialog::ImageThreadImpl(): unknown mode");
-			LM_LOG("Image validation file name: [" << fileName << "]");
-
-			// Read the raw data
-			QFile rawFile(Path2QString(fileName));
-			if (!rawFile.open(QIODevice::ReadOnly))
-				throw std::runtime_error("Internal error in ResultDialog::ImageThreadImpl(): unable to open image reference file");
-			const QByteArray rawData = rawFile.readAll();
-			rawFile.close();
-
-			// Check the image size
-			if (rawData.size() != (int)dataCount)
-				throw std::runtime_error("Internal error in ResultDialog::ImageThreadImpl(): wrong image size");
-
-			// Create reference image
-			referenceImage = new float[dataCount];
-			const unsigned char *pixels = reinterpret_cast<const unsigned char *>(rawData.constData());
-			for (u_int i = 0; i < dataCount; ++i)
-				referenceImage[i] = pixels[i] / 255.f;
-		} else
-			throw std::runtime_error("Internal error in ResultDialog::ImageThreadImpl(): unknown scene");
-
-		// Create test image
-		testImage = new float[dataCount];
-		for (u_int i = 0; i < dataCount; ++i)
-			testImage[i] = resultDialog->frameBuffer[i] / 255.f;
-
-		// Run the image comparison
-		lux::ConvergenceTest convTest(resultDialog->frameBufferWidth, resultDialog->frameBufferHeight);
-
-		// Reference image
-		convTest.Test(referenceImage);
-
-		// Test image
-		emit resultDialog->imageValidationLabelChanged("Comparing...", false, false);
-		const u_int diffPixelCount = convTest.Test(testImage);
-
-		const float errorTreshold = (strcmp(resultDialog->sceneName, SCENE_WALLPAPER) == 0) ? 50.f : 33.f;
-		const float errorPerc =  100.f * diffPixelCount / (float)(resultDialog->frameBufferWidth * resultDialog->frameBufferHeight);
-		const bool isOk = (errorPerc < errorTreshold);
+		string description;
+		const bool isOk = ValidateImage(resultDialog->sceneName, resultDialog->mode,
+				resultDialog->descs, resultDialog->oclImageValidation,
+				resultDialog->frameBuffer, resultDialog->frameBufferWidth, resultDialog->frameBufferHeight,
+				boost::bind(&ResultDialog::ImageValidationProgress, resultDialog, _1),
+				description);
 
 		stringstream ss;
         ss << (isOk ? "OK" : "Failed");
-        ss << " (" << diffPixelCount << " different pixels, " << fixed << setprecision(2) << errorPerc << "%)";
+		ss << " (" << description << ")";
 
 		emit resultDialog->imageValidationLabelChanged(ss.str().c_str(), true, isOk);
 	} catch (exception &err) {
@@ -344,7 +213,4 @@ void ResultDialog::ImageThreadImpl(ResultDialog *resultDialog) {
 
 		emit resultDialog->imageValidationLabelChanged("Error", true, false);
 	}
-	
-	delete[] testImage;
-	delete[] referenceImage;
 }
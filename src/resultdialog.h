@@ -25,8 +25,6 @@
 #ifndef Q_MOC_RUN
 #include <cstddef>
 
-#include <boost/filesystem.hpp>
-
 #include "luxmarkdefs.h"
 #include "hardwaretree.h"
 #endif
@@ -42,8 +40,10 @@ public:
 			const char *sceneName,
 			const double sampleSecs,
 			const vector<BenchmarkDeviceDescription> descs,
-			const unsigned char *frameBuffer,
+			const float *frameBuffer,
 			const u_int frameBufferWidth, const u_int frameBufferHeight,
+			const string &overheadReport,
+			const bool oclImageValidation,
 			const bool singleRunExtInfo,
 			QWidget *parent = NULL);
 	~ResultDialog();
@@ -51,9 +51,8 @@ public:
 private:
 	static void MD5ThreadImpl(ResultDialog *resultDialog);
 	static void ImageThreadImpl(ResultDialog *resultDialog);
-	static void AddSceneFiles(ResultDialog *resultDialog,
-			vector<boost::filesystem::path> &files,
-			const boost::filesystem::path &path);
+	void SceneValidationProgress(const string &msg);
+	void ImageValidationProgress(const string &msg);
 	void PrintExtInfoAndExit();
 
 	Ui::ResultDialog *ui;
@@ -62,8 +61,13 @@ private:
 	const char *sceneName;
 	double sampleSec;
 	const vector<BenchmarkDeviceDescription> descs;
-	const unsigned char *frameBuffer;
+	// The float image pipeline output of the film
+	const float *frameBuffer;
 	u_int frameBufferWidth, frameBufferHeight;
+	// The time spent displaying the rendering during the benchmark
+	string overheadReport;
+	// Use the OpenCL version of the image validation metric
+	bool oclImageValidation;
 	DeviceListModel *deviceListModel;
 
 	bool sceneValidationDone, sceneValidationOk;